@@ -101,6 +101,11 @@ void AgentInterface::handle_button_press(agent_interface::ButtonPress& button_pr
         std::cout << +button_press_data.pressed_buttons()[i];
     }
 
+    if (button_press_data.frame_skip() != 0)
+    {
+        frame_skip_request_ = static_cast<int32_t>(button_press_data.frame_skip());
+    }
+
     {
         std::scoped_lock lock(buttons_mutex_);
         last_buttons_ = button_press_data;
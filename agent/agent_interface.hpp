@@ -34,6 +34,18 @@ public:
 	// called from the UI thread when polling button status
 	bool is_button_pressed(Joypads::Button);
 
+	// called from the emulation thread, returns the frame skip an agent asked for since the
+	// last call or NO_REQUEST
+	static constexpr int32_t NO_REQUEST = 0;
+	int32_t take_frame_skip_request()
+	{
+		if (frame_skip_request_.load(std::memory_order_relaxed) == NO_REQUEST)
+		{
+			return NO_REQUEST;
+		}
+		return frame_skip_request_.exchange(NO_REQUEST);
+	}
+
 private:
 	AgentInterface(const AgentInterface&) = delete;
 	AgentInterface& operator=(const AgentInterface&) = delete;
@@ -51,6 +63,8 @@ private:
 	std::mutex buttons_mutex_;
 	agent_interface::ButtonPress last_buttons_;
 	uint64_t buttons_expiration_;
+
+	std::atomic<int32_t> frame_skip_request_{NO_REQUEST};
 };
 
 class AgentConnection
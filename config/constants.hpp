@@ -7,5 +7,7 @@
 
 static constexpr std::string_view SNAPSHOTS_OUTPUT_PATH = "/Users/jesse/Desktop/nes_screenshots/";
 static constexpr std::string_view AGENT_SOCKET_PATH = "/tmp/nes_screenshot_server.sock";
+static constexpr std::string_view ROM_LIBRARY_CATALOG_PATH = "/Users/jesse/Desktop/nes_rom_library.catalog";
+static constexpr std::string_view ROM_CACHE_PATH = "/tmp/nes_rom_cache/"; // uncompressed .zip and .gz ROMs
 
 #endif  // __CONSTANTS_H__
@@ -15,4 +15,12 @@ static constexpr bool ENABLE_APU_PARAMETERS_LOGGING = false;
 // E684  4C B3 EA  JMP $EAB3    c14532915    i4977228     A:00 X:00 Y:20 P:27 SP:FC 
 static constexpr bool ENABLE_CPU_LOGGING = false;
 
+// Renders PPU frames on a separate thread, one frame behind the emulation. The emulation
+// thread's PPU only keeps timing and status and logs its accesses for the render thread to
+// replay. Output is the same as rendering on the emulation thread.
+static constexpr bool ENABLE_PIPELINED_PPU_RENDERING = false;
+
+// Scanlines without any dirty tiles are copied from the previous frame instead of rendered
+static constexpr bool ENABLE_PPU_CLEAN_SCANLINE_SKIP = false;
+
 #endif  // __FLAGS_H__
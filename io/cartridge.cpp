@@ -1,361 +1,711 @@
 #include "io/cartridge.hpp"
 
+#include "io/crc32.hpp"
+#include "io/rom_archive.hpp"
+#include "io/rom_database.hpp"
+#include "io/rom_image.hpp"
 #include "lib/magic_enum.hpp"
 
+#include <algorithm>
+#include <array>
+
 #include <glog/logging.h>
 
 class Cartridge_NROM : public Cartridge
 {
+    // No registers, 16KB or 32KB of PRG (16KB mirrored at $C000) and 8KB of CHR
 protected:
     friend class Cartridge;
-    Cartridge_NROM(std::shared_ptr<MappedFile> file, Format format, std::string_view name)
-     : Cartridge(file, format, name) {}
+    Cartridge_NROM(std::shared_ptr<const RomImage> rom, const Header& header, std::string_view name)
+     : Cartridge(rom, header, name) {}
+
+    void write(uint16_t, uint8_t) override {}
+
+    void reset() override;
+};
+
+void Cartridge_NROM::reset()
+{
+    map_prg(0, 0, 2);
+    map_prg(2, -1, 2);
+    map_chr(0, 0, CHR_SLOT_COUNT);
+    map_prg_ram(true);
+    map_nametables(nametable_mirroring());
+}
+
+class Cartridge_MMC1 : public Cartridge
+{
+    // https://www.nesdev.org/wiki/MMC1
+    // Registers are loaded one bit at a time through a shift register, the fifth write copies
+    // it to the register selected by the address.
+protected:
+    friend class Cartridge;
+    Cartridge_MMC1(std::shared_ptr<const RomImage> rom, const Header& header, std::string_view name)
+     : Cartridge(rom, header, name) {}
 
-    uint8_t read(uint16_t a) const override;
     void write(uint16_t a, uint8_t v) override;
-    uint8_t ppu_read(uint16_t a) const override;
 
     void reset() override;
 
 private:
-    std::span<uint8_t> cpu_mapping_; // data mapped to 0x8000 - 0xBFFF
-    std::span<uint8_t> ppu_mapping_; // data mapped to 0x0000 - 0x1FFF
+    void update_banks();
 
-    std::array<uint8_t, 0x1000> prg_ram_; // 4kb, mapper 0 @ 0x6000, mirrored to 0x8000
+    int32_t load_write_count_{0};
+    uint8_t load_register_{0};
+    uint8_t control_register_{0};
+    uint8_t chr_bank0_register_{0};
+    uint8_t chr_bank1_register_{0};
+    uint8_t prg_bank_register_{0};
 };
 
-uint8_t Cartridge_NROM::read(uint16_t a) const
+void Cartridge_MMC1::write(uint16_t a, uint8_t v)
 {
-    assert(a >= 0x4020);
+    if (a < 0x8000)
+    {
+        return; // prg ram is disabled
+    }
 
-    if (a < 0x6000)
+    if (v & 0x80) // clear shift register, back to the fixed last bank
     {
-        return 0;
+        load_register_ = 0;
+        load_write_count_ = 0;
+        control_register_ |= 0x0C;
+        update_banks();
+        return;
     }
+    load_register_ = load_register_ >> 1;
+    load_register_ |= (v & 0x01) << 4;
+    load_write_count_++;
 
-    if (a >= 0x6000 && a < 0x8000)
+    if (load_write_count_ < 5)
     {
-        return prg_ram_[a % 0x1000];
+        return;
     }
 
-    if (a >= 0xC000 && cpu_mapping_.size() == 0x4000) // 16kb roms (0x4000) are mirrored at 0xC000
+    if (a < 0xA000)
+    {
+        control_register_ = load_register_;
+    }
+    else if (a < 0xC000)
     {
-        return cpu_mapping_[a - 0xC000];
+        chr_bank0_register_ = load_register_;
     }
+    else if (a < 0xE000)
+    {
+        chr_bank1_register_ = load_register_;
+    }
+    else
+    {
+        prg_bank_register_ = load_register_;
+    }
+    update_banks();
 
-    return cpu_mapping_[a - 0x8000];
+    load_register_ = 0;
+    load_write_count_ = 0;
 }
 
-void Cartridge_NROM::write(uint16_t a, uint8_t v)
+void Cartridge_MMC1::update_banks()
 {
-    if (a >= 0x6000 && a < 0x8000)
+    static constexpr std::array<PPUPageTable::NametableMirroring, 4> MIRRORING =
     {
-        prg_ram_[a % 0x1000] = v;
-        return;
-    }
-    assert(false);
-}
+        PPUPageTable::NametableMirroring::SingleScreenLower,
+        PPUPageTable::NametableMirroring::SingleScreenUpper,
+        PPUPageTable::NametableMirroring::Vertical,
+        PPUPageTable::NametableMirroring::Horizontal,
+    };
+    map_nametables(MIRRORING[control_register_ & 0x03]);
+
+    // 512KB boards (SUROM) select the 256KB half with bit 4 of the chr bank registers
+    const int32_t outer_bank = sizeof_prg_rom() > 0x40000 ? (chr_bank0_register_ & 0x10) : 0;
+    const int32_t prg_bank = outer_bank | (prg_bank_register_ & 0x0F);
+
+    switch ((control_register_ >> 2) & 0x03)
+    {
+        case 0:
+        case 1: // 32KB, ignoring the low bit of the bank
+            map_prg(0, prg_bank >> 1, 4);
+            break;
 
-uint8_t Cartridge_NROM::ppu_read(uint16_t a) const
-{
-    assert(a <= 0x2000);
+        case 2: // first bank fixed at $8000, 16KB switched at $C000
+            map_prg(0, outer_bank, 2);
+            map_prg(2, prg_bank, 2);
+            break;
 
-    return ppu_mapping_[a];
-}
+        case 3: // 16KB switched at $8000, last bank fixed at $C000
+            map_prg(0, prg_bank, 2);
+            map_prg(2, outer_bank | 0x0F, 2);
+            break;
+    }
 
-void Cartridge_NROM::reset()
-{
-    if (mapper() == 0)
+    if (control_register_ & 0x10) // two 4KB banks
     {
-        cpu_mapping_ = prg_rom(0, sizeof_prg_rom());
-
-        if (chr_rom(0, sizeof_chr_rom()))
-        {
-            ppu_mapping_ = chr_rom(0, sizeof_chr_rom()).value();
-        }
-        return;
+        map_chr(0, chr_bank0_register_, 4);
+        map_chr(4, chr_bank1_register_, 4);
     }
-    else if( mapper() == 1)
+    else // 8KB, ignoring the low bit of the bank
     {
-
+        map_chr(0, chr_bank0_register_ >> 1, 8);
     }
-    assert(false);
+
+    map_prg_ram(!(prg_bank_register_ & 0x10));
 }
 
-class Cartridge_MMC1 : public Cartridge
+void Cartridge_MMC1::reset()
 {
+    load_register_ = 0;
+    load_write_count_ = 0;
+    control_register_ = 0x0C;
+    chr_bank0_register_ = 0;
+    chr_bank1_register_ = 0;
+    prg_bank_register_ = 0;
+
+    update_banks();
+}
+
+class Cartridge_MMC3 : public Cartridge, public ScanlineCounter
+{
+    // https://www.nesdev.org/wiki/MMC3
+    // Eight bank registers written through a select and data pair: two 2KB and four 1KB CHR banks
+    // and two switchable 8KB PRG banks, the other two PRG slots are fixed to the second to last
+    // and last banks. The scanline counter reloads from the latch when it's zero and asserts the
+    // IRQ when it reaches zero again.
 protected:
     friend class Cartridge;
-    Cartridge_MMC1(std::shared_ptr<MappedFile> file, Format format, std::string_view name)
-     : Cartridge(file, format, name) {}
+    Cartridge_MMC3(std::shared_ptr<const RomImage> rom, const Header& header, std::string_view name)
+     : Cartridge(rom, header, name) {}
 
-    uint8_t read(uint16_t a) const override;
     void write(uint16_t a, uint8_t v) override;
-    uint8_t ppu_read(uint16_t a) const override;
 
     void reset() override;
 
+    ScanlineCounter* scanline_counter() override { return this; }
+    void clock_scanline_counter() override;
+
 private:
-    int32_t load_write_count_{0};
-    uint8_t load_register_{0};
-    uint8_t control_register_{0};
-    uint8_t chr_bank0_register_{0};
-    uint8_t chr_bank1_register_{0};
-    uint8_t pgr_bank_register_{0};
+    void update_prg_banks();
+    void update_chr_banks();
+    void update_prg_ram();
 
-    std::span<uint8_t> chr_bank0_;
-    std::span<uint8_t> chr_bank1_;
+    void set_irq(bool asserted);
 
-    std::span<uint8_t> prg_bank0_;
-    std::span<uint8_t> prg_bank1_;
+    std::array<uint8_t, 8> bank_registers_{};
+    uint8_t bank_select_{0};
+    uint8_t prg_ram_protect_{0};
 
-    std::array<uint8_t, 0x2000> chr_ram_;
-    std::array<uint8_t, 0x1000> prg_ram_; // 4kb, mapper 0 @ 0x6000, mirrored to 0x8000
+    uint8_t irq_latch_{0};
+    uint8_t irq_counter_{0};
+    bool irq_reload_{false};
+    bool irq_enabled_{false};
 };
 
-uint8_t Cartridge_MMC1::read(uint16_t a) const
+void Cartridge_MMC3::write(uint16_t a, uint8_t v)
 {
-    if (a < 0x6000)
+    if (a < 0x8000)
     {
-        return 0;
+        return; // prg ram is disabled or write protected
     }
 
-    if (a >= 0x6000 && a < 0x8000)
+    // each register pair is mirrored over 8KB, even and odd addresses select the register
+    const bool odd = a & 0x0001;
+
+    switch (a & 0xE000)
     {
-        return prg_ram_[a];
+        case 0x8000:
+            if (odd)
+            {
+                const int32_t r = bank_select_ & 0x07;
+                bank_registers_[r] = v;
+
+                if (r < 6)
+                {
+                    update_chr_banks();
+                }
+                else
+                {
+                    update_prg_banks();
+                }
+            }
+            else
+            {
+                bank_select_ = v;
+                update_prg_banks();
+                update_chr_banks();
+            }
+            break;
+
+        case 0xA000:
+            if (odd)
+            {
+                prg_ram_protect_ = v;
+                update_prg_ram();
+            }
+            else if (nametable_mirroring() != PPUPageTable::NametableMirroring::FourScreen)
+            {
+                map_nametables((v & 0x01) ? PPUPageTable::NametableMirroring::Horizontal :
+                                            PPUPageTable::NametableMirroring::Vertical);
+            }
+            break;
+
+        case 0xC000:
+            if (odd) // reloaded from the latch on the next clock
+            {
+                irq_counter_ = 0;
+                irq_reload_ = true;
+            }
+            else
+            {
+                irq_latch_ = v;
+            }
+            break;
+
+        case 0xE000:
+            irq_enabled_ = odd;
+            if (!irq_enabled_) // disabling also acknowledges
+            {
+                set_irq(false);
+            }
+            break;
     }
+}
 
-    if (a >= 0x8000 && a < 0x8000 + prg_bank0_.size())
+void Cartridge_MMC3::clock_scanline_counter()
+{
+    if (irq_counter_ == 0 || irq_reload_)
     {
-        return prg_bank0_[a - 0x8000];
+        irq_counter_ = irq_latch_;
+        irq_reload_ = false;
     }
-    else if (a >= 0xC000)
+    else
     {
-        return prg_bank1_[a - 0xC000];
+        irq_counter_--;
+    }
+
+    if (irq_counter_ == 0 && irq_enabled_)
+    {
+        set_irq(true);
     }
-    return 0;
 }
 
-void Cartridge_MMC1::write(uint16_t a, uint8_t v)
+void Cartridge_MMC3::set_irq(bool asserted)
 {
-    if (a < 0x2000)
+    if (irq_line_)
     {
-        assert(has_chr_ram());
-
-        chr_ram_[a] = v;
+        irq_line_->set(IrqLine::Source::Mapper, asserted);
     }
+}
+
+void Cartridge_MMC3::update_prg_banks()
+{
+    // bit 6 swaps R6 at $8000 with the fixed second to last bank at $C000
+    const bool swapped = bank_select_ & 0x40;
+
+    map_prg(swapped ? 2 : 0, bank_registers_[6] & 0x3F);
+    map_prg(1, bank_registers_[7] & 0x3F);
+    map_prg(swapped ? 0 : 2, -2);
+    map_prg(3, -1);
+}
 
-    if (a >= 0x6000 && a < 0x8000)
+void Cartridge_MMC3::update_chr_banks()
+{
+    // R0 and R1 are 2KB banks (numbered in 1KB, the low bit is ignored) in one pattern table and
+    // R2 - R5 1KB banks in the other, bit 7 swaps the tables
+    const int32_t slot_2kb = (bank_select_ & 0x80) ? 4 : 0;
+    const int32_t slot_1kb = slot_2kb ^ 4;
+
+    map_chr(slot_2kb, bank_registers_[0] >> 1, 2);
+    map_chr(slot_2kb + 2, bank_registers_[1] >> 1, 2);
+
+    for (int32_t i = 0;i < 4;++i)
     {
-        // LOG(INFO) << "write to cartridge ram " << std::hex << "0x" << a << "    " << "0x" << +v;
-        prg_ram_[a] = v;
+        map_chr(slot_1kb + i, bank_registers_[2 + i]);
     }
+}
+
+void Cartridge_MMC3::update_prg_ram()
+{
+    // bit 7 enables, bit 6 protects from writes
+    map_prg_ram(prg_ram_protect_ & 0x80, !(prg_ram_protect_ & 0x40));
+}
+
+void Cartridge_MMC3::reset()
+{
+    bank_registers_ = {0, 2, 4, 5, 6, 7, 0, 1};
+    bank_select_ = 0;
+
+    // PRG-RAM starts enabled, some games never enable it
+    prg_ram_protect_ = 0x80;
+
+    irq_latch_ = 0;
+    irq_counter_ = 0;
+    irq_reload_ = false;
+    irq_enabled_ = false;
+    set_irq(false);
+
+    update_prg_banks();
+    update_chr_banks();
+    update_prg_ram();
+    map_nametables(nametable_mirroring());
+}
+
+// Discrete logic boards are a latch on writes to $8000 - $FFFF whose bits drive the bank address
+// lines, they only differ in which bits select what. A field of the latched value:
+struct LatchField
+{
+    uint8_t shift{0};
+    uint8_t mask{0}; // 0 when the board doesn't have the field
+
+    constexpr bool present() const { return mask != 0; }
+    constexpr int32_t operator () (uint8_t v) const { return (v >> shift) & mask; }
+};
+
+struct DiscreteMapperLayout
+{
+    int32_t prg_bank_slots{4};  // 2: 16KB at $8000 with the last bank fixed at $C000, 4: 32KB
+    LatchField prg;             // without it PRG is fixed like NROM
+    LatchField chr;             // 8KB
+    LatchField single_screen;   // nametable, without it mirroring is from the header
+    bool bus_conflicts{false};  // the ROM drives the bus at the written address too
+};
 
-    if (a >= 0x8000 && a <= 0xFFFF)
+template <DiscreteMapperLayout LAYOUT>
+class Cartridge_Discrete : public Cartridge
+{
+    // A mapper generated from its layout. The fields are template constants, so each mapper
+    // compiles to its own shifts and masks with the missing fields left out.
+protected:
+    friend class Cartridge;
+    Cartridge_Discrete(std::shared_ptr<const RomImage> rom, const Header& header, std::string_view name)
+     : Cartridge(rom, header, name) {}
+
+    void write(uint16_t a, uint8_t v) override
     {
-        if (v & 0x80) // clear shift register
+        if (a < PRG_ADDRESS)
         {
-            load_register_ = 0;
-            load_write_count_ = 0;
             return;
         }
-        load_register_ = load_register_ >> 1;
-        load_register_ |= (v & 0x01) << 4;
-        load_write_count_++;
 
-        if (load_write_count_ == 5)
+        if constexpr (LAYOUT.bus_conflicts)
         {
-            if (a < 0xA000) // control register
+            // the written value and the ROM byte at the address meet on the bus and 0 wins
+            if (const uint8_t* page = cpu_pages_->unpatched_page(a))
             {
-                control_register_ = load_register_;
+                v &= page[a & CPUPageTable::PAGE_MASK];
             }
-            else if (a < 0xC000) // chr bank 0 register
-            {
-                // this does not support all mapper 001 variants, yet
-                if (!has_chr_ram())
-                {
-                    int32_t bank_size = control_register_ & 0x10 ? 0x1000 : 0x2000;
-                    chr_bank0_register_ = load_register_;
+        }
+        latch(v);
+    }
 
-                    chr_bank0_ = chr_rom(chr_bank0_register_ * bank_size, bank_size).value();
-                }
-            }
-            else if (a < 0xE000) // chr bank 1 register
-            {
-                chr_bank1_register_ = load_register_;
+    void reset() override
+    {
+        if constexpr (!LAYOUT.prg.present())
+        {
+            map_prg(0, 0, 2);
+        }
+        if constexpr (!LAYOUT.prg.present() || LAYOUT.prg_bank_slots == 2)
+        {
+            map_prg(2, -1, 2);
+        }
+        if constexpr (!LAYOUT.single_screen.present())
+        {
+            map_nametables(nametable_mirroring());
+        }
+        map_chr(0, 0, CHR_SLOT_COUNT);
+        map_prg_ram(false);
 
-                if (control_register_ & 0x10)
-                {
-                    int32_t bank_size = 0x1000;
+        latch(0);
+    }
 
-                    chr_bank1_ = chr_rom(chr_bank1_register_ * bank_size, bank_size).value();
-                }
-                else
-                {
-                    chr_bank1_ = std::span<uint8_t>();
-                }
+private:
+    void latch(uint8_t v)
+    {
+        if constexpr (LAYOUT.prg.present())
+        {
+            map_prg(0, LAYOUT.prg(v), LAYOUT.prg_bank_slots);
+        }
+        if constexpr (LAYOUT.chr.present())
+        {
+            map_chr(0, LAYOUT.chr(v), CHR_SLOT_COUNT);
+        }
+        if constexpr (LAYOUT.single_screen.present())
+        {
+            map_nametables(LAYOUT.single_screen(v) ? PPUPageTable::NametableMirroring::SingleScreenUpper :
+                                                     PPUPageTable::NametableMirroring::SingleScreenLower);
+        }
+    }
+};
 
-                uint8_t prg_ram_bank = (chr_bank1_register_ & 0x0C) >> 2;
-                // LOG(INFO) << "set prg_ram_bank " << +prg_ram_bank;
-            }
-            else // prg bank register
-            {
-                pgr_bank_register_ = load_register_;
+// https://www.nesdev.org/wiki/UxROM
+static constexpr DiscreteMapperLayout UXROM{.prg_bank_slots = 2, .prg = {0, 0x0F}, .bus_conflicts = true};
+using Cartridge_UxROM = Cartridge_Discrete<UXROM>;
 
-                switch ((control_register_ >> 2) & 0x03)
-                {
-                    case 0:
-                    case 1:
-                    {
-                        int32_t bank_size = 0x8000;
-                        prg_bank0_ = prg_rom((pgr_bank_register_ & 0x0F) * 0x4000, bank_size);
-                        break;
-                    }
-
-                    case 3:
-                    {
-                        int32_t bank_size = 0x4000;
-                        prg_bank0_ = prg_rom((pgr_bank_register_ & 0x0F) * 0x4000, bank_size);
-                        break;
-                    }
-
-                    case 4:
-                    {
-                        int32_t bank_size = 0x4000;
-                        prg_bank0_ = prg_rom((pgr_bank_register_ & 0x0F) * 0x4000, bank_size);
-                        break;
-                    }
-                }
-            }
-            load_register_ = 0;
-            load_write_count_ = 0;
-        }
+// https://www.nesdev.org/wiki/INES_Mapper_003
+static constexpr DiscreteMapperLayout CNROM{.chr = {0, 0x03}, .bus_conflicts = true};
+using Cartridge_CNROM = Cartridge_Discrete<CNROM>;
+
+// https://www.nesdev.org/wiki/AxROM
+static constexpr DiscreteMapperLayout AXROM{.prg = {0, 0x07}, .single_screen = {4, 0x01}};
+using Cartridge_AxROM = Cartridge_Discrete<AXROM>;
+
+// https://www.nesdev.org/wiki/Color_Dreams
+static constexpr DiscreteMapperLayout COLOR_DREAMS{.prg = {0, 0x03}, .chr = {4, 0x0F}, .bus_conflicts = true};
+using Cartridge_ColorDreams = Cartridge_Discrete<COLOR_DREAMS>;
+
+// https://www.nesdev.org/wiki/GxROM
+static constexpr DiscreteMapperLayout GXROM{.prg = {4, 0x03}, .chr = {0, 0x03}, .bus_conflicts = true};
+using Cartridge_GxROM = Cartridge_Discrete<GXROM>;
+
+Cartridge::Cartridge(std::shared_ptr<const RomImage> rom, const Header& header, std::string_view name)
+{
+    rom_ = rom;
+    header_ = header;
+    name_ = name;
+
+    if (!valid())
+    {
+        return;
+    }
+
+    prg_rom_ = rom_->prg_rom();
+
+    if (has_chr_ram())
+    {
+        chr_ram_.resize(std::max<size_t>(header_.chr_ram_size, CHR_RAM_SIZE), 0);
+        chr_memory_ = chr_ram_;
+    }
+    else
+    {
+        chr_memory_ = rom_->chr_rom();
     }
+    prg_ram_buffer_.resize(PRG_RAM_SIZE, 0);
+    prg_ram_ = prg_ram_buffer_;
+}
+
+bool Cartridge::valid() const
+{
+    return format() == Format::iNES || format() == Format::iNES2 || format() == Format::NSF;
 }
 
-uint8_t Cartridge_MMC1::ppu_read(uint16_t a) const
+namespace
 {
-    assert(a <= 0x2000);
 
-    if (a < chr_bank0_.size())
+// NES 2.0 ROM sizes, https://www.nesdev.org/wiki/NES_2.0#PRG-ROM_Area
+// With the most significant nibble $F the least significant byte is an exponent and multiplier,
+// 2^E * (M * 2 + 1) bytes, otherwise the 12 bits count units.
+uint32_t nes2_rom_size(uint8_t lsb, uint8_t msb_nibble, uint32_t unit)
+{
+    if (msb_nibble == 0x0F)
     {
-        return chr_bank0_[a];
+        const uint32_t exponent = lsb >> 2;
+        const uint64_t multiplier = (lsb & 0x03) * 2 + 1;
+
+        if (exponent >= 32)
+        {
+            return UINT32_MAX; // more than fits in a file, clamped to its size by the cartridge
+        }
+        return static_cast<uint32_t>(std::min<uint64_t>((uint64_t(1) << exponent) * multiplier, UINT32_MAX));
     }
+    return ((msb_nibble << 8) | lsb) * unit;
+}
 
-    return chr_bank1_[a - 0x1000];
+// NES 2.0 RAM sizes are shift counts, 64 << shift bytes and 0 for none
+uint32_t nes2_ram_size(uint8_t shift)
+{
+    return shift ? 64u << shift : 0;
 }
 
-void Cartridge_MMC1::reset()
+}
+
+size_t Cartridge::prg_offset(std::span<const uint8_t> buffer, const Header& header)
 {
-    uint32_t header_size = 16;
-    uint32_t trainer_size = has_trainer() ? 512 : 0;
-    uint32_t prg_rom_size = sizeof_prg_rom();
-    prg_bank0_ = std::span<uint8_t>(&buffer_[header_size + trainer_size], 0x4000); // first 16kb of prg
-    prg_bank1_ = std::span<uint8_t>(&buffer_[header_size + trainer_size + prg_rom_size - 0x4000], 0x4000); // last 16kb of prg
+    return std::min(HEADER_SIZE + (header.trainer ? TRAINER_SIZE : 0), buffer.size());
+}
 
-    uint32_t chr_rom_size = sizeof_chr_rom();
+uint32_t Cartridge::rom_crc32(std::span<const uint8_t> buffer, const Header& header)
+{
+    const size_t offset = prg_offset(buffer, header);
+    const size_t rom_size = std::min<size_t>(size_t(header.prg_rom_size) + header.chr_rom_size, buffer.size() - offset);
+
+    return crc32(buffer.subspan(offset, rom_size));
+}
 
-    if (chr_rom_size == 0)
+Cartridge::Header Cartridge::parse_header(std::span<const uint8_t> buffer)
+{
+    // https://www.nesdev.org/wiki/INES
+    // https://www.nesdev.org/wiki/NES_2.0
+    Header header;
+
+    // note last character is not a space it is 0x1A, substitute / spacer
+    static constexpr std::array<uint8_t, 4> MAGIC = {'N', 'E', 'S', 0x1A};
+    if (buffer.size() < HEADER_SIZE || !std::equal(MAGIC.begin(), MAGIC.end(), buffer.begin()))
     {
-        assert(has_chr_ram());
+        return header;
+    }
+    header.format = (buffer[7] & 0x0C) == 0x08 ? Format::iNES2 : Format::iNES;
 
-        chr_bank0_ = std::span<uint8_t>(chr_ram_.data(), chr_ram_.size()); // 8kb
+    header.mapper = buffer[6] >> 4;
+    header.battery = buffer[6] & 0x02;
+    header.trainer = buffer[6] & 0x04;
+
+    if (buffer[6] & 0x08)
+    {
+        header.mirroring = PPUPageTable::NametableMirroring::FourScreen;
     }
     else
     {
-        chr_bank0_ = std::span<uint8_t>(&buffer_[header_size + trainer_size + prg_rom_size], 0x2000); // 8kb
+        header.mirroring = (buffer[6] & 0x01) ? PPUPageTable::NametableMirroring::Vertical
+                                              : PPUPageTable::NametableMirroring::Horizontal;
     }
-}
 
-Cartridge::Cartridge(std::shared_ptr<MappedFile> file, Format format, std::string_view name)
-{
-    file_ = file;
-    format_ = format;
-    name_ = name;
+    if (header.format == Format::iNES2)
+    {
+        header.mapper |= (buffer[7] & 0xF0) | ((buffer[8] & 0x0F) << 8);
+        header.submapper = buffer[8] >> 4;
+
+        header.prg_rom_size = nes2_rom_size(buffer[4], buffer[9] & 0x0F, 16 * 1024);
+        header.chr_rom_size = nes2_rom_size(buffer[5], buffer[9] >> 4, 8 * 1024);
+
+        header.prg_ram_size = nes2_ram_size(buffer[10] & 0x0F) + nes2_ram_size(buffer[10] >> 4);
+        header.chr_ram_size = nes2_ram_size(buffer[11] & 0x0F) + nes2_ram_size(buffer[11] >> 4);
+        return header;
+    }
+
+    // iNES 1.0 dumps with text in the unused bytes 12 - 15 ("DiskDude!") have garbage in the
+    // upper mapper nibble too
+    if (std::all_of(buffer.begin() + 12, buffer.begin() + HEADER_SIZE, [](uint8_t b) { return b == 0; }))
+    {
+        header.mapper |= buffer[7] & 0xF0;
+    }
+
+    header.prg_rom_size = buffer[4] * 16 * 1024;
+    header.chr_rom_size = buffer[5] * 8 * 1024;
+    header.prg_ram_size = PRG_RAM_SIZE;
+    header.chr_ram_size = header.chr_rom_size ? 0 : CHR_RAM_SIZE;
 
-    buffer_ = file_->buffer();
+    return header;
 }
 
-bool Cartridge::valid() const
+PPUPageTable::NametableMirroring Cartridge::nametable_mirroring() const
 {
-    return format_ == Format::iNES || format_ == Format::iNES2;
+    return header_.mirroring;
 }
 
-uint8_t Cartridge::mapper() const
+namespace
+{
+
+// Bank number within count banks, negative from the end and wrapped past the end
+int32_t wrap_bank(int32_t bank, int32_t count)
 {
-    uint8_t mapper_number = 0;
-    mapper_number |= buffer_[6] >> 4;
-    mapper_number |= buffer_[7] & 0xF0;
+    return count > 0 ? ((bank % count) + count) % count : 0;
+}
 
-    return mapper_number;
 }
 
-uint32_t Cartridge::sizeof_prg_rom() const
+void Cartridge::map_prg(int32_t slot, int32_t bank, int32_t count)
 {
-    // https://www.nesdev.org/wiki/NES_2.0#PRG-ROM_Area
-    uint16_t rom_area = ((buffer_[9] & 0x0F) << 8) | buffer_[4];
-    uint16_t size = 0;
+    assert(cpu_pages_);
+    assert(slot >= 0 && slot + count <= PRG_SLOT_COUNT);
 
-    if ((rom_area & 0x800) == 0)
+    const int32_t bank_size = count * PRG_SLOT_SIZE;
+    if (prg_rom_.size() < static_cast<size_t>(bank_size))
     {
-        size = rom_area;
+        return;
     }
-    else // exponent form
-    {
-        uint16_t exponent = (rom_area >> 2) & 0x003F;
-        uint16_t multiplier = (rom_area & 0x0003);
 
-        size = (2 ^ exponent) * multiplier * 2 + 1;
+    bank = wrap_bank(bank, static_cast<int32_t>(prg_rom_.size() / bank_size));
+    cpu_pages_->map(PRG_ADDRESS + slot * PRG_SLOT_SIZE, prg_rom_.subspan(bank * bank_size, bank_size), false);
+}
+
+void Cartridge::map_chr(int32_t slot, int32_t bank, int32_t count)
+{
+    assert(ppu_pages_);
+    assert(slot >= 0 && slot + count <= CHR_SLOT_COUNT);
+
+    const int32_t bank_size = count * CHR_SLOT_SIZE;
+    if (chr_memory_.size() < static_cast<size_t>(bank_size))
+    {
+        return;
     }
 
-    return size * 16 * 1024;
+    bank = wrap_bank(bank, static_cast<int32_t>(chr_memory_.size() / bank_size));
+    ppu_pages_->map_chr(slot * CHR_SLOT_SIZE, chr_memory_.subspan(bank * bank_size, bank_size), has_chr_ram());
 }
 
-uint32_t Cartridge::sizeof_chr_rom() const
+void Cartridge::map_prg_ram(bool enabled, bool writable)
 {
-    // https://www.nesdev.org/wiki/NES_2.0#PRG-ROM_Area
-    uint16_t rom_area = ((buffer_[9] & 0xF0) << 4) | buffer_[5];
-    uint16_t size = 0;
+    assert(cpu_pages_);
 
-    if ((rom_area & 0x800) == 0)
+    if (enabled)
     {
-        size = rom_area;
+        cpu_pages_->map(PRG_RAM_ADDRESS, prg_ram_, writable);
     }
-    else // exponent form
+    else
     {
-        uint16_t exponent = (rom_area >> 2) & 0x003F;
-        uint16_t multiplier = (rom_area & 0x0003);
-
-        size = (2 ^ exponent) * multiplier * 2 + 1;
+        cpu_pages_->unmap(PRG_RAM_ADDRESS, PRG_RAM_SIZE);
     }
-
-    return size * 8 * 1024;
 }
 
-std::span<uint8_t> Cartridge::prg_rom(int32_t bank_offset, int32_t size) const
+void Cartridge::map_nametables(PPUPageTable::NametableMirroring mirroring)
 {
-    uint32_t header_size = 16;
-    uint32_t trainer_size = has_trainer() ? 512 : 0;
-    return std::span<uint8_t>(&buffer_[header_size + trainer_size + bank_offset], size);
+    assert(ppu_pages_);
+
+    if (mirroring == PPUPageTable::NametableMirroring::FourScreen && four_screen_vram_.empty())
+    {
+        four_screen_vram_.resize(2 * PPUPageTable::PAGE_SIZE, 0);
+    }
+    ppu_pages_->map_nametables(mirroring, four_screen_vram_.data());
 }
 
-std::optional<std::span<uint8_t>> Cartridge::chr_rom(int32_t bank_offset, int32_t size) const
+void Cartridge::open_save_file(const std::filesystem::path& path)
 {
-    uint32_t header_size = 16;
-    uint32_t chr_rom_size = sizeof_chr_rom();
-    uint32_t prg_rom_size = sizeof_prg_rom();
-    uint32_t trainer_size = has_trainer() ? 512 : 0;
+    save_path_ = path;
+    save_file_ = MappedFile::open_exclusive(path, PRG_RAM_SIZE);
 
-    if (chr_rom_size == 0)
+    if (!save_file_)
     {
-        return std::nullopt;
+        // Most likely another instance of the game has the save file. Games use PRG-RAM as work
+        // RAM too, so this instance gets its own copy of the save instead of sharing the mapping.
+        if (std::shared_ptr<MappedFile> saved = MappedFile::open(path))
+        {
+            std::span<uint8_t> buffer = saved->buffer();
+            std::copy_n(buffer.begin(), std::min(buffer.size(), prg_ram_buffer_.size()), prg_ram_buffer_.begin());
+        }
+        LOG(ERROR) << "Battery backed RAM won't be saved";
+        return;
     }
-    return std::span<uint8_t>(&buffer_[header_size + trainer_size + prg_rom_size + bank_offset], size);
+    prg_ram_ = save_file_->buffer();
+    synced_prg_ram_.assign(prg_ram_.begin(), prg_ram_.end());
+
+    LOG(INFO) << "PRG-RAM saved to " << path;
+}
+
+void Cartridge::sync_battery_ram()
+{
+    // the writes went to the mapping through the page table without being seen, comparing 8KB
+    // once a frame finds the frames that changed it
+    if (!save_file_ || std::equal(prg_ram_.begin(), prg_ram_.end(), synced_prg_ram_.begin()))
+    {
+        return;
+    }
+    std::copy(prg_ram_.begin(), prg_ram_.end(), synced_prg_ram_.begin());
+
+    save_file_->sync_async();
 }
 
-bool Cartridge::has_trainer() const
+bool Cartridge::take_save_file(Cartridge& previous)
 {
-    return buffer_[6] & 0x04;
+    if (save_file_ || !previous.save_file_ || previous.save_path_ != save_path_)
+    {
+        return false;
+    }
+    // the lock belongs to previous's open file, so this cartridge's open failed even though
+    // both are in this process. Closing it releases the lock, the mapping has every write.
+    previous.save_file_->sync_async();
+    previous.prg_ram_ = previous.prg_ram_buffer_;
+    previous.save_file_.reset();
+
+    open_save_file(save_path_);
+
+    return save_file_ != nullptr;
 }
 
 std::ostream& operator << (std::ostream& os, const Cartridge& f)
@@ -366,13 +716,17 @@ std::ostream& operator << (std::ostream& os, const Cartridge& f)
 
     uint32_t sizeofprg = f.sizeof_prg_rom();
 
-    os << std::left << std::setw(23) << std::setfill(' ') << "Format:" << magic_enum::enum_name<Cartridge::Format>(f.format_)  << std::endl;
+    os << std::left << std::setw(23) << std::setfill(' ') << "Format:" << magic_enum::enum_name<Cartridge::Format>(f.format())  << std::endl;
+    os << std::left << std::setw(23) << std::setfill(' ') << "crc32:" << "0x" << std::setw(8) << std::setfill('0') << std::right << f.crc32_ << std::endl;
     os << std::left << std::setw(23) << std::setfill(' ') << "prg-rom:" << "0x" << sizeofprg << std::endl;
     os << std::left << std::setw(23) << std::setfill(' ') << "chr-rom:" << "0x" << f.sizeof_chr_rom() << std::endl;
     os << std::left << std::setw(23) << std::setfill(' ') << "mapper:"  << "0x" << static_cast<int32_t>(f.mapper()) << std::endl;
+    os << std::left << std::setw(23) << std::setfill(' ') << "submapper:"  << "0x" << static_cast<int32_t>(f.header_.submapper) << std::endl;
+    os << std::left << std::setw(23) << std::setfill(' ') << "prg-ram:" << "0x" << f.header_.prg_ram_size << std::endl;
+    os << std::left << std::setw(23) << std::setfill(' ') << "chr-ram:" << "0x" << f.header_.chr_ram_size << std::endl;
     os << std::left << std::setw(23) << std::setfill(' ') << "battery:" << (f.has_battery() ? "yes" : "no") << std::endl;
     os << std::left << std::setw(23) << std::setfill(' ') << "trainer:" << (f.has_trainer() ? "yes" : "no") << std::endl;
-    os << std::left << std::setw(23) << std::setfill(' ') << "nametable mirroring:" << (f.horizontal_nametable_mirroring() ? "horizontal" : "vertical") << std::endl;
+    os << std::left << std::setw(23) << std::setfill(' ') << "nametable mirroring:" << magic_enum::enum_name(f.nametable_mirroring()) << std::endl;
 
     return os;
 }
@@ -380,7 +734,7 @@ std::ostream& operator << (std::ostream& os, const Cartridge& f)
 std::shared_ptr<Cartridge> Cartridge::create(std::filesystem::path path)
 {
     std::shared_ptr<Cartridge> result_cartridge;
-    std::shared_ptr<MappedFile> file = MappedFile::open(path.c_str());
+    std::shared_ptr<MappedFile> file = open_rom_file(path);
 
     if (!file)
     {
@@ -388,52 +742,103 @@ std::shared_ptr<Cartridge> Cartridge::create(std::filesystem::path path)
     }
 
     std::span<uint8_t> buffer = file->buffer();
-    std::string_view header_constant(reinterpret_cast<char*>(buffer.data()), 4);
-    Format format = Format::Unknown;
+    Header header = parse_header(buffer);
 
-    // note last character is not a space it is 0x1A, substitute / spacer
-    if (header_constant.starts_with("NES"))
+    if (header.format == Format::Unknown)
     {
-        // iNES header
-        if ((buffer[7] & 0xC0) == 0x80)
-        {
-            format = Format::iNES2;
-        }
-        else
-        {
-            format = Format::iNES;
-        }
-        // Layout
-        // headers (16 bytes)
-        // trainer (optional, 512 bytes)
-        // prg-rom
-        // chr-rom
-        // misc-rom
+        return result_cartridge;
+    }
+
+    // Layout
+    // headers (16 bytes)
+    // trainer (optional, 512 bytes)
+    // prg-rom
+    // chr-rom
+    // misc-rom
+    const size_t prg_offset = Cartridge::prg_offset(buffer, header);
+    const uint32_t rom_crc32 = Cartridge::rom_crc32(buffer, header);
+
+    if (const RomDatabaseEntry* known = find_rom(rom_crc32))
+    {
+        LOG_IF(WARNING, known->mapper != header.mapper || known->mirroring != header.mirroring ||
+                        known->battery != header.battery)
+            << path.filename() << " has a bad header, using the ROM database";
+
+        header.mapper = known->mapper;
+        header.submapper = known->submapper;
+        header.mirroring = known->mirroring;
+        header.battery = known->battery;
+        header.prg_ram_size = known->prg_ram_size;
+        header.chr_ram_size = known->chr_ram_size;
     }
 
-    if (format == Format::Unknown)
+    std::span<const uint8_t> prg_rom = buffer.subspan(prg_offset, std::min<size_t>(header.prg_rom_size, buffer.size() - prg_offset));
+
+    const size_t chr_offset = prg_offset + prg_rom.size();
+    std::span<const uint8_t> chr_rom = buffer.subspan(chr_offset, std::min<size_t>(header.chr_rom_size, buffer.size() - chr_offset));
+
+    LOG_IF(ERROR, prg_rom.size() < header.prg_rom_size || chr_rom.size() < header.chr_rom_size)
+        << path.filename() << " is smaller than its header says";
+
+    // The file is only read here, the cartridge maps the shared copy of its ROM
+    std::shared_ptr<const RomImage> rom = RomImage::share(rom_crc32, prg_rom, chr_rom);
+    if (!rom)
     {
         return result_cartridge;
     }
 
-    uint8_t mapper_number = 0;
-    mapper_number |= buffer[6] >> 4;
-    mapper_number |= buffer[7] & 0xF0;
+    const uint16_t mapper_number = header.mapper;
 
     switch(mapper_number)
     {
         case 0:
-            result_cartridge.reset(new Cartridge_NROM(file, format, path.filename().string()));
+            result_cartridge.reset(new Cartridge_NROM(rom, header, path.filename().string()));
             break;
 
         case 1:
-            result_cartridge.reset(new Cartridge_MMC1(file, format, path.filename().string()));
+            result_cartridge.reset(new Cartridge_MMC1(rom, header, path.filename().string()));
+            break;
+
+        case 2:
+            result_cartridge.reset(new Cartridge_UxROM(rom, header, path.filename().string()));
+            break;
+
+        case 3:
+            result_cartridge.reset(new Cartridge_CNROM(rom, header, path.filename().string()));
+            break;
+
+        case 4:
+            result_cartridge.reset(new Cartridge_MMC3(rom, header, path.filename().string()));
+            break;
+
+        case 7:
+            result_cartridge.reset(new Cartridge_AxROM(rom, header, path.filename().string()));
+            break;
+
+        case 11:
+            result_cartridge.reset(new Cartridge_ColorDreams(rom, header, path.filename().string()));
+            break;
+
+        case 66:
+            result_cartridge.reset(new Cartridge_GxROM(rom, header, path.filename().string()));
             break;
 
         default:
             LOG(ERROR) << "Unsupported mapper (" << +mapper_number << ")";
             return result_cartridge;
     }
+    result_cartridge->crc32_ = rom_crc32;
+
+    if (result_cartridge->valid() && result_cartridge->has_battery())
+    {
+        // game.nes.gz saves to game.sav like game.nes
+        std::filesystem::path save_path = path.replace_extension();
+        if (save_path.extension() == ".nes")
+        {
+            save_path.replace_extension();
+        }
+        result_cartridge->open_save_file(save_path.concat(".sav"));
+    }
     LOG(INFO) << *result_cartridge;
 
     return result_cartridge;
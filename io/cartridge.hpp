@@ -1,6 +1,13 @@
 #pragma once
 
 #include "io/files.hpp"
+#include "io/rom_image.hpp"
+#include "processor/cpu_page_table.hpp"
+#include "processor/irq_line.hpp"
+#include "processor/ppu_page_table.hpp"
+#include "processor/scanline_counter.hpp"
+
+#include <vector>
 
 class Cartridge
 {
@@ -10,48 +17,143 @@ public:
     {
         Unknown,
         iNES,
-        iNES2
+        iNES2,
+        NSF // music only, Cartridge_NSF
+    };
+
+    // The cartridge's parameters, from the iNES or NES 2.0 header
+    struct Header
+    {
+        Format format{Format::Unknown};
+        uint16_t mapper{0};
+        uint8_t submapper{0};
+        PPUPageTable::NametableMirroring mirroring{PPUPageTable::NametableMirroring::Horizontal};
+        bool battery{false};
+        bool trainer{false};
+        uint32_t prg_rom_size{0};
+        uint32_t chr_rom_size{0};
+        uint32_t prg_ram_size{0};
+        uint32_t chr_ram_size{0};
     };
 
-    // Instantiates a cartridge from the file. Mapper 0 is handeled directly by this class,
-    // other mappers will be derived classes.
+    static constexpr size_t HEADER_SIZE = 16;
+    static constexpr size_t TRAINER_SIZE = 512;
+
+    // Format is Unknown when the buffer doesn't start with an iNES header
+    static Header parse_header(std::span<const uint8_t> buffer);
+
+    // Offset of the PRG-ROM in the file, after the header and the trainer
+    static size_t prg_offset(std::span<const uint8_t> buffer, const Header& header);
+
+    // CRC32 of the PRG-ROM and CHR-ROM sizes in the header, what ROM databases list. Bytes after
+    // them (padding, title blocks) aren't part of the ROM.
+    static uint32_t rom_crc32(std::span<const uint8_t> buffer, const Header& header);
+
+    // Instantiates a cartridge from the file, with the subclass for its mapper. The ROM is
+    // identified by the CRC32 of its PRG and CHR, and a ROM in the database gets the database's
+    // parameters instead of its header's. Cartridges of the same ROM share one RomImage.
     static std::shared_ptr<Cartridge> create(std::filesystem::path path);
 
     bool valid() const;
 
-    // Mapper subclasses implement these
-    virtual uint8_t read(uint16_t a) const = 0;
+    // The CPU and PPU read the cartridge's memory through their page tables. These are only
+    // called for the addresses without memory mapped: writes to the mapper registers, and reads
+    // of $4020 - $5FFF or of disabled PRG-RAM, which are open bus.
+    virtual uint8_t read(uint16_t) const { return 0; }
     virtual void write(uint16_t a, uint8_t v) = 0;
-    virtual uint8_t ppu_read(uint16_t a) const = 0;
 
+    // Mappers map their banks and nametables into the page tables on reset and reprogram them
+    // as the game switches banks
     virtual void reset() = 0;
 
-    bool horizontal_nametable_mirroring() const { return buffer_[6] & 0x01; }
-    bool vertical_nametable_mirroring() const { return !horizontal_nametable_mirroring(); }
+    void attach_cpu_page_table(CPUPageTable& cpu_pages) { cpu_pages_ = &cpu_pages; }
+    void attach_ppu_page_table(PPUPageTable& ppu_pages) { ppu_pages_ = &ppu_pages; }
+    void attach_irq_line(IrqLine& irq_line) { irq_line_ = &irq_line; }
+
+    // Mappers that count scanlines return their counter for the PPU to clock
+    virtual ScanlineCounter* scanline_counter() { return nullptr; }
+
+    // Battery backed PRG-RAM is a shared mapping of the .sav file next to the ROM and the game
+    // writes straight into it. Called at frame boundaries, schedules writing it to disk when
+    // the frame changed it.
+    void sync_battery_ram();
+
+    // a battery backed game whose save file couldn't be opened, most likely because another
+    // instance of the game has it: its PRG-RAM is a copy that won't be saved
+    bool battery_ram_unsaved() const { return has_battery() && !save_file_; }
+
+    // A cartridge of the same game replacing previous takes over the save file previous holds
+    // the lock on. Call once previous stopped running, before this cartridge is reset.
+    bool take_save_file(Cartridge& previous);
+
+    // nametable mirroring from the header
+    PPUPageTable::NametableMirroring nametable_mirroring() const;
 
     friend std::ostream& operator << (std::ostream& os, const Cartridge &f);
 
 protected:
-    Cartridge(std::shared_ptr<MappedFile> file, Format format, std::string_view name);
+    // Mappers switch banks in fixed slots. PRG is 4 slots of 8KB at $8000, $A000, $C000 and
+    // $E000, CHR is 8 slots of 1KB over the pattern tables, PRG-RAM is 8KB at $6000. A mapper
+    // only decodes its register writes and points slots at banks.
+    static constexpr int32_t PRG_SLOT_SIZE = 0x2000;
+    static constexpr int32_t PRG_SLOT_COUNT = 4;
+    static constexpr uint16_t PRG_ADDRESS = 0x8000;
+    static constexpr int32_t CHR_SLOT_SIZE = 0x0400;
+    static constexpr int32_t CHR_SLOT_COUNT = 8;
+    static constexpr int32_t PRG_RAM_SIZE = 0x2000;
+    static constexpr uint16_t PRG_RAM_ADDRESS = 0x6000;
+    static constexpr int32_t CHR_RAM_SIZE = 0x2000;
+
+    Cartridge(std::shared_ptr<const RomImage> rom, const Header& header, std::string_view name);
+
+    Format format() const { return header_.format; }
 
-    Format format() const { return format_; }
+    uint16_t mapper() const { return header_.mapper; }
 
-    uint8_t mapper() const;
+    uint32_t sizeof_prg_rom() const { return header_.prg_rom_size; }
+    uint32_t sizeof_chr_rom() const { return header_.chr_rom_size; }
 
-    uint32_t sizeof_prg_rom() const;
-    uint32_t sizeof_chr_rom() const;
+    bool has_trainer() const { return header_.trainer; }
+    bool has_battery() const { return header_.battery; }
+    bool has_chr_ram() const { return header_.chr_rom_size == 0; }
 
-    std::span<uint8_t> prg_rom(int32_t bank_offset, int32_t size) const;
-    std::optional<std::span<uint8_t>> chr_rom(int32_t bank_offset, int32_t size) const;
+    // Point count slots, starting at slot, at a bank the size of count slots. Banks are counted
+    // in that size and negative banks count back from the last one (-1 is the last bank). Bank
+    // numbers past the end wrap, like the address lines a smaller ROM doesn't connect.
+    void map_prg(int32_t slot, int32_t bank, int32_t count = 1);
+    void map_chr(int32_t slot, int32_t bank, int32_t count = 1);
 
-    bool has_trainer() const;
-    bool has_battery() const { return buffer_[6] & 0x02; }
-    bool has_chr_ram() const { return buffer_[5] == 0; }
+    // PRG-RAM at $6000 - $7FFF, unmapped reads and writes go to read() and write()
+    void map_prg_ram(bool enabled, bool writable = true);
 
-    std::span<uint8_t> buffer_;
-    std::shared_ptr<MappedFile> file_;
+    void map_nametables(PPUPageTable::NametableMirroring mirroring);
 
-    Format format_{Format::Unknown};
+    // Back PRG-RAM with the save file when the cartridge has a battery
+    void open_save_file(const std::filesystem::path& path);
+
+    std::shared_ptr<const RomImage> rom_; // shared by every cartridge of the same ROM
+
+    Header header_;
+    uint32_t crc32_{0};
 
     std::string name_;
+
+    CPUPageTable* cpu_pages_{nullptr};
+    PPUPageTable* ppu_pages_{nullptr};
+    IrqLine* irq_line_{nullptr};
+
+    std::span<uint8_t> prg_rom_;    // in rom_
+    std::span<uint8_t> chr_memory_; // CHR-ROM in rom_, or chr_ram_ when the cartridge has none
+
+    std::vector<uint8_t> chr_ram_;
+
+    std::span<uint8_t> prg_ram_; // prg_ram_buffer_, or the save file's mapping
+    std::vector<uint8_t> prg_ram_buffer_;
+
+    std::filesystem::path save_path_;
+    std::shared_ptr<MappedFile> save_file_;
+    std::vector<uint8_t> synced_prg_ram_; // contents at the last sync, to find the dirty frames
+
+    // nametables 2 and 3 for four screen mirroring, allocated when used
+    std::vector<uint8_t> four_screen_vram_;
 };
@@ -0,0 +1,83 @@
+#include "io/cheats.hpp"
+
+#include <array>
+#include <cctype>
+#include <regex>
+#include <string>
+
+namespace
+{
+
+std::optional<CPUPageTable::Patch> decode_game_genie(std::string_view code)
+{
+    static constexpr std::string_view LETTERS = "APZLGITYEOXUKSVN";
+
+    if (code.size() != 6 && code.size() != 8)
+    {
+        return std::nullopt;
+    }
+
+    std::array<uint8_t, 8> n{};
+    for (size_t i = 0;i < code.size();++i)
+    {
+        const size_t index = LETTERS.find(std::toupper(static_cast<unsigned char>(code[i])));
+        if (index == std::string_view::npos)
+        {
+            return std::nullopt;
+        }
+        n[i] = static_cast<uint8_t>(index);
+    }
+
+    // each letter is 4 bits, the address, value and compare bits are shuffled across them
+    CPUPageTable::Patch patch;
+    patch.address = 0x8000 | ((n[3] & 7) << 12) | ((n[5] & 7) << 8) | ((n[4] & 8) << 8) |
+                             ((n[2] & 7) << 4) | ((n[1] & 8) << 4) | (n[4] & 7) | (n[3] & 8);
+
+    if (code.size() == 6)
+    {
+        patch.value = ((n[1] & 7) << 4) | ((n[0] & 8) << 4) | (n[0] & 7) | (n[5] & 8);
+    }
+    else
+    {
+        patch.value = ((n[1] & 7) << 4) | ((n[0] & 8) << 4) | (n[0] & 7) | (n[7] & 8);
+        patch.compare = ((n[7] & 7) << 4) | ((n[6] & 8) << 4) | (n[6] & 7) | (n[5] & 8);
+    }
+    return patch;
+}
+
+std::optional<CPUPageTable::Patch> decode_raw(std::string_view code)
+{
+    static const std::regex raw_regex("(?:0x|\\$)?([0-9A-Fa-f]{4}):([0-9A-Fa-f]{2})(?::([0-9A-Fa-f]{2}))?");
+
+    std::match_results<std::string_view::const_iterator> match;
+    if (!std::regex_match(code.begin(), code.end(), match, raw_regex))
+    {
+        return std::nullopt;
+    }
+
+    CPUPageTable::Patch patch;
+    patch.address = static_cast<uint16_t>(std::stoi(match[1].str(), nullptr, 16));
+    patch.value = static_cast<uint8_t>(std::stoi(match[2].str(), nullptr, 16));
+
+    if (match[3].matched)
+    {
+        patch.compare = static_cast<uint8_t>(std::stoi(match[3].str(), nullptr, 16));
+    }
+
+    if (patch.address < 0x8000)
+    {
+        return std::nullopt;
+    }
+    return patch;
+}
+
+}
+
+std::optional<CPUPageTable::Patch> decode_cheat(std::string_view code)
+{
+    if (std::optional<CPUPageTable::Patch> patch = decode_game_genie(code))
+    {
+        return patch;
+    }
+    return decode_raw(code);
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "processor/cpu_page_table.hpp"
+
+#include <optional>
+#include <string_view>
+
+// Decodes a cheat into the ROM patch it makes: a Game Genie code, 6 letters for an address and
+// value or 8 with a compare value too (https://www.nesdev.org/wiki/Game_Genie), or a raw code in
+// hex, address:value or address:value:compare. The Game Genie only patches $8000 - $FFFF and so
+// do raw codes. nullopt when the code is neither.
+std::optional<CPUPageTable::Patch> decode_cheat(std::string_view code);
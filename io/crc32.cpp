@@ -0,0 +1,94 @@
+#include "io/crc32.hpp"
+
+#include <array>
+#include <bit>
+#include <cstring>
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+namespace
+{
+
+#if !defined(__ARM_FEATURE_CRC32)
+
+// Slicing-by-8: TABLES[k][b] is the CRC of byte b followed by k zero bytes, so the CRC of 8 bytes
+// is the xor of 8 independent lookups instead of a chain of 8 dependent ones
+using CRCTables = std::array<std::array<uint32_t, 256>, 8>;
+
+constexpr CRCTables make_tables()
+{
+    constexpr uint32_t POLYNOMIAL = 0xEDB88320; // reflected 0x04C11DB7
+
+    CRCTables tables{};
+
+    for (uint32_t b = 0;b < 256;++b)
+    {
+        uint32_t crc = b;
+        for (int32_t bit = 0;bit < 8;++bit)
+        {
+            crc = (crc >> 1) ^ ((crc & 1) ? POLYNOMIAL : 0);
+        }
+        tables[0][b] = crc;
+    }
+
+    for (uint32_t b = 0;b < 256;++b)
+    {
+        for (int32_t k = 1;k < 8;++k)
+        {
+            tables[k][b] = (tables[k - 1][b] >> 8) ^ tables[0][tables[k - 1][b] & 0xFF];
+        }
+    }
+    return tables;
+}
+
+constexpr CRCTables TABLES = make_tables();
+
+#endif
+
+}
+
+uint32_t crc32(std::span<const uint8_t> data, uint32_t crc)
+{
+    const uint8_t* p = data.data();
+    size_t size = data.size();
+
+    crc = ~crc;
+
+#if defined(__ARM_FEATURE_CRC32)
+    for (;size >= 8;p += 8, size -= 8)
+    {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        crc = __crc32d(crc, v);
+    }
+    for (;size;++p, --size)
+    {
+        crc = __crc32b(crc, *p);
+    }
+#else
+    // the tables assume little endian loads
+    static_assert(std::endian::native == std::endian::little);
+
+    for (;size >= 8;p += 8, size -= 8)
+    {
+        uint32_t low;
+        uint32_t high;
+        std::memcpy(&low, p, sizeof(low));
+        std::memcpy(&high, p + 4, sizeof(high));
+        low ^= crc;
+
+        crc = TABLES[7][low & 0xFF] ^ TABLES[6][(low >> 8) & 0xFF] ^
+              TABLES[5][(low >> 16) & 0xFF] ^ TABLES[4][low >> 24] ^
+              TABLES[3][high & 0xFF] ^ TABLES[2][(high >> 8) & 0xFF] ^
+              TABLES[1][(high >> 16) & 0xFF] ^ TABLES[0][high >> 24];
+    }
+    for (;size;++p, --size)
+    {
+        crc = (crc >> 8) ^ TABLES[0][(crc ^ *p) & 0xFF];
+    }
+#endif
+
+    return ~crc;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+// CRC-32 (the zlib/PNG polynomial, the one ROM databases list), computed 8 bytes at a time with
+// slicing-by-8 tables, or with the CRC32 instructions on ARM. A 512KB ROM takes well under a
+// millisecond either way. crc continues a previous call's result.
+uint32_t crc32(std::span<const uint8_t> data, uint32_t crc = 0);
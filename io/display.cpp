@@ -4,92 +4,444 @@
 
 #include <glog/logging.h>
 
+#include <cmath>
+#include <cstring>
+
 NesDisplay * global_display_ptr = nullptr;
 
+NesDisplay::NesDisplay()
+{
+    draw_frame_ = pool_.acquire();
+    clear_screen(BLACK);
+}
+
 void NesDisplay::init()
 {
     global_display_ptr = this;
 }
 
-void NesDisplay::clear_screen(Color color)
+void NesDisplay::clear_screen(uint8_t color)
+{
+    std::memset(draw_frame().pixels_, color, sizeof(IndexedBuffer));
+    std::memset(draw_frame().emphasis_, 0, sizeof(draw_frame().emphasis_));
+    draw_dirty_tiles_.fill(ALL_TILE_COLUMNS);
+}
+
+void NesDisplay::draw_pixel(int32_t x, int32_t y, uint8_t color)
+{
+    assert(x >= 0 && y >= 0);
+    if (x >= WIDTH || y >= HEIGHT)
+    {
+        return;
+    }
+
+    draw_frame().pixels_[y][x] = color;
+}
+
+void NesDisplay::copy_scanline_from_display_buffer(int32_t y)
+{
+    if (!last_frame_)
+    {
+        mark_dirty(y, ALL_TILE_COLUMNS);
+        return;
+    }
+    std::memcpy(draw_frame().pixels_[y], last_frame_->pixels_[y], WIDTH);
+    draw_frame().emphasis_[y] = last_frame_->emphasis_[y];
+}
+
+bool NesDisplay::render()
 {
-    for (uint32_t x = 0; x < WIDTH; ++x)
+    // The next frame to draw into has to be found before this one is published. If consumers
+    // hold every frame in the pool this frame is dropped and drawn over, its dirty tiles carry
+    // over to the next frame.
+    FrameRef next_frame = pool_.acquire();
+    if (!next_frame)
+    {
+        stalls_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    VideoFrame* frame = &draw_frame();
+    frame->number_ = ++frame_count_;
+
+    // dirty tiles since each of the earlier frames, from the previous frame's history
+    frame->dirty_since_[0] = draw_dirty_tiles_;
+
+    for (uint64_t n = 1;n < VideoFrame::DIRTY_TILES_HISTORY;++n)
+    {
+        for (int32_t row = 0;row < TILE_ROWS;++row)
+        {
+            frame->dirty_since_[n][row] = draw_dirty_tiles_[row] |
+                (last_frame_ ? last_frame_->dirty_since_[n - 1][row] : ALL_TILE_COLUMNS);
+        }
+    }
+    draw_dirty_tiles_.fill(0);
+
+    last_frame_ = std::move(draw_frame_);
+    draw_frame_ = std::move(next_frame);
+
     {
-        for (uint32_t y = 0; y < HEIGHT; ++y)
+        std::scoped_lock lock(consumers_lock_);
+
+        for (FrameMailbox* consumer : consumers_)
         {
-            draw_pixel(x, y, color);
+            consumer->post(last_frame_);
         }
     }
+
+    refresh_callback_();
+    return true;
 }
 
-void NesDisplay::draw_pixel(int32_t x, int32_t y, Color color)
+void NesDisplay::add_consumer(FrameMailbox* mailbox)
 {
-    assert(x >= 0 && y >= 0);
-    if (x > WIDTH || y > HEIGHT)
+    std::scoped_lock lock(consumers_lock_);
+    consumers_.push_back(mailbox);
+}
+
+void NesDisplay::remove_consumer(FrameMailbox* mailbox)
+{
+    std::scoped_lock lock(consumers_lock_);
+    std::erase(consumers_, mailbox);
+}
+
+bool NesDisplay::set_consumer_scaler(std::string_view name, Scaler scaler)
+{
+    std::scoped_lock lock(consumers_lock_);
+
+    bool found = false;
+    for (FrameMailbox* consumer : consumers_)
     {
-        return;
+        if (consumer->name() == name)
+        {
+            consumer->set_scaler(scaler);
+            found = true;
+        }
     }
+    return found;
+}
 
-    if (y < (OVERSCAN / 2) || y > HEIGHT - (OVERSCAN / 2))
+bool NesDisplay::set_consumer_ntsc_filter(std::string_view name, bool enabled)
+{
+    std::scoped_lock lock(consumers_lock_);
+
+    bool found = false;
+    for (FrameMailbox* consumer : consumers_)
     {
-        color = BLACK;
+        if (consumer->name() == name)
+        {
+            consumer->set_ntsc_filter(enabled);
+            found = true;
+        }
     }
+    return found;
+}
 
-    offscreen_[draw_buffer_index()][y][x] = color;
+void NesDisplay::log_consumer_stats()
+{
+    std::scoped_lock lock(consumers_lock_);
+
+    for (FrameMailbox* consumer : consumers_)
+    {
+        LOG(INFO) << "frames " << consumer->name() << ": delivered " << consumer->delivered()
+                  << " dropped " << consumer->dropped();
+    }
+    LOG_IF(INFO, stalls() > 0) << "frames not published, no free frame: " << stalls();
 }
 
-void NesDisplay::render()
+const std::array<PaletteLUT, NesDisplay::EMPHASIS_COUNT>& NesDisplay::palette_luts()
 {
-    swap_buffers();
+    // RGB with each represented from 0-7. Scale each component to fill the 0-255 range when
+    // generating the NestDisplay color to return.
+    // This is the 2C03 palette from the nesdev wiki: https://www.nesdev.org/wiki/PPU_palettes
+    static constexpr uint16_t COLOR_PALETTE[] =
+    {0x333,0x014,0x006,0x326,0x403,0x503,0x510,0x420,0x320,0x120,0x031,0x040,0x022,0x00,0x00,0x00,
+     0x555,0x036,0x027,0x407,0x507,0x704,0x700,0x630,0x430,0x140,0x040,0x053,0x044,0x00,0x00,0x00,
+     0x777,0x357,0x447,0x637,0x707,0x737,0x740,0x750,0x660,0x360,0x070,0x276,0x077,0x00,0x00,0x00,
+     0x777,0x567,0x657,0x757,0x747,0x755,0x764,0x772,0x773,0x572,0x473,0x276,0x467,0x00,0x00,0x00};
 
-    refresh_callback_();
+    static constexpr uint8_t COLOR_SCALE_FACTOR = 31;
+
+    // Emphasis bits (PPUMASK 5-7: red, green, blue) darken the channels that are not emphasized.
+    // This approximates the NTSC PPU, the 2C03 instead forces the emphasized channel to full.
+    static constexpr float DEEMPHASIS_FACTOR = 0.816f;
+
+    static const std::array<PaletteLUT, EMPHASIS_COUNT> luts = []()
+    {
+        std::array<PaletteLUT, EMPHASIS_COUNT> result;
+
+        for (int32_t e = 0;e < EMPHASIS_COUNT;++e)
+        {
+            const float red_scale = (e & 0x06) ? DEEMPHASIS_FACTOR : 1.0f;
+            const float green_scale = (e & 0x05) ? DEEMPHASIS_FACTOR : 1.0f;
+            const float blue_scale = (e & 0x03) ? DEEMPHASIS_FACTOR : 1.0f;
+
+            for (int32_t i = 0;i < PaletteLUT::SIZE;++i)
+            {
+                const uint8_t red = ((COLOR_PALETTE[i] >> 8) & 0x000F) * COLOR_SCALE_FACTOR;
+                const uint8_t green = ((COLOR_PALETTE[i] >> 4) & 0x000F) * COLOR_SCALE_FACTOR;
+                const uint8_t blue = ((COLOR_PALETTE[i] >> 0) & 0x000F) * COLOR_SCALE_FACTOR;
+
+                result[e].r[i] = e == 0 ? red : static_cast<uint8_t>(red * red_scale);
+                result[e].g[i] = e == 0 ? green : static_cast<uint8_t>(green * green_scale);
+                result[e].b[i] = e == 0 ? blue : static_cast<uint8_t>(blue * blue_scale);
+            }
+        }
+        return result;
+    }();
+
+    return luts;
 }
 
-bool NesDisplay::is_pixel_transparent(int32_t x, int32_t y)
+NesDisplay::Color NesDisplay::palette_color(uint8_t color, uint8_t emphasis)
 {
-    return offscreen_[draw_buffer_index()][y][x].a == 0xFF;
+    const PaletteLUT& lut = palette_luts()[emphasis & 0x07];
+    return rgb(lut.r[color & 0x3F], lut.g[color & 0x3F], lut.b[color & 0x3F]);
+}
+
+void RGBAFrameBuffer::set_output(Scaler scaler, bool ntsc_filter)
+{
+    scaler_ = scaler;
+    ntsc_filter_ = ntsc_filter;
+    buffer_.assign(static_cast<size_t>(width()) * height(), NesDisplay::Color{});
+    frame_ = UINT64_MAX;
+}
+
+const NesDisplay::Color* RGBAFrameBuffer::update(const VideoFrame& frame, Scaler scaler, bool ntsc_filter)
+{
+    if (scaler != scaler_ || ntsc_filter != ntsc_filter_)
+    {
+        set_output(scaler, ntsc_filter);
+    }
+
+    if (frame_ == frame.number())
+    {
+        return data();
+    }
+
+    uint8_t* dst = reinterpret_cast<uint8_t*>(buffer_.data());
+    const int32_t stride = width() * sizeof(NesDisplay::Color);
+
+    if (ntsc_filter_)
+    {
+        // the filter spreads pixels over their neighbors and the phase changes every frame,
+        // filtered frames are converted in full
+        NesDisplay::convert_frame_ntsc(frame, PixelFormat::RGBA8888, dst, stride);
+        frame_ = frame.number();
+        return data();
+    }
+
+    if (scaler_ != Scaler::None)
+    {
+        // the scalers look at neighboring rows, scaled frames are converted in full
+        NesDisplay::convert_frame_scaled(frame, scaler_, PixelFormat::RGBA8888, dst, stride);
+        frame_ = frame.number();
+        return data();
+    }
+
+    // only the tile rows that changed since the last conversion need to be converted again
+    NesDisplay::DirtyTiles dirty;
+    if (frame_ != UINT64_MAX && frame.dirty_tiles_since(frame_, dirty))
+    {
+        for (int32_t row = 0;row < NesDisplay::TILE_ROWS;++row)
+        {
+            if (dirty[row])
+            {
+                NesDisplay::convert_frame_lines(frame, PixelFormat::RGBA8888, dst, stride,
+                                                row * NesDisplay::TILE_SIZE, NesDisplay::TILE_SIZE);
+            }
+        }
+    }
+    else
+    {
+        NesDisplay::convert_frame(frame, PixelFormat::RGBA8888, dst, stride);
+    }
+    frame_ = frame.number();
+
+    return data();
+}
+
+void NesDisplay::convert_frame(const VideoFrame& frame, PixelFormat format, uint8_t* dst, int32_t stride)
+{
+    convert_frame_lines(frame, format, dst, stride, 0, HEIGHT);
+}
+
+void NesDisplay::convert_frame_lines(const VideoFrame& frame, PixelFormat format, uint8_t* dst,
+                                     int32_t stride, int32_t first_line, int32_t line_count)
+{
+    for (int32_t y = first_line;y < first_line + line_count;++y)
+    {
+        uint8_t* dst_line = dst + y * stride;
+
+        if (y < (OVERSCAN / 2) || y > HEIGHT - (OVERSCAN / 2))
+        {
+            fill_pixels(dst_line, WIDTH, 0, 0, 0, format);
+            continue;
+        }
+        convert_indexed_pixels(frame.scanline(y), dst_line, WIDTH, palette_luts()[frame.emphasis(y)], format);
+    }
+}
+
+void NesDisplay::convert_frame_scaled(const VideoFrame& frame, Scaler scaler, PixelFormat format,
+                                      uint8_t* dst, int32_t stride)
+{
+    const int32_t factor = scale_factor(scaler);
+    const int32_t scaled_width = WIDTH * factor;
+
+    thread_local std::vector<uint8_t> scaled;
+    scaled.resize(static_cast<size_t>(scaled_width) * HEIGHT * factor);
+
+    scale_indexed(scaler, &frame.pixels()[0][0], WIDTH, WIDTH, HEIGHT, scaled.data(), scaled_width);
+
+    // each output line takes the emphasis and overscan of the line it was scaled from
+    for (int32_t y = 0;y < HEIGHT * factor;++y)
+    {
+        const int32_t source_y = y / factor;
+        uint8_t* dst_line = dst + y * stride;
+
+        if (source_y < (OVERSCAN / 2) || source_y > HEIGHT - (OVERSCAN / 2))
+        {
+            fill_pixels(dst_line, scaled_width, 0, 0, 0, format);
+            continue;
+        }
+        convert_indexed_pixels(scaled.data() + y * scaled_width, dst_line, scaled_width,
+                               palette_luts()[frame.emphasis(source_y)], format);
+    }
+}
+
+void NesDisplay::convert_frame_ntsc(const VideoFrame& frame, PixelFormat format, uint8_t* dst, int32_t stride)
+{
+    const int32_t filtered_width = WIDTH * NTSC_SCALE;
+
+    for (int32_t y = 0;y < HEIGHT;++y)
+    {
+        uint8_t* dst_line = dst + y * NTSC_SCALE * stride;
+
+        if (y < (OVERSCAN / 2) || y > HEIGHT - (OVERSCAN / 2))
+        {
+            fill_pixels(dst_line, filtered_width, 0, 0, 0, format);
+        }
+        else
+        {
+            ntsc_filter_line(frame.scanline(y), WIDTH, frame.emphasis(y), ntsc_line_phase(frame.number(), y),
+                             dst_line, format);
+        }
+
+        for (int32_t r = 1;r < NTSC_SCALE;++r)
+        {
+            std::memcpy(dst_line + r * stride, dst_line, filtered_width * BYTES_PER_PIXEL);
+        }
+    }
 }
 
 NesDisplayView::NesDisplayView(QQuickItem *parent)
+: QQuickItem(parent)
 {
+    setFlag(ItemHasContents, true);
+
     // bind the nes display refresh callback to the QT signal in ViewUpdateRelay which makes sure
     // the handler is called on the main event thread
-    connect_nes_refresh_callback(std::bind(&ViewUpdateRelay::requestUpdate, &refresh_relay_));
+    connect_nes_refresh_callback([this]()
+    {
+        if (!update_pending_.exchange(true, std::memory_order_acq_rel))
+        {
+            emit refresh_relay_.requestUpdate();
+        }
+    });
 
     // connect the QT signal ViewUpdateRelay to call the NesDisplayView::refresh which will
-    // call the view update() to trigger a re-paint
+    // call the view update() to schedule a scene graph sync
     connect(&refresh_relay_, &ViewUpdateRelay::requestUpdate, this, &NesDisplayView::refresh,
             Qt::QueuedConnection);
+
+    global_display_ptr->add_consumer(&frames_);
 }
 
+NesDisplayView::~NesDisplayView()
+{
+    global_display_ptr->remove_consumer(&frames_);
+}
 
 void NesDisplayView::refresh()
 {
-    update(boundingRect().toAlignedRect());
+    // frames published after this point request another update
+    update_pending_.store(false, std::memory_order_release);
+
+    update();
 }
 
-void NesDisplayView::paint(QPainter *painter)
+void NesDisplayView::geometryChange(const QRectF& new_geometry, const QRectF& old_geometry)
 {
-    std::scoped_lock lock(global_display_ptr->display_buffer_lock());
-    
-    // TODO get instance of NesDisplay and retrieve buffer from it
-    // TODO time this and look at more efficient options
+    QQuickItem::geometryChange(new_geometry, old_geometry);
 
-    qreal scaleFactorX = this->window()->width() / this->window()->devicePixelRatio() / NesDisplay::WIDTH;
-    qreal scaleFactorY = this->window()->height() / this->window()->devicePixelRatio() / NesDisplay::HEIGHT;
+    // the frame is scaled to the new size in updatePaintNode
+    update();
+}
 
-    qreal scaleFactor = qMin(scaleFactorX, scaleFactorY);
+QRectF NesDisplayView::frame_rect() const
+{
+    const qreal scale_x = width() / NesDisplay::WIDTH;
+    const qreal scale_y = height() / NesDisplay::HEIGHT;
 
-    painter->save();
-    painter->scale(scaleFactor, scaleFactor); // Scale the painter
+    qreal scale = qMin(scale_x, scale_y);
+    if (scale >= 1.0)
+    {
+        scale = std::floor(scale);
+    }
 
-    QImage image((const uchar*)global_display_ptr->display_buffer(),
-                 NesDisplay::WIDTH, NesDisplay::HEIGHT,
-                 QImage::Format_RGBA8888);
+    const qreal frame_width = NesDisplay::WIDTH * scale;
+    const qreal frame_height = NesDisplay::HEIGHT * scale;
 
-    painter->drawPixmap(0, 0, NesDisplay::WIDTH * 2, NesDisplay::HEIGHT * 2, // dest rect
-                        QPixmap::fromImage(image),
-                        0, 0,NesDisplay::WIDTH, NesDisplay::HEIGHT); // source rect
+    return QRectF(std::floor((width() - frame_width) / 2), std::floor((height() - frame_height) / 2),
+                  frame_width, frame_height);
+}
+
+QSGNode* NesDisplayView::updatePaintNode(QSGNode* old_node, UpdatePaintNodeData*)
+{
+    // Runs on the scene graph render thread while the GUI thread is blocked
+    QSGSimpleTextureNode* node = static_cast<QSGSimpleTextureNode*>(old_node);
+
+    FrameRef frame = frames_.take();
+
+    // nothing to show until the first frame
+    if (!node && !frame)
+    {
+        return nullptr;
+    }
+
+    const Scaler scaler = frames_.scaler();
+    const bool ntsc_filter = frames_.ntsc_filter();
+
+    // the NTSC filter changes phase every frame, unchanged pixels still change the picture
+    if (frame && (texture_frame_ == UINT64_MAX || frame->changed_since(texture_frame_) || ntsc_filter ||
+                  scaler != texture_scaler_ || ntsc_filter != texture_ntsc_filter_))
+    {
+        rgba_index_ = (rgba_index_ + 1) % rgba_.size();
+        RGBAFrameBuffer& rgba = rgba_[rgba_index_];
+        const NesDisplay::Color* pixels = rgba.update(*frame, scaler, ntsc_filter);
+
+        // wraps the buffer without copying it, opaque so the scene graph doesn't blend
+        QImage image(reinterpret_cast<const uchar*>(pixels), rgba.width(), rgba.height(),
+                     rgba.width() * sizeof(NesDisplay::Color), QImage::Format_RGBX8888);
+
+        QSGTexture* texture = window()->createTextureFromImage(image);
+
+        if (!node)
+        {
+            node = new QSGSimpleTextureNode();
+            node->setOwnsTexture(true);
+            node->setFiltering(QSGTexture::Nearest);
+        }
+        node->setTexture(texture); // deletes the previous texture
+    }
+
+    if (frame)
+    {
+        texture_frame_ = frame->number();
+        texture_scaler_ = scaler;
+        texture_ntsc_filter_ = ntsc_filter;
+    }
 
-    painter->restore();
+    node->setRect(frame_rect());
+    return node;
 }
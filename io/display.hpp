@@ -1,16 +1,39 @@
 #pragma once
 
+#include "io/frame_pool.hpp"
+#include "io/ntsc_filter.hpp"
+#include "io/pixel_formats.hpp"
+#include "io/scalers.hpp"
 #include "platform/view_update_relay.hpp"
 
+#include <array>
+#include <atomic>
 #include <cstdint>
 #include <functional>
 #include <mutex>
+#include <vector>
 
 #include <QtQuick>
-#include <QQuickPaintedItem>
+#include <QQuickItem>
+#include <QSGSimpleTextureNode>
 
 class NesDisplay
 {
+    // The PPU draws into an indexed framebuffer, one byte per pixel holding the NES system
+    // palette color (0x00 - 0x3F), plus the PPUMASK color emphasis bits for each scanline.
+    // Conversion to RGBA is deferred until a consumer (the view, snapshots, the agent) asks for
+    // the frame, so frames that are never looked at never pay for the conversion.
+    //
+    // The PPU also marks which 8x8 tiles changed from the previous frame. Consumers use the dirty
+    // tiles to only convert or re-encode what changed since the frame they last looked at.
+    //
+    // Finished frames are published from a pool of refcounted frames (io/frame_pool.hpp) to the
+    // mailboxes of every consumer. Publishing never copies a frame or waits on a consumer, each
+    // one takes the newest frame when it is ready and holds it for as long as it needs.
+    //
+    // For the view this is a lock free triple buffer: the frame being drawn, the newest complete
+    // frame waiting in the view's mailbox and the frame the view is painting. The pool starts
+    // with those three, so the PPU always has a free frame to draw into.
 public:
     struct Color
     {
@@ -21,58 +44,166 @@ public:
         uint8_t a;
     };
 
-    static constexpr int32_t WIDTH = 256;
-    static constexpr int32_t HEIGHT = 240;
+    static constexpr int32_t WIDTH = VideoFrame::WIDTH;
+    static constexpr int32_t HEIGHT = VideoFrame::HEIGHT;
     static constexpr int32_t OVERSCAN = 16;
-    static constexpr Color BLACK = Color({0, 0, 0, 255});
-    
-    NesDisplay() {}
-    
+    static constexpr uint8_t BLACK = 0x0F; // system palette entry for black
+    static constexpr int32_t EMPHASIS_COUNT = 8;
+
+    // drawing, waiting to be presented, being presented
+    static constexpr int32_t MIN_FRAMES = 3;
+
+    static constexpr int32_t TILE_SIZE = VideoFrame::TILE_SIZE;
+    static constexpr int32_t TILE_ROWS = VideoFrame::TILE_ROWS;
+    static constexpr uint32_t ALL_TILE_COLUMNS = VideoFrame::ALL_TILE_COLUMNS;
+
+    using IndexedBuffer = VideoFrame::IndexedBuffer;
+    using DirtyTiles = VideoFrame::DirtyTiles;
+
+    NesDisplay();
+
     void set_refresh_callback(std::function<void()> callback) { refresh_callback_ = callback; }
 
     void init();
-    void clear_screen(Color color = {0,0,0,0});
-    void draw_pixel(int32_t x, int32_t y, Color color);
-    void render();
-    
+
+    // PPU side, draws into the frame being drawn
+    void clear_screen(uint8_t color = BLACK);
+    void draw_pixel(int32_t x, int32_t y, uint8_t color);
+    uint8_t* scanline(int32_t y) { return draw_frame().pixels_[y]; }
+    void set_emphasis(int32_t y, uint8_t emphasis) { draw_frame().emphasis_[y] = emphasis & 0x07; }
+    // Publish the frame. Returns false when it was dropped because the pool was exhausted.
+    bool render();
+
+    // Mark tile columns of the scanline's tile row as changed from the previous frame
+    void mark_dirty(int32_t y, uint32_t tile_columns) { draw_dirty_tiles_[y / TILE_SIZE] |= tile_columns; }
+
+    // Reuse the previous frame's scanline, for scanlines with nothing dirty
+    void copy_scanline_from_display_buffer(int32_t y);
+
     static constexpr Color rgb(uint8_t r, uint8_t g, uint8_t b) { return {.r = r, .g = g, .b = b, .a = 0xFF}; }
 
-    Color* display_buffer() { return (Color*)offscreen_[display_buffer_index()]; }
-    
-    uint32_t draw_buffer_index() { return draw_buffer_index_ == 1 ? 1 : 0; }
-    uint32_t display_buffer_index() { return draw_buffer_index_ == 1 ? 0 : 1; }
-    
-    void swap_buffers()
-    {
-        std::scoped_lock lock(display_buffer_lock_);
-        draw_buffer_index_ = draw_buffer_index_ == 1 ? 0 : 1;
-    }
-    
-    bool is_pixel_transparent(int32_t x, int32_t y);
+    // RGB value of a system palette entry
+    static Color palette_color(uint8_t color, uint8_t emphasis = 0);
+
+    // Consumer side. Mailboxes receive every published frame until they are removed.
+    void add_consumer(FrameMailbox* mailbox);
+    void remove_consumer(FrameMailbox* mailbox);
+
+    // Frames the PPU finished without a free frame to draw the next one into, because consumers
+    // held every frame in the pool. The emulator doesn't wait, the frame isn't published and is
+    // drawn over.
+    uint64_t stalls() const { return stalls_.load(std::memory_order_relaxed); }
+
+    // Select the scaler of the consumer with the mailbox name. Returns false if there is none.
+    bool set_consumer_scaler(std::string_view name, Scaler scaler);
+    bool set_consumer_ntsc_filter(std::string_view name, bool enabled);
+
+    // Log delivered and dropped frames of each consumer, and the stalls
+    void log_consumer_stats();
 
-    std::mutex& display_buffer_lock() { return display_buffer_lock_; }
+    static void convert_frame(const VideoFrame& frame, PixelFormat format, uint8_t* dst, int32_t stride);
+    static void convert_frame_lines(const VideoFrame& frame, PixelFormat format, uint8_t* dst,
+                                    int32_t stride, int32_t first_line, int32_t line_count);
+
+    // Scale the indexed frame and convert it, dst holds WIDTH * factor x HEIGHT * factor pixels
+    static void convert_frame_scaled(const VideoFrame& frame, Scaler scaler, PixelFormat format,
+                                     uint8_t* dst, int32_t stride);
+
+    // Decode the frame as an NTSC TV would show it, dst holds WIDTH * NTSC_SCALE x
+    // HEIGHT * NTSC_SCALE pixels. The lines are doubled to keep the aspect of the other outputs.
+    static void convert_frame_ntsc(const VideoFrame& frame, PixelFormat format, uint8_t* dst, int32_t stride);
+
+    // number of frames published
+    uint64_t frame_count() const { return frame_count_; }
 
 private:
-    std::mutex display_buffer_lock_;
+    static const std::array<PaletteLUT, EMPHASIS_COUNT>& palette_luts();
+
+    VideoFrame& draw_frame() { return *draw_frame_.mutable_frame(); }
 
-    uint32_t draw_buffer_index_{0};
+    FramePool pool_{MIN_FRAMES};
+    FrameRef draw_frame_;
+    FrameRef last_frame_;   // most recently published frame
+    uint64_t frame_count_{0};
 
-    Color offscreen_[2][HEIGHT][WIDTH];
+    // dirty tiles of the frame being drawn
+    DirtyTiles draw_dirty_tiles_{};
+
+    // only held to post frames and to add or remove consumers, never while a consumer works
+    std::mutex consumers_lock_;
+    std::vector<FrameMailbox*> consumers_;
+
+    std::atomic<uint64_t> stalls_{0};
 
     std::function<void()> refresh_callback_;
 };
 
-class NesDisplayView : public QQuickPaintedItem
+class RGBAFrameBuffer
 {
+    // A consumer's RGBA copy of the frames it takes, optionally upscaled or NTSC filtered.
+    // Unscaled, only the tile rows that changed since the frame it last converted are converted
+    // again.
+public:
+    RGBAFrameBuffer() { set_output(Scaler::None, false); }
+
+    const NesDisplay::Color* update(const VideoFrame& frame, Scaler scaler = Scaler::None,
+                                    bool ntsc_filter = false);
+
+    const NesDisplay::Color* data() const { return buffer_.data(); }
+    int32_t width() const { return NesDisplay::WIDTH * scale(); }
+    int32_t height() const { return NesDisplay::HEIGHT * scale(); }
+    uint64_t frame() const { return frame_; }
+
+private:
+    void set_output(Scaler scaler, bool ntsc_filter);
+    int32_t scale() const { return ntsc_filter_ ? NTSC_SCALE : scale_factor(scaler_); }
+
+    std::vector<NesDisplay::Color> buffer_;
+    Scaler scaler_{Scaler::None};
+    bool ntsc_filter_{false};
+    uint64_t frame_{UINT64_MAX};
+};
+
+class NesDisplayView : public QQuickItem
+{
+    // Shows the frames as a scene graph texture. A new texture is only made when a frame with
+    // changes arrives, from an RGBA copy where only the dirty tile rows were converted. The scene
+    // graph scales the texture with nearest filtering, on the GPU or with the software renderer.
     Q_OBJECT
     QML_ELEMENT
 
 public:
     NesDisplayView(QQuickItem *parent = nullptr);
-    void paint(QPainter *painter) override;
+    ~NesDisplayView();
 
     void refresh();
 
+    // presented: frames painted, dropped: frames replaced by a newer one before they were painted
+    uint64_t presented() const { return frames_.delivered(); }
+    uint64_t dropped() const { return frames_.dropped(); }
+
+protected:
+    QSGNode* updatePaintNode(QSGNode* old_node, UpdatePaintNodeData*) override;
+    void geometryChange(const QRectF& new_geometry, const QRectF& old_geometry) override;
+
 private:
+    // Largest integer multiple of the frame size that fits, centered. Scales down to fit when
+    // the item is smaller than the frame.
+    QRectF frame_rect() const;
+
     ViewUpdateRelay refresh_relay_;
+
+    // set when an update was requested and the GUI thread hasn't handled it yet, so a slow GUI
+    // thread gets one queued update instead of one for every frame
+    std::atomic<bool> update_pending_{false};
+
+    FrameMailbox frames_{"display"};
+
+    // The texture made from one buffer is in use until the next texture replaces it, so the
+    // frames are converted into the two buffers in turn
+    std::array<RGBAFrameBuffer, 2> rgba_;
+    int32_t rgba_index_{0};
+    uint64_t texture_frame_{UINT64_MAX};
+    Scaler texture_scaler_{Scaler::None};
+    bool texture_ntsc_filter_{false};
 };
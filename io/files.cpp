@@ -2,6 +2,7 @@
 
 #include <glog/logging.h>
 #include <fcntl.h>
+#include <sys/file.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 
@@ -35,6 +36,81 @@ std::shared_ptr<MappedFile> MappedFile::open(std::filesystem::path path)
 	return file;
 }
 
+std::shared_ptr<MappedFile> MappedFile::open_shared(std::filesystem::path path, size_t size)
+{
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+
+	file->fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if (file->fd_ < 0)
+	{
+		LOG(ERROR) << "Failed to open file " << path << ": " << strerror(errno);
+		return nullptr;
+	}
+
+	struct stat file_info;
+	if (fstat(file->fd_, &file_info) != 0)
+	{
+		LOG(ERROR) << "Failed to fstat file " << strerror(errno);
+		return nullptr;
+	}
+
+	if (static_cast<size_t>(file_info.st_size) < size && ftruncate(file->fd_, size) != 0)
+	{
+		LOG(ERROR) << "Failed to extend file " << path << ": " << strerror(errno);
+		return nullptr;
+	}
+	file->length_ = size;
+
+	file->buffer_ = static_cast<uint8_t*>(mmap(nullptr, file->length_, PROT_READ | PROT_WRITE,
+											  MAP_FILE | MAP_SHARED, file->fd_, 0));
+	if (file->buffer_ == MAP_FAILED)
+	{
+		LOG(ERROR) << "mmap failed " << MAP_FAILED << " " <<" " << strerror(errno);
+		file->buffer_ = nullptr;
+		return nullptr;
+	}
+
+	return file;
+}
+
+std::shared_ptr<MappedFile> MappedFile::open_exclusive(std::filesystem::path path, size_t size)
+{
+	std::shared_ptr<MappedFile> file = open_shared(path, size);
+
+	// flock locks belong to the open file, a second open of the path in this process is refused too
+	if (file && flock(file->fd_, LOCK_EX | LOCK_NB) != 0)
+	{
+		LOG(WARNING) << path << " is locked by another instance: " << strerror(errno);
+		return nullptr;
+	}
+	return file;
+}
+
+std::shared_ptr<MappedFile> MappedFile::allocate(size_t size)
+{
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+
+	file->length_ = size;
+	file->buffer_ = static_cast<uint8_t*>(mmap(nullptr, file->length_, PROT_READ | PROT_WRITE,
+											  MAP_ANONYMOUS | MAP_PRIVATE, -1, 0));
+	if (file->buffer_ == MAP_FAILED)
+	{
+		LOG(ERROR) << "mmap failed " << MAP_FAILED << " " <<" " << strerror(errno);
+		file->buffer_ = nullptr;
+		return nullptr;
+	}
+
+	return file;
+}
+
+void MappedFile::sync_async()
+{
+	if (buffer_ && msync(buffer_, length_, MS_ASYNC) != 0)
+	{
+		LOG(ERROR) << "msync failed " << strerror(errno);
+	}
+}
+
 MappedFile::MappedFile()
 {
 }
@@ -58,6 +58,21 @@ class MappedFile
 public:
 	static std::shared_ptr<MappedFile> open(std::filesystem::path path);
 
+	// Read/write MAP_SHARED mapping of the first size bytes of the file, which is created or
+	// extended with zeros as needed. Writes to the buffer are writes to the file, they are in
+	// the page cache as soon as they're made and survive the process crashing.
+	static std::shared_ptr<MappedFile> open_shared(std::filesystem::path path, size_t size);
+
+	// open_shared for a single writer. Holds an advisory lock on the file for as long as it is
+	// mapped, nullptr while another MappedFile holds it, in this process or another.
+	static std::shared_ptr<MappedFile> open_exclusive(std::filesystem::path path, size_t size);
+
+	// Anonymous zeroed memory of size bytes, page aligned, for data that isn't a file yet
+	static std::shared_ptr<MappedFile> allocate(size_t size);
+
+	// Schedules writing the dirty pages of a shared mapping to disk without waiting for it
+	void sync_async();
+
 	MappedFile();
 	~MappedFile();
 
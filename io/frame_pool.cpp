@@ -0,0 +1,86 @@
+#include "io/frame_pool.hpp"
+
+bool VideoFrame::dirty_tiles_since(uint64_t frame, DirtyTiles& dirty) const
+{
+    if (frame == number_)
+    {
+        dirty.fill(0);
+        return true;
+    }
+
+    if (frame > number_ || number_ - frame > DIRTY_TILES_HISTORY)
+    {
+        dirty.fill(ALL_TILE_COLUMNS);
+        return false;
+    }
+
+    dirty = dirty_since_[number_ - frame - 1];
+    return true;
+}
+
+bool VideoFrame::changed_since(uint64_t frame) const
+{
+    DirtyTiles dirty;
+    if (!dirty_tiles_since(frame, dirty))
+    {
+        return true;
+    }
+
+    for (uint32_t row : dirty)
+    {
+        if (row)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+FramePool::FramePool(int32_t initial_frames)
+{
+    for (int32_t i = 0;i < initial_frames && i < MAX_FRAMES;++i)
+    {
+        frames_.push_back(std::make_unique<VideoFrame>());
+    }
+}
+
+FrameRef FramePool::acquire()
+{
+    for (std::unique_ptr<VideoFrame>& frame : frames_)
+    {
+        // acquire pairs with the release of the last consumer reference
+        if (frame->refs_.load(std::memory_order_acquire) == 0)
+        {
+            return FrameRef(frame.get());
+        }
+    }
+
+    if (frames_.size() < MAX_FRAMES)
+    {
+        frames_.push_back(std::make_unique<VideoFrame>());
+        return FrameRef(frames_.back().get());
+    }
+    return FrameRef();
+}
+
+void FrameMailbox::post(const FrameRef& frame)
+{
+    VideoFrame* previous = latest_.exchange(FrameRef(frame).detach(), std::memory_order_acq_rel);
+
+    if (previous)
+    {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        FrameRef::adopt(previous);
+    }
+}
+
+FrameRef FrameMailbox::take()
+{
+    VideoFrame* frame = latest_.exchange(nullptr, std::memory_order_acq_rel);
+
+    if (frame)
+    {
+        delivered_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return FrameRef::adopt(frame);
+}
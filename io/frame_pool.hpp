@@ -0,0 +1,189 @@
+#pragma once
+
+#include "io/scalers.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class VideoFrame
+{
+    // One frame of PPU output: the indexed pixels, the color emphasis of each scanline and the
+    // tiles that changed from earlier frames. The display draws into a frame and publishes it,
+    // after that it is immutable and shared by every consumer that holds a reference to it.
+public:
+    static constexpr int32_t WIDTH = 256;
+    static constexpr int32_t HEIGHT = 240;
+
+    static constexpr int32_t TILE_SIZE = 8;
+    static constexpr int32_t TILE_ROWS = HEIGHT / TILE_SIZE;
+    static constexpr uint32_t ALL_TILE_COLUMNS = 0xFFFFFFFF;
+
+    // frames of dirty tiles kept for consumers that skip frames
+    static constexpr uint64_t DIRTY_TILES_HISTORY = 8;
+
+    using IndexedBuffer = uint8_t[HEIGHT][WIDTH];
+
+    // One bit for each of the 32 tile columns in each tile row
+    using DirtyTiles = std::array<uint32_t, TILE_ROWS>;
+
+    // identifies the frame, published frames are numbered 1, 2, 3...
+    uint64_t number() const { return number_; }
+
+    const IndexedBuffer& pixels() const { return pixels_; }
+    const uint8_t* scanline(int32_t y) const { return pixels_[y]; }
+    uint8_t emphasis(int32_t y) const { return emphasis_[y]; }
+
+    // Tiles changed between frame and this one. Returns false, with every tile marked, when
+    // frame is too old for the history.
+    bool dirty_tiles_since(uint64_t frame, DirtyTiles& dirty) const;
+    bool changed_since(uint64_t frame) const;
+
+private:
+    friend class FrameRef;
+    friend class FramePool;
+    friend class NesDisplay;
+    friend class ScalerBenchmark;
+
+    std::atomic<int32_t> refs_{0};
+
+    uint64_t number_{0};
+
+    IndexedBuffer pixels_;
+    uint8_t emphasis_[HEIGHT]{};
+
+    // dirty_since_[n] holds the tiles changed since frame number_ - 1 - n
+    std::array<DirtyTiles, DIRTY_TILES_HISTORY> dirty_since_{};
+};
+
+class FrameRef
+{
+    // Counted reference to a VideoFrame. The frame returns to its pool when the last reference
+    // goes away, so consumers can hold on to a frame for as long as they need it without
+    // the display waiting for them.
+public:
+    FrameRef() = default;
+    explicit FrameRef(VideoFrame* frame) : frame_(frame) { retain(); }
+    FrameRef(const FrameRef& other) : frame_(other.frame_) { retain(); }
+    FrameRef(FrameRef&& other) noexcept : frame_(other.frame_) { other.frame_ = nullptr; }
+    ~FrameRef() { release(); }
+
+    FrameRef& operator=(FrameRef other) noexcept
+    {
+        std::swap(frame_, other.frame_);
+        return *this;
+    }
+
+    // Take over a reference that was already counted
+    static FrameRef adopt(VideoFrame* frame)
+    {
+        FrameRef ref;
+        ref.frame_ = frame;
+        return ref;
+    }
+
+    // Give up the reference without releasing it
+    VideoFrame* detach()
+    {
+        VideoFrame* frame = frame_;
+        frame_ = nullptr;
+        return frame;
+    }
+
+    const VideoFrame* get() const { return frame_; }
+    const VideoFrame* operator->() const { return frame_; }
+    const VideoFrame& operator*() const { return *frame_; }
+    explicit operator bool() const { return frame_ != nullptr; }
+
+private:
+    friend class NesDisplay;
+    VideoFrame* mutable_frame() const { return frame_; }
+
+    void retain()
+    {
+        if (frame_)
+        {
+            frame_->refs_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void release()
+    {
+        if (frame_)
+        {
+            // release so the consumer's reads of the frame happen before it is reused
+            frame_->refs_.fetch_sub(1, std::memory_order_release);
+            frame_ = nullptr;
+        }
+    }
+
+    VideoFrame* frame_{nullptr};
+};
+
+class FramePool
+{
+    // Frames for the display to draw into. A frame is free when nothing references it. Only the
+    // producer (the thread running the PPU) acquires frames, consumers only release them, so
+    // acquiring is a scan over the reference counts without a lock. The pool grows until
+    // MAX_FRAMES, after that acquire fails instead of waiting for a consumer.
+public:
+    static constexpr int32_t MAX_FRAMES = 16;
+
+    // Allocates the first frames up front, so steady state use never allocates
+    explicit FramePool(int32_t initial_frames = 0);
+
+    // Returns a frame nothing else references, or an empty ref when every frame is held
+    FrameRef acquire();
+
+private:
+    std::vector<std::unique_ptr<VideoFrame>> frames_;
+};
+
+class FrameMailbox
+{
+    // A consumer's slot for published frames. The display posts every frame it publishes and the
+    // consumer takes the newest one when it is ready for it. A frame that is replaced before it
+    // was taken is dropped and counted, so a slow consumer skips frames and never holds up the
+    // emulation.
+public:
+    explicit FrameMailbox(std::string_view name) : name_(name) {}
+    ~FrameMailbox() { take(); }
+
+    FrameMailbox(const FrameMailbox&) = delete;
+    FrameMailbox& operator=(const FrameMailbox&) = delete;
+
+    // Producer side
+    void post(const FrameRef& frame);
+
+    // Consumer side, the newest frame posted since the last take or an empty ref
+    FrameRef take();
+
+    const std::string& name() const { return name_; }
+
+    // How the consumer wants its frames scaled, each consumer converts its own frames
+    void set_scaler(Scaler scaler) { scaler_.store(scaler, std::memory_order_relaxed); }
+    Scaler scaler() const { return scaler_.load(std::memory_order_relaxed); }
+
+    // Decode the frames through the NTSC composite filter (io/ntsc_filter.hpp) instead of the
+    // palette. The filter has its own 2x output, the scaler doesn't apply.
+    void set_ntsc_filter(bool enabled) { ntsc_filter_.store(enabled, std::memory_order_relaxed); }
+    bool ntsc_filter() const { return ntsc_filter_.load(std::memory_order_relaxed); }
+
+    uint64_t delivered() const { return delivered_.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    std::string name_;
+
+    std::atomic<VideoFrame*> latest_{nullptr};
+    std::atomic<Scaler> scaler_{Scaler::None};
+    std::atomic<bool> ntsc_filter_{false};
+
+    std::atomic<uint64_t> delivered_{0};
+    std::atomic<uint64_t> dropped_{0};
+};
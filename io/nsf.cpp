@@ -0,0 +1,179 @@
+#include "io/nsf.hpp"
+
+#include "io/crc32.hpp"
+#include "io/rom_image.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <vector>
+
+#include <glog/logging.h>
+
+namespace
+{
+
+uint16_t read16(std::span<const uint8_t> buffer, size_t offset)
+{
+    return buffer[offset] | (buffer[offset + 1] << 8);
+}
+
+// the header's strings are 32 bytes, null terminated unless all 32 are used
+std::string read_string(std::span<const uint8_t> buffer, size_t offset)
+{
+    static constexpr size_t STRING_SIZE = 32;
+
+    const char* chars = reinterpret_cast<const char*>(buffer.data() + offset);
+    return std::string(chars, std::find(chars, chars + STRING_SIZE, '\0'));
+}
+
+}
+
+std::shared_ptr<Cartridge_NSF> Cartridge_NSF::create(const std::filesystem::path& path)
+{
+    std::shared_ptr<MappedFile> file = MappedFile::open(path);
+
+    if (!file)
+    {
+        return nullptr;
+    }
+
+    std::span<const uint8_t> buffer = file->buffer();
+
+    static constexpr std::array<uint8_t, 5> MAGIC = {'N', 'E', 'S', 'M', 0x1A};
+    if (buffer.size() < NSF_HEADER_SIZE || !std::equal(MAGIC.begin(), MAGIC.end(), buffer.begin()))
+    {
+        LOG(ERROR) << path.filename() << " is not an NSF file";
+        return nullptr;
+    }
+
+    Info info;
+    info.track_count = buffer[0x06];
+    info.first_track = std::max(buffer[0x07], uint8_t(1)) - 1;
+    info.load_address = read16(buffer, 0x08);
+    info.init_address = read16(buffer, 0x0A);
+    info.play_address = read16(buffer, 0x0C);
+    info.title = read_string(buffer, 0x0E);
+    info.artist = read_string(buffer, 0x2E);
+    info.copyright = read_string(buffer, 0x4E);
+
+    // 0 in files that don't set it, the common 60.1Hz is the NTSC frame rate
+    info.play_period_us = read16(buffer, 0x6E) ? read16(buffer, 0x6E) : 16639;
+
+    std::copy(buffer.begin() + 0x70, buffer.begin() + 0x78, info.initial_banks.begin());
+    info.bankswitched = std::any_of(info.initial_banks.begin(), info.initial_banks.end(), [](uint8_t b) { return b != 0; });
+
+    LOG_IF(WARNING, buffer[0x7B]) << path.filename() << " uses expansion audio, only the APU channels will play";
+
+    std::span<const uint8_t> data = buffer.subspan(NSF_HEADER_SIZE);
+
+    // NSF2 can have metadata after the data, the data's length is in the header
+    const uint32_t data_length = buffer[0x7D] | (buffer[0x7E] << 8) | (buffer[0x7F] << 16);
+    if (buffer[0x05] >= 2 && data_length && data_length < data.size())
+    {
+        data = data.first(data_length);
+    }
+
+    if (data.empty())
+    {
+        LOG(ERROR) << path.filename() << " has no data";
+        return nullptr;
+    }
+
+    // Both layouts are 4KB banks, padded in front so the data's load address lines up. Without
+    // bankswitching the data starts at its load address in a 32KB image.
+    size_t padding = info.load_address & (BANK_SIZE - 1);
+    size_t image_size = (padding + data.size() + BANK_SIZE - 1) / BANK_SIZE * BANK_SIZE;
+
+    if (!info.bankswitched)
+    {
+        static constexpr size_t MAPPED_SIZE = 0x8000;
+
+        if (info.load_address < 0x8000)
+        {
+            LOG(ERROR) << path.filename() << " loads below $8000 without bankswitching";
+            return nullptr;
+        }
+        padding = info.load_address - 0x8000;
+        image_size = MAPPED_SIZE;
+
+        LOG_IF(WARNING, padding + data.size() > MAPPED_SIZE) << path.filename() << " is larger than $8000 - $FFFF";
+        data = data.first(std::min(data.size(), MAPPED_SIZE - padding));
+
+        for (int32_t slot = 0;slot < static_cast<int32_t>(info.initial_banks.size());++slot)
+        {
+            info.initial_banks[slot] = slot;
+        }
+    }
+
+    std::vector<uint8_t> image(image_size, 0);
+    std::copy(data.begin(), data.end(), image.begin() + padding);
+
+    const uint32_t image_crc32 = crc32(image);
+    std::shared_ptr<const RomImage> rom = RomImage::share(image_crc32, image, {});
+
+    if (!rom)
+    {
+        return nullptr;
+    }
+
+    Header header;
+    header.format = Format::NSF;
+    header.prg_rom_size = static_cast<uint32_t>(image.size());
+    header.prg_ram_size = PRG_RAM_SIZE;
+
+    std::shared_ptr<Cartridge_NSF> nsf(new Cartridge_NSF(rom, header, path.filename().string(), info));
+    nsf->crc32_ = image_crc32;
+
+    LOG(INFO) << *nsf;
+
+    return nsf;
+}
+
+void Cartridge_NSF::write(uint16_t a, uint8_t v)
+{
+    if (info_.bankswitched && a >= BANK_REGISTERS && a <= 0x5FFF)
+    {
+        map_bank(a - BANK_REGISTERS, v);
+    }
+}
+
+void Cartridge_NSF::reset()
+{
+    for (int32_t slot = 0;slot < static_cast<int32_t>(info_.initial_banks.size());++slot)
+    {
+        map_bank(slot, info_.initial_banks[slot]);
+    }
+
+    std::fill(prg_ram_.begin(), prg_ram_.end(), 0);
+    map_prg_ram(true);
+}
+
+void Cartridge_NSF::map_bank(int32_t slot, uint8_t bank)
+{
+    assert(cpu_pages_);
+
+    // banks past the end wrap, like the address lines a smaller ROM doesn't connect
+    bank %= prg_rom_.size() / BANK_SIZE;
+    cpu_pages_->map(PRG_ADDRESS + slot * BANK_SIZE, prg_rom_.subspan(bank * BANK_SIZE, BANK_SIZE), false);
+}
+
+std::ostream& operator << (std::ostream& os, const Cartridge_NSF& nsf)
+{
+    const Cartridge_NSF::Info& info = nsf.info_;
+
+    os << std::hex << std::setfill('0') << std::endl << std::endl;
+    os << "  NSF: " << nsf.name_ << "\n";
+    os << "------------------------------\n";
+
+    os << std::left << std::setw(23) << std::setfill(' ') << "title:" << info.title << std::endl;
+    os << std::left << std::setw(23) << std::setfill(' ') << "artist:" << info.artist << std::endl;
+    os << std::left << std::setw(23) << std::setfill(' ') << "copyright:" << info.copyright << std::endl;
+    os << std::left << std::setw(23) << std::setfill(' ') << "tracks:" << std::dec << info.track_count << std::endl;
+    os << std::left << std::setw(23) << std::setfill(' ') << "load:" << "0x" << std::hex << info.load_address << std::endl;
+    os << std::left << std::setw(23) << std::setfill(' ') << "init:" << "0x" << info.init_address << std::endl;
+    os << std::left << std::setw(23) << std::setfill(' ') << "play:" << "0x" << info.play_address << std::endl;
+    os << std::left << std::setw(23) << std::setfill(' ') << "play period:" << std::dec << info.play_period_us << "us" << std::endl;
+    os << std::left << std::setw(23) << std::setfill(' ') << "bankswitched:" << (info.bankswitched ? "yes" : "no") << std::endl;
+
+    return os;
+}
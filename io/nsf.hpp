@@ -0,0 +1,65 @@
+#pragma once
+
+#include "io/cartridge.hpp"
+
+#include <array>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+class Cartridge_NSF : public Cartridge
+{
+    // NES Sound Format, the music code and data of a game: https://www.nesdev.org/wiki/NSF
+    // Played by calling its INIT routine once for a track and its PLAY routine at the rate in
+    // the header, see NsfPlayer.
+    //
+    // The data is mapped at $8000 - $FFFF in 4KB banks. Bankswitched files select the bank of
+    // each slot by writing $5FF8 - $5FFF, the others are loaded at their load address and
+    // mapped as the 8 banks that address puts them in. $6000 - $7FFF is RAM.
+public:
+    static constexpr size_t NSF_HEADER_SIZE = 0x80;
+
+    struct Info
+    {
+        std::string title;
+        std::string artist;
+        std::string copyright;
+
+        int32_t track_count{0};
+        int32_t first_track{0}; // 0 based, the header's is 1 based
+
+        uint16_t load_address{0};
+        uint16_t init_address{0};
+        uint16_t play_address{0};
+        uint32_t play_period_us{0}; // NTSC
+
+        bool bankswitched{false};
+        std::array<uint8_t, 8> initial_banks{};
+    };
+
+    // nullptr when the file isn't an NSF. Expansion audio chips aren't emulated, their writes
+    // are ignored.
+    static std::shared_ptr<Cartridge_NSF> create(const std::filesystem::path& path);
+
+    const Info& info() const { return info_; }
+
+    void write(uint16_t a, uint8_t v) override;
+
+    // Maps the initial banks and clears PRG-RAM, before each track's INIT
+    void reset() override;
+
+    friend std::ostream& operator << (std::ostream& os, const Cartridge_NSF& nsf);
+
+protected:
+    Cartridge_NSF(std::shared_ptr<const RomImage> rom, const Header& header, std::string_view name, const Info& info)
+     : Cartridge(rom, header, name)
+     , info_(info) {}
+
+private:
+    static constexpr int32_t BANK_SIZE = 0x1000;
+    static constexpr uint16_t BANK_REGISTERS = 0x5FF8;
+
+    void map_bank(int32_t slot, uint8_t bank);
+
+    Info info_;
+};
@@ -0,0 +1,363 @@
+#include "io/ntsc_filter.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <memory>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+// The signal is sampled at twice the 21.48MHz master clock: 8 samples per PPU pixel and 12 per
+// cycle of the 3.58MHz color subcarrier
+constexpr int32_t SAMPLES_PER_PIXEL = 8;
+constexpr int32_t SAMPLES_PER_CYCLE = 12;
+constexpr int32_t SAMPLES_PER_OUTPUT = SAMPLES_PER_PIXEL / NTSC_SCALE;
+
+// A pixel's kernel covers the output pairs from two before its own pair to two after it, which
+// holds the widest (chroma) decoding window around every sample of the pixel
+constexpr int32_t KERNEL_PAIRS = 5;
+constexpr int32_t FIRST_PAIR = -2;
+
+// Kernels are RGB in 1/16ths of a level, so the sum of a window keeps its fraction until the
+// final shift and rounding
+constexpr int32_t FRACTION_BITS = 4;
+constexpr int16_t ROUNDING = 1 << (FRACTION_BITS - 1);
+
+constexpr int32_t COLORS = 64;
+constexpr int32_t EMPHASIS_COUNT = 8;
+
+// One pixel's contribution to two output pixels per pair, as r, g, b, unused
+struct Kernel
+{
+    alignas(16) int16_t pairs[KERNEL_PAIRS][8];
+};
+
+using Kernels = std::array<Kernel, EMPHASIS_COUNT * NTSC_PHASES * COLORS>;
+
+// Composite signal level of a color at a subcarrier phase, from the nesdev wiki:
+// https://www.nesdev.org/wiki/NTSC_video
+double signal_level(int32_t color, int32_t emphasis, int32_t phase)
+{
+    // voltages relative to sync for each luma level, low half and high half of the square wave
+    static constexpr double LEVELS[8] = {0.350, 0.518, 0.962, 1.550,
+                                         1.094, 1.506, 1.962, 1.962};
+    static constexpr double ATTENUATION = 0.746;
+
+    auto in_color_phase = [phase](int32_t hue) { return (hue + phase) % SAMPLES_PER_CYCLE < 6; };
+
+    const int32_t hue = color & 0x0F;
+    const int32_t luma = hue > 13 ? 1 : (color >> 4) & 0x03; // colors 14 and 15 are black
+
+    double low = LEVELS[luma];
+    double high = LEVELS[4 + luma];
+    if (hue == 0)
+    {
+        low = high;
+    }
+    if (hue > 12)
+    {
+        high = low;
+    }
+
+    double level = in_color_phase(hue) ? high : low;
+
+    // the emphasis bits attenuate the signal in the thirds of the cycle of the other colors
+    if (((emphasis & 0x01) && in_color_phase(0)) ||
+        ((emphasis & 0x02) && in_color_phase(4)) ||
+        ((emphasis & 0x04) && in_color_phase(8)))
+    {
+        level *= ATTENUATION;
+    }
+    return level;
+}
+
+std::unique_ptr<Kernels> make_kernels()
+{
+    static constexpr double BLACK = 0.518;
+    static constexpr double WHITE = 1.962;
+
+    // Luma is the mean of one subcarrier cycle around the output pixel, which removes the
+    // subcarrier. Chroma is demodulated over a triangle twice as wide, the lower bandwidth of
+    // the color signal is what spreads colors over their neighbors.
+    static constexpr double LUMA_HALF_WIDTH = SAMPLES_PER_CYCLE / 2;
+    static constexpr double CHROMA_HALF_WIDTH = SAMPLES_PER_CYCLE;
+    static constexpr double CHROMA_WEIGHTS = CHROMA_HALF_WIDTH * CHROMA_HALF_WIDTH;
+
+    // decoder hue adjustment, like the knob on the TV, in samples (30 degrees each). Calibrated so
+    // flat areas of color come out close to the usual 2C02 palettes.
+    static constexpr double HUE = 3.75;
+    static constexpr double SATURATION = 1.0;
+
+    auto kernels = std::make_unique<Kernels>();
+
+    for (int32_t emphasis = 0;emphasis < EMPHASIS_COUNT;++emphasis)
+    {
+        for (int32_t phase = 0;phase < NTSC_PHASES;++phase)
+        {
+            for (int32_t color = 0;color < COLORS;++color)
+            {
+                Kernel& kernel = (*kernels)[(emphasis * NTSC_PHASES + phase) * COLORS + color];
+
+                for (int32_t output = 0;output < KERNEL_PAIRS * 2;++output)
+                {
+                    // output pixel relative to the pixel's first output, and its center in samples
+                    const int32_t relative = FIRST_PAIR * 2 + output;
+                    const double center = relative * SAMPLES_PER_OUTPUT + (SAMPLES_PER_OUTPUT - 1) / 2.0;
+
+                    double y = 0;
+                    double i = 0;
+                    double q = 0;
+
+                    for (int32_t sample = 0;sample < SAMPLES_PER_PIXEL;++sample)
+                    {
+                        const int32_t sample_phase = (phase * SAMPLES_PER_OUTPUT + sample) % SAMPLES_PER_CYCLE;
+                        const double level = (signal_level(color, emphasis, sample_phase) - BLACK) / (WHITE - BLACK);
+                        const double distance = std::abs(sample - center);
+
+                        if (distance < LUMA_HALF_WIDTH)
+                        {
+                            y += level / SAMPLES_PER_CYCLE;
+                        }
+                        if (distance < CHROMA_HALF_WIDTH)
+                        {
+                            const double weight = (CHROMA_HALF_WIDTH - distance) / CHROMA_WEIGHTS;
+                            const double angle = M_PI * (sample_phase + HUE) / (SAMPLES_PER_CYCLE / 2);
+
+                            i += 2 * SATURATION * level * weight * std::cos(angle);
+                            q += 2 * SATURATION * level * weight * std::sin(angle);
+                        }
+                    }
+
+                    // FCC YIQ to RGB
+                    const double rgb[3] = {y + 0.956 * i + 0.621 * q,
+                                           y - 0.272 * i - 0.647 * q,
+                                           y - 1.106 * i + 1.703 * q};
+
+                    for (int32_t channel = 0;channel < 3;++channel)
+                    {
+                        kernel.pairs[output / 2][(output % 2) * 4 + channel] =
+                            static_cast<int16_t>(std::lround(rgb[channel] * 255 * (1 << FRACTION_BITS)));
+                    }
+                    kernel.pairs[output / 2][(output % 2) * 4 + 3] = 0;
+                }
+            }
+        }
+    }
+    return kernels;
+}
+
+const Kernels& ntsc_kernels()
+{
+    static const std::unique_ptr<Kernels> kernels = make_kernels();
+    return *kernels;
+}
+
+// A pair of output pixels as r, g, b, unused in 16 bit fixed point
+
+struct ScalarOps
+{
+    struct V
+    {
+        int16_t lanes[8];
+    };
+
+    static V load(const int16_t* p)
+    {
+        V v{};
+        std::copy(p, p + 8, v.lanes);
+        return v;
+    }
+
+    static V rounding()
+    {
+        V v{};
+        std::fill(v.lanes, v.lanes + 8, ROUNDING);
+        return v;
+    }
+
+    static V add(V a, V b)
+    {
+        for (int32_t i = 0;i < 8;++i)
+        {
+            a.lanes[i] = static_cast<int16_t>(a.lanes[i] + b.lanes[i]);
+        }
+        return a;
+    }
+
+    static void store_pair(uint8_t* dst, V v, PixelFormat format)
+    {
+        for (int32_t pixel = 0;pixel < 2;++pixel)
+        {
+            const int16_t* rgb = v.lanes + pixel * 4;
+            auto channel = [rgb](int32_t c) { return static_cast<uint8_t>(std::clamp(rgb[c] >> FRACTION_BITS, 0, 0xFF)); };
+
+            uint8_t* out = dst + pixel * BYTES_PER_PIXEL;
+            out[0] = channel(format == PixelFormat::RGBA8888 ? 0 : 2);
+            out[1] = channel(1);
+            out[2] = channel(format == PixelFormat::RGBA8888 ? 2 : 0);
+            out[3] = 0xFF;
+        }
+    }
+};
+
+#if defined(__ARM_NEON)
+
+struct VectorOps
+{
+    using V = int16x8_t;
+
+    static V load(const int16_t* p) { return vld1q_s16(p); }
+    static V rounding() { return vdupq_n_s16(ROUNDING); }
+    static V add(V a, V b) { return vaddq_s16(a, b); }
+
+    static void store_pair(uint8_t* dst, V v, PixelFormat format)
+    {
+        static constexpr uint8_t BGRA_ORDER[8] = {2, 1, 0, 3, 6, 5, 4, 7};
+        static constexpr uint8_t ALPHA[8] = {0, 0, 0, 0xFF, 0, 0, 0, 0xFF};
+
+        // shift out the fraction and saturate to 0 - 255
+        uint8x8_t pixels = vqshrun_n_s16(v, FRACTION_BITS);
+        if (format == PixelFormat::BGRA8888)
+        {
+            pixels = vtbl1_u8(pixels, vld1_u8(BGRA_ORDER));
+        }
+        vst1_u8(dst, vorr_u8(pixels, vld1_u8(ALPHA)));
+    }
+};
+
+#elif defined(__SSE2__)
+
+struct VectorOps
+{
+    using V = __m128i;
+
+    static V load(const int16_t* p) { return _mm_load_si128(reinterpret_cast<const __m128i*>(p)); }
+    static V rounding() { return _mm_set1_epi16(ROUNDING); }
+    static V add(V a, V b) { return _mm_add_epi16(a, b); }
+
+    static void store_pair(uint8_t* dst, V v, PixelFormat format)
+    {
+        v = _mm_srai_epi16(v, FRACTION_BITS);
+        if (format == PixelFormat::BGRA8888)
+        {
+            v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 0, 1, 2));
+            v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(3, 0, 1, 2));
+        }
+
+        // packus saturates to 0 - 255
+        const __m128i alpha = _mm_set_epi32(0, 0, static_cast<int32_t>(0xFF000000), static_cast<int32_t>(0xFF000000));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), _mm_or_si128(_mm_packus_epi16(v, v), alpha));
+    }
+};
+
+#else
+
+using VectorOps = ScalarOps; // no vector unit available
+
+#endif
+
+template<typename Ops>
+void filter_line(const uint8_t* src, int32_t width, uint8_t emphasis, int32_t phase,
+                 uint8_t* dst, PixelFormat format)
+{
+    using V = typename Ops::V;
+
+    // The kernels of the three pixel phases in the order consecutive pixels step through them,
+    // each pixel starts 8 samples (2 phases) after the previous one
+    const Kernel* line_kernels = ntsc_kernels().data() + (emphasis & 0x07) * NTSC_PHASES * COLORS;
+    const Kernel* kernels[NTSC_PHASES];
+    for (int32_t i = 0;i < NTSC_PHASES;++i)
+    {
+        kernels[i] = line_kernels + ((phase + i * 2) % NTSC_PHASES) * COLORS;
+    }
+
+    // Running sums of the output pairs the current pixel's kernel covers, from two pairs left
+    // of its own to two right of it. The leftmost is complete once the pixel is added, no later
+    // pixel reaches back that far.
+    V s0 = Ops::rounding();
+    V s1 = Ops::rounding();
+    V s2 = Ops::rounding();
+    V s3 = Ops::rounding();
+    V s4 = Ops::rounding();
+
+    auto add_pixel = [&](const Kernel* phase_kernels, uint8_t color)
+    {
+        const Kernel& kernel = phase_kernels[color & 0x3F];
+
+        s0 = Ops::add(s0, Ops::load(kernel.pairs[0]));
+        s1 = Ops::add(s1, Ops::load(kernel.pairs[1]));
+        s2 = Ops::add(s2, Ops::load(kernel.pairs[2]));
+        s3 = Ops::add(s3, Ops::load(kernel.pairs[3]));
+        s4 = Ops::add(s4, Ops::load(kernel.pairs[4]));
+    };
+
+    auto next_pair = [&](uint8_t* pair_dst)
+    {
+        if (pair_dst)
+        {
+            Ops::store_pair(pair_dst, s0, format);
+        }
+        s0 = s1;
+        s1 = s2;
+        s2 = s3;
+        s3 = s4;
+        s4 = Ops::rounding();
+    };
+
+    constexpr int32_t PAIR_BYTES = NTSC_SCALE * BYTES_PER_PIXEL;
+
+    // pairs left of the line are outside the output
+    int32_t x = 0;
+    for (;x < -FIRST_PAIR && x < width;++x)
+    {
+        add_pixel(kernels[x % NTSC_PHASES], src[x]);
+        next_pair(nullptr);
+    }
+
+    // three pixels at a time go through the phases in order
+    for (;x + NTSC_PHASES <= width;x += NTSC_PHASES)
+    {
+        const int32_t i = x % NTSC_PHASES;
+        uint8_t* pair_dst = dst + (x + FIRST_PAIR) * PAIR_BYTES;
+
+        add_pixel(kernels[i], src[x]);
+        next_pair(pair_dst);
+        add_pixel(kernels[(i + 1) % NTSC_PHASES], src[x + 1]);
+        next_pair(pair_dst + PAIR_BYTES);
+        add_pixel(kernels[(i + 2) % NTSC_PHASES], src[x + 2]);
+        next_pair(pair_dst + PAIR_BYTES * 2);
+    }
+
+    for (;x < width;++x)
+    {
+        add_pixel(kernels[x % NTSC_PHASES], src[x]);
+        next_pair(dst + (x + FIRST_PAIR) * PAIR_BYTES);
+    }
+
+    // the last pixels' pairs, without anything further right to add
+    for (int32_t pair = std::max(width + FIRST_PAIR, 0);pair < width;++pair)
+    {
+        next_pair(dst + pair * PAIR_BYTES);
+    }
+}
+
+} // namespace
+
+void ntsc_filter_line(const uint8_t* src, int32_t width, uint8_t emphasis, int32_t phase,
+                      uint8_t* dst, PixelFormat format)
+{
+    filter_line<VectorOps>(src, width, emphasis, phase, dst, format);
+}
+
+void ntsc_filter_line_scalar(const uint8_t* src, int32_t width, uint8_t emphasis, int32_t phase,
+                             uint8_t* dst, PixelFormat format)
+{
+    filter_line<ScalarOps>(src, width, emphasis, phase, dst, format);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "io/pixel_formats.hpp"
+
+#include <cstdint>
+
+// NTSC composite video filter for the consumers of the frames. The NES PPU doesn't output RGB, it
+// generates a composite signal directly from the palette index and emphasis bits: a square wave
+// between two voltage levels whose phase against the color subcarrier picks the hue. A TV then
+// separates luma and chroma again with filters that blur colors into their neighbors, which is
+// where the fringes on vertical edges and the rainbow on dithered patterns come from.
+//
+// Decoding is linear in the signal, so the contribution of one PPU pixel to the decoded RGB
+// around it only depends on its color, the line's emphasis and the subcarrier phase the pixel
+// starts at (one of three). Those contributions are precomputed as kernels of fixed point RGB,
+// and filtering a line is adding one kernel per input pixel into a window of output pixels.
+// The output has 2x the horizontal resolution, 4 signal samples per output pixel.
+
+static constexpr int32_t NTSC_SCALE = 2;
+
+// Subcarrier phases a pixel can start at. Each pixel is 8 samples of the 12 sample subcarrier
+// cycle, so consecutive pixels start 8 samples later, and each scanline 4 samples later.
+static constexpr int32_t NTSC_PHASES = 3;
+
+// Subcarrier phase (0 - 2) of the first pixel of a scanline. Frames alternate between two phases
+// because odd frames skip a dot.
+inline int32_t ntsc_line_phase(uint64_t frame, int32_t y) { return static_cast<int32_t>((frame & 1) + y) % NTSC_PHASES; }
+
+// Filter width indexed pixels (color in the low 6 bits) of a scanline with the emphasis bits
+// (PPUMASK 5-7 as bits 0-2) into width * NTSC_SCALE pixels of dst in the requested format.
+void ntsc_filter_line(const uint8_t* src, int32_t width, uint8_t emphasis, int32_t phase,
+                      uint8_t* dst, PixelFormat format);
+
+// The same without the vector unit, for checking the vector kernel against
+void ntsc_filter_line_scalar(const uint8_t* src, int32_t width, uint8_t emphasis, int32_t phase,
+                             uint8_t* dst, PixelFormat format);
@@ -0,0 +1,147 @@
+#include "io/pixel_formats.hpp"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+namespace
+{
+
+void convert_indexed_pixels_scalar(const uint8_t* src, uint8_t* dst, int32_t count,
+                                   const uint8_t* c0, const uint8_t* c1, const uint8_t* c2)
+{
+    for (int32_t i = 0;i < count;++i)
+    {
+        const uint8_t index = src[i] & 0x3F;
+
+        dst[i * 4 + 0] = c0[index];
+        dst[i * 4 + 1] = c1[index];
+        dst[i * 4 + 2] = c2[index];
+        dst[i * 4 + 3] = 0xFF;
+    }
+}
+
+#if defined(__ARM_NEON)
+
+int32_t convert_indexed_pixels_simd(const uint8_t* src, uint8_t* dst, int32_t count,
+                                    const uint8_t* c0, const uint8_t* c1, const uint8_t* c2)
+{
+    // tbl with 4 registers covers the full 64 entry palette for a channel in one instruction
+    const uint8x16x4_t table0 = vld1q_u8_x4(c0);
+    const uint8x16x4_t table1 = vld1q_u8_x4(c1);
+    const uint8x16x4_t table2 = vld1q_u8_x4(c2);
+    const uint8x16_t index_mask = vdupq_n_u8(0x3F);
+
+    int32_t i = 0;
+    for (;i + 16 <= count;i += 16)
+    {
+        const uint8x16_t index = vandq_u8(vld1q_u8(src + i), index_mask);
+
+        uint8x16x4_t pixels;
+        pixels.val[0] = vqtbl4q_u8(table0, index);
+        pixels.val[1] = vqtbl4q_u8(table1, index);
+        pixels.val[2] = vqtbl4q_u8(table2, index);
+        pixels.val[3] = vdupq_n_u8(0xFF);
+
+        vst4q_u8(dst + i * 4, pixels); // interleaves the channels
+    }
+    return i;
+}
+
+#elif defined(__SSSE3__)
+
+inline __m128i lookup_64(const __m128i table[4], __m128i index)
+{
+    // pshufb only addresses 16 entries. Look the low nibble up in each quarter of the table and
+    // keep the result from the quarter selected by bits 4-5 of the index.
+    const __m128i quarter = _mm_and_si128(_mm_srli_epi16(index, 4), _mm_set1_epi8(0x03));
+    const __m128i nibble = _mm_and_si128(index, _mm_set1_epi8(0x0F));
+
+    __m128i result = _mm_setzero_si128();
+    for (int32_t k = 0;k < 4;++k)
+    {
+        const __m128i select = _mm_cmpeq_epi8(quarter, _mm_set1_epi8(k));
+        result = _mm_or_si128(result, _mm_and_si128(select, _mm_shuffle_epi8(table[k], nibble)));
+    }
+    return result;
+}
+
+int32_t convert_indexed_pixels_simd(const uint8_t* src, uint8_t* dst, int32_t count,
+                                    const uint8_t* c0, const uint8_t* c1, const uint8_t* c2)
+{
+    __m128i table0[4];
+    __m128i table1[4];
+    __m128i table2[4];
+
+    for (int32_t k = 0;k < 4;++k)
+    {
+        table0[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c0 + k * 16));
+        table1[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c1 + k * 16));
+        table2[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c2 + k * 16));
+    }
+    const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xFF));
+
+    int32_t i = 0;
+    for (;i + 16 <= count;i += 16)
+    {
+        const __m128i index = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+
+        const __m128i ch0 = lookup_64(table0, index);
+        const __m128i ch1 = lookup_64(table1, index);
+        const __m128i ch2 = lookup_64(table2, index);
+
+        // interleave into 4 byte pixels
+        const __m128i ch01_lo = _mm_unpacklo_epi8(ch0, ch1);
+        const __m128i ch01_hi = _mm_unpackhi_epi8(ch0, ch1);
+        const __m128i ch23_lo = _mm_unpacklo_epi8(ch2, alpha);
+        const __m128i ch23_hi = _mm_unpackhi_epi8(ch2, alpha);
+
+        __m128i* out = reinterpret_cast<__m128i*>(dst + i * 4);
+        _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(ch01_lo, ch23_lo));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(ch01_lo, ch23_lo));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(ch01_hi, ch23_hi));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(ch01_hi, ch23_hi));
+    }
+    return i;
+}
+
+#else
+
+int32_t convert_indexed_pixels_simd(const uint8_t*, uint8_t*, int32_t,
+                                    const uint8_t*, const uint8_t*, const uint8_t*)
+{
+    return 0; // no vector unit available, everything goes through the scalar loop
+}
+
+#endif
+
+} // namespace
+
+void convert_indexed_pixels(const uint8_t* src, uint8_t* dst, int32_t count,
+                            const PaletteLUT& lut, PixelFormat format)
+{
+    const uint8_t* c0 = format == PixelFormat::RGBA8888 ? lut.r.data() : lut.b.data();
+    const uint8_t* c1 = lut.g.data();
+    const uint8_t* c2 = format == PixelFormat::RGBA8888 ? lut.b.data() : lut.r.data();
+
+    const int32_t converted = convert_indexed_pixels_simd(src, dst, count, c0, c1, c2);
+
+    convert_indexed_pixels_scalar(src + converted, dst + converted * BYTES_PER_PIXEL,
+                                  count - converted, c0, c1, c2);
+}
+
+void fill_pixels(uint8_t* dst, int32_t count, uint8_t r, uint8_t g, uint8_t b, PixelFormat format)
+{
+    const uint8_t c0 = format == PixelFormat::RGBA8888 ? r : b;
+    const uint8_t c2 = format == PixelFormat::RGBA8888 ? b : r;
+
+    for (int32_t i = 0;i < count;++i)
+    {
+        dst[i * 4 + 0] = c0;
+        dst[i * 4 + 1] = g;
+        dst[i * 4 + 2] = c2;
+        dst[i * 4 + 3] = 0xFF;
+    }
+}
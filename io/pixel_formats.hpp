@@ -0,0 +1,35 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// The PPU outputs one byte per pixel, an index into the NES system palette (64 colors). These
+// helpers expand indexed pixels into packed 32 bit formats for whoever consumes the frame. The
+// palette is stored as separate channel planes so the SIMD paths can look up 16 pixels at once
+// with byte table lookups (NEON tbl / SSSE3 pshufb) and interleave the channels on store.
+
+enum class PixelFormat
+{
+    RGBA8888, // byte order r, g, b, a. QImage::Format_RGBA8888
+    BGRA8888, // byte order b, g, r, a. QImage::Format_ARGB32 on little endian hosts
+};
+
+struct PaletteLUT
+{
+    static constexpr int32_t SIZE = 64;
+
+    alignas(16) std::array<uint8_t, SIZE> r;
+    alignas(16) std::array<uint8_t, SIZE> g;
+    alignas(16) std::array<uint8_t, SIZE> b;
+};
+
+// All of the supported output formats are 32 bits per pixel
+static constexpr int32_t BYTES_PER_PIXEL = 4;
+
+// Convert count indexed pixels from src into dst in the requested format. Only the low 6 bits
+// of each source byte are used.
+void convert_indexed_pixels(const uint8_t* src, uint8_t* dst, int32_t count,
+                            const PaletteLUT& lut, PixelFormat format);
+
+// Fill count pixels of dst with a single color
+void fill_pixels(uint8_t* dst, int32_t count, uint8_t r, uint8_t g, uint8_t b, PixelFormat format);
@@ -1,8 +1,16 @@
 #include "io/prompt.hpp"
 
+#include "config/constants.hpp"
+#include "io/cartridge.hpp"
+#include "io/cheats.hpp"
+#include "io/nsf.hpp"
+#include "io/rom_library.hpp"
 #include "platform/ui_properties.hpp"
 #include "processor/utils.hpp"
 #include "system/nes.hpp"
+#include "system/nsf_player.hpp"
+#include "test/dirty_tiles_test.hpp"
+#include "test/scaler_benchmark.hpp"
 
 #include <cassert>
 #include <iostream>
@@ -106,6 +114,16 @@ bool CommandPrompt::execute_command(Nes& nes, std::string cmd)
     const std::regex step_regex("(step|s)\\s*(\\d*)");
     const std::regex exit_regex("exit|e|quit|q");
     const std::regex test_regex("test|t");
+    const std::regex frame_skip_regex("(frameskip|fs) ?([0-9]+)?");
+    const std::regex scaler_regex("scaler ([a-z]+) ([A-Za-z0-9]+)");
+    const std::regex ntsc_regex("ntsc ([a-z]+) (on|off)");
+    const std::regex benchmark_regex("bench|benchmark");
+    const std::regex dirty_tiles_test_regex("test dirty");
+    const std::regex library_scan_regex("library scan (.+)");
+    const std::regex library_load_regex("library load ([0-9]+)");
+    const std::regex library_regex("library ?(.*)");
+    const std::regex cheat_regex("cheat ?(.*)");
+    const std::regex nsf_regex("nsf (.+?\\.nsf)(?: ([0-9]+))?(?: ([0-9]+))?");
     const std::regex print_regex("(print|p) (r|registers|m|memory|s|stack|vram|v|n|nametable|tile|oam|sprite|attr|palette) ?(0x[A-Fa-f0-9]+|[0-9]+)? ?(0x[A-Fa-f0-9]+|[0-9]+)?");
     const std::regex set_regex("(set) (m|memory) ?(0x[A-Fa-f0-9]+|[0-9]+)? ?(0x[A-Fa-f0-9]+|[0-9]+)");
     std::smatch base_match;
@@ -131,6 +149,159 @@ bool CommandPrompt::execute_command(Nes& nes, std::string cmd)
         nes.processor().execute_instruction({{0xA9, 0x0}});
         nes.processor().execute_instruction({{0xAD, 142, 2}});
     }
+    else if (std::regex_match(cmd, base_match, frame_skip_regex))
+    {
+        if (base_match.size() == 3 && base_match[2].str().size())
+        {
+            nes.set_frame_skip(std::stoi(base_match[2], 0, 0));
+        }
+        std::cout << "frame skip: rendering 1 of " << nes.frame_skip() << " frames\n";
+    }
+    else if (std::regex_match(cmd, base_match, scaler_regex))
+    {
+        std::optional<Scaler> scaler = scaler_from_name(base_match[2].str());
+
+        if (!scaler)
+        {
+            std::cout << "Unknown scaler: " << base_match[2] << " (None, Nearest2x, Nearest3x, Nearest4x, "
+                      << "Scale2x, Scale3x, XBRLite2x)\n";
+        }
+        else if (!nes.set_scaler(base_match[1].str(), *scaler))
+        {
+            std::cout << "Unknown frame consumer: " << base_match[1] << " (display, snapshot, agent)\n";
+        }
+    }
+    else if (std::regex_match(cmd, base_match, ntsc_regex))
+    {
+        if (!nes.set_ntsc_filter(base_match[1].str(), base_match[2] == "on"))
+        {
+            std::cout << "Unknown frame consumer: " << base_match[1] << " (display, snapshot, agent)\n";
+        }
+    }
+    else if (std::regex_match(cmd, base_match, benchmark_regex))
+    {
+        ScalerBenchmark().run();
+    }
+    else if (std::regex_match(cmd, base_match, dirty_tiles_test_regex))
+    {
+        std::cout << "dirty tiles test " << (DirtyTilesTest().run() ? "passed" : "failed") << "\n";
+    }
+    else if (std::regex_match(cmd, base_match, library_scan_regex))
+    {
+        RomLibrary::ScanStats stats = RomLibrary::scan(base_match[1].str(), ROM_LIBRARY_CATALOG_PATH);
+
+        std::cout << stats.roms << " ROMs, " << stats.indexed << " indexed and " << stats.reused
+                  << " unchanged in " << stats.milliseconds << "ms\n";
+    }
+    else if (std::regex_match(cmd, base_match, library_load_regex))
+    {
+        std::shared_ptr<RomLibrary> library = RomLibrary::open(ROM_LIBRARY_CATALOG_PATH);
+        const size_t index = std::stoul(base_match[1]);
+
+        if (!library || index >= library->size())
+        {
+            std::cout << "No ROM " << index << " in the library\n";
+        }
+        else
+        {
+            std::shared_ptr<Cartridge> cartridge = Cartridge::create(std::string(library->rom(index).path));
+
+            if (!nes.load_cartridge(cartridge))
+            {
+                std::cout << "Could not load " << library->rom(index).path << "\n";
+            }
+            else
+            {
+                library->mark_played(index);
+
+                if (cartridge->battery_ram_unsaved())
+                {
+                    std::cout << "Another instance of this game is using its save file, progress won't be saved\n";
+                }
+            }
+        }
+    }
+    else if (std::regex_match(cmd, base_match, library_regex))
+    {
+        std::shared_ptr<RomLibrary> library = RomLibrary::open(ROM_LIBRARY_CATALOG_PATH);
+
+        if (!library)
+        {
+            std::cout << "No ROM library, create it with: library scan <directory>\n";
+        }
+        else
+        {
+            for (uint32_t index : library->find(base_match[1].str()))
+            {
+                RomLibrary::Rom rom = library->rom(index);
+                std::cout << std::dec << std::setw(5) << index << "  " << rom.title << "  (mapper " << rom.mapper
+                          << ", crc32 " << std::hex << std::setw(8) << std::setfill('0') << rom.crc32
+                          << std::setfill(' ') << std::dec << ")\n";
+            }
+        }
+    }
+    else if (std::regex_match(cmd, base_match, cheat_regex))
+    {
+        // cheat <code> adds a Game Genie or address:value[:compare] code, cheat clear removes
+        // them all and cheat lists them
+        const std::string code = base_match[1].str();
+
+        if (code == "clear")
+        {
+            nes.clear_cheats();
+        }
+        else if (code.size())
+        {
+            std::optional<CPUPageTable::Patch> patch = decode_cheat(code);
+
+            if (patch)
+            {
+                nes.add_cheat(*patch);
+            }
+            else
+            {
+                std::cout << "Invalid cheat: " << code << " (Game Genie code, or hex address:value[:compare] "
+                          << "with the address in $8000 - $FFFF)\n";
+            }
+        }
+
+        for (const CPUPageTable::Patch& patch : nes.cheats())
+        {
+            std::cout << std::hex << std::setfill('0') << "$" << std::setw(4) << patch.address << " = "
+                      << std::setw(2) << +patch.value;
+            if (patch.compare)
+            {
+                std::cout << " if " << std::setw(2) << +*patch.compare;
+            }
+            std::cout << std::setfill(' ') << std::dec << (nes.cheat_applied(patch) ? "" : "  (not in the mapped bank)") << "\n";
+        }
+    }
+    else if (std::regex_match(cmd, base_match, nsf_regex))
+    {
+        // nsf <file> [track] [seconds], renders the track headless to a wav in /tmp
+        std::filesystem::path path = base_match[1].str();
+        std::shared_ptr<Cartridge_NSF> nsf = Cartridge_NSF::create(path);
+
+        if (nsf)
+        {
+            const int32_t track = base_match[2].matched ? std::stoi(base_match[2]) - 1 : nsf->info().first_track;
+            const double seconds = base_match[3].matched ? std::stod(base_match[3]) : 60.0;
+
+            NsfPlayer player(nsf);
+
+            auto start_time = std::chrono::high_resolution_clock::now();
+            std::vector<int16_t> samples = player.render(track, seconds);
+            std::chrono::duration<double> render_time = std::chrono::high_resolution_clock::now() - start_time;
+
+            const std::filesystem::path wav_path = "/tmp/" + path.stem().string() + "-" + std::to_string(track + 1) + ".wav";
+            if (NsfPlayer::write_wav(wav_path, samples, player.sample_rate()))
+            {
+                std::cout << "track " << track + 1 << " of " << nsf->info().track_count << ", " << seconds
+                          << "s rendered in " << render_time.count() << "s (" << seconds / render_time.count()
+                          << "x realtime) to " << wav_path << "\n";
+            }
+        }
+    }
     else if (std::regex_match(cmd, base_match, break_regex))
     {
         if (base_match.size() == 3 && base_match[2].str().size())
@@ -0,0 +1,275 @@
+#include "io/rom_archive.hpp"
+
+#include "config/constants.hpp"
+#include "io/crc32.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iomanip>
+#include <optional>
+#include <sstream>
+#include <string>
+
+#include <glog/logging.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+struct CompressedRom
+{
+    enum class Method
+    {
+        Stored,
+        Deflate, // raw deflate, from a zip
+        Gzip,
+    };
+
+    std::span<const uint8_t> data;
+    Method method;
+
+    // of the uncompressed ROM
+    uint32_t crc32;
+    uint32_t size;
+};
+
+std::string lowercase_extension(const fs::path& path)
+{
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+    return extension;
+}
+
+uint16_t read16(std::span<const uint8_t> buffer, size_t offset)
+{
+    return buffer[offset] | (buffer[offset + 1] << 8);
+}
+
+uint32_t read32(std::span<const uint8_t> buffer, size_t offset)
+{
+    return read16(buffer, offset) | (uint32_t(read16(buffer, offset + 2)) << 16);
+}
+
+// https://www.rfc-editor.org/rfc/rfc1952
+std::optional<CompressedRom> find_gzip_rom(std::span<const uint8_t> archive)
+{
+    if (archive.size() < 18 || archive[0] != 0x1F || archive[1] != 0x8B)
+    {
+        return std::nullopt;
+    }
+
+    // the trailer is the CRC32 and the size (mod 2^32) of the uncompressed data
+    return CompressedRom{.data = archive, .method = CompressedRom::Method::Gzip,
+                         .crc32 = read32(archive, archive.size() - 8), .size = read32(archive, archive.size() - 4)};
+}
+
+// https://pkware.cachefly.net/webdocs/casestudies/APPNOTE.TXT
+// The first .nes file in the central directory. Zip64 isn't supported, ROMs are far too small.
+std::optional<CompressedRom> find_zip_rom(std::span<const uint8_t> archive)
+{
+    static constexpr uint32_t LOCAL_HEADER_SIGNATURE = 0x04034B50;
+    static constexpr uint32_t CENTRAL_HEADER_SIGNATURE = 0x02014B50;
+    static constexpr uint32_t END_SIGNATURE = 0x06054B50;
+
+    static constexpr size_t LOCAL_HEADER_SIZE = 30;
+    static constexpr size_t CENTRAL_HEADER_SIZE = 46;
+    static constexpr size_t END_SIZE = 22;
+
+    if (archive.size() < END_SIZE)
+    {
+        return std::nullopt;
+    }
+
+    // the end of central directory record is last, followed only by a comment of up to 64KB
+    const size_t lowest_end = archive.size() > END_SIZE + 0xFFFF ? archive.size() - END_SIZE - 0xFFFF : 0;
+    size_t end = archive.size() - END_SIZE;
+
+    while (read32(archive, end) != END_SIGNATURE)
+    {
+        if (end == lowest_end)
+        {
+            return std::nullopt;
+        }
+        end--;
+    }
+
+    const uint16_t entry_count = read16(archive, end + 10);
+    size_t offset = read32(archive, end + 16);
+
+    for (uint16_t i = 0;i < entry_count;++i)
+    {
+        if (offset + CENTRAL_HEADER_SIZE > archive.size() || read32(archive, offset) != CENTRAL_HEADER_SIGNATURE)
+        {
+            return std::nullopt;
+        }
+
+        const uint16_t method = read16(archive, offset + 10);
+        const uint32_t crc32 = read32(archive, offset + 16);
+        const uint32_t compressed_size = read32(archive, offset + 20);
+        const uint32_t size = read32(archive, offset + 24);
+        const uint16_t name_length = read16(archive, offset + 28);
+        const size_t local_offset = read32(archive, offset + 42);
+
+        const size_t name_offset = offset + CENTRAL_HEADER_SIZE;
+        offset = name_offset + name_length + read16(archive, offset + 30) + read16(archive, offset + 32);
+
+        if (name_offset + name_length > archive.size())
+        {
+            return std::nullopt;
+        }
+        const std::string_view name(reinterpret_cast<const char*>(archive.data() + name_offset), name_length);
+
+        if (lowercase_extension(name) != ".nes" || (method != 0 && method != 8))
+        {
+            continue;
+        }
+
+        // the data follows the local header, its name and extra field can differ in length from
+        // the central directory's
+        if (local_offset + LOCAL_HEADER_SIZE > archive.size() || read32(archive, local_offset) != LOCAL_HEADER_SIGNATURE)
+        {
+            return std::nullopt;
+        }
+        const size_t data_offset = local_offset + LOCAL_HEADER_SIZE + read16(archive, local_offset + 26) +
+                                   read16(archive, local_offset + 28);
+
+        if (data_offset + compressed_size > archive.size())
+        {
+            return std::nullopt;
+        }
+
+        return CompressedRom{.data = archive.subspan(data_offset, compressed_size),
+                             .method = method == 8 ? CompressedRom::Method::Deflate : CompressedRom::Method::Stored,
+                             .crc32 = crc32, .size = size};
+    }
+    return std::nullopt;
+}
+
+// Inflates in one pass from the archive's mapping into the output, which is exactly the size of
+// the ROM
+bool inflate_rom(const CompressedRom& rom, std::span<uint8_t> output)
+{
+    if (rom.method == CompressedRom::Method::Stored)
+    {
+        if (rom.data.size() != output.size())
+        {
+            return false;
+        }
+        std::memcpy(output.data(), rom.data.data(), output.size());
+        return true;
+    }
+
+    z_stream stream{};
+    const int window_bits = rom.method == CompressedRom::Method::Gzip ? 16 + MAX_WBITS : -MAX_WBITS;
+
+    if (inflateInit2(&stream, window_bits) != Z_OK)
+    {
+        return false;
+    }
+
+    stream.next_in = const_cast<Bytef*>(rom.data.data());
+    stream.avail_in = static_cast<uInt>(rom.data.size());
+    stream.next_out = output.data();
+    stream.avail_out = static_cast<uInt>(output.size());
+
+    const int result = inflate(&stream, Z_FINISH);
+    inflateEnd(&stream);
+
+    return result == Z_STREAM_END && stream.avail_out == 0;
+}
+
+}
+
+bool is_rom_file(const fs::path& path)
+{
+    const std::string extension = lowercase_extension(path);
+    return extension == ".nes" || extension == ".gz" || extension == ".zip";
+}
+
+std::shared_ptr<MappedFile> open_rom_file(const fs::path& path)
+{
+    const std::string extension = lowercase_extension(path);
+
+    if (extension != ".gz" && extension != ".zip")
+    {
+        return MappedFile::open(path);
+    }
+
+    std::shared_ptr<MappedFile> archive = MappedFile::open(path);
+    if (!archive)
+    {
+        return nullptr;
+    }
+
+    std::optional<CompressedRom> rom = extension == ".gz" ? find_gzip_rom(archive->buffer())
+                                                          : find_zip_rom(archive->buffer());
+    if (!rom || rom->size == 0)
+    {
+        LOG(ERROR) << "No ROM found in " << path;
+        return nullptr;
+    }
+
+    std::stringstream cache_name;
+    cache_name << std::hex << std::setw(8) << std::setfill('0') << rom->crc32 << "-" << std::dec << rom->size << ".nes";
+    const fs::path cache_path = fs::path(ROM_CACHE_PATH) / cache_name.str();
+
+    std::error_code ec;
+    if (fs::file_size(cache_path, ec) == rom->size && !ec)
+    {
+        if (std::shared_ptr<MappedFile> cached = MappedFile::open(cache_path))
+        {
+            return cached;
+        }
+    }
+
+    // Inflate into a temporary file in the cache, renamed into place once its CRC checks out so
+    // the cache never has a partial ROM under a real name. Without a cache the ROM is inflated
+    // into anonymous memory instead.
+    fs::create_directories(ROM_CACHE_PATH, ec);
+
+    // mkstemp makes a name no other thread or process is using
+    std::string temp_name = fs::path(cache_path).concat(".XXXXXX").string();
+    const int temp_fd = mkstemp(temp_name.data());
+    const fs::path temp_path = temp_name;
+
+    std::shared_ptr<MappedFile> file;
+    if (temp_fd >= 0)
+    {
+        fchmod(temp_fd, 0644); // mkstemp's 0600, the rest of the cache is 0644
+        ::close(temp_fd);
+        file = MappedFile::open_shared(temp_path, rom->size);
+    }
+    const bool cached = file != nullptr;
+
+    if (!cached)
+    {
+        LOG(WARNING) << "Can't cache " << path << " in " << ROM_CACHE_PATH;
+        if (temp_fd >= 0)
+        {
+            fs::remove(temp_path, ec);
+        }
+        file = MappedFile::allocate(rom->size);
+    }
+
+    if (!file || !inflate_rom(*rom, file->buffer()) || crc32(file->buffer()) != rom->crc32)
+    {
+        LOG(ERROR) << "Failed to decompress " << path;
+        if (cached)
+        {
+            fs::remove(temp_path, ec);
+        }
+        return nullptr;
+    }
+
+    if (cached)
+    {
+        fs::rename(temp_path, cache_path, ec);
+        LOG_IF(ERROR, ec) << "Failed to add " << cache_path << " to the ROM cache: " << ec.message();
+    }
+    return file;
+}
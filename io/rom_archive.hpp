@@ -0,0 +1,19 @@
+#pragma once
+
+#include "io/files.hpp"
+
+#include <filesystem>
+#include <memory>
+
+// Opens a ROM file, uncompressed (.nes) or compressed (.nes.gz, or the first .nes in a .zip,
+// stored or deflated).
+//
+// Compressed ROMs are inflated straight from a mapping of the archive into a mapping of a file
+// in the ROM cache, so the cartridge ends up pointing into one page aligned buffer with no copies
+// in between. Cache files are named by the CRC32 and size of the uncompressed ROM, which gzip and
+// zip both store next to the compressed data, so a ROM that was loaded before is found without
+// inflating anything and opened with a plain mmap.
+std::shared_ptr<MappedFile> open_rom_file(const std::filesystem::path& path);
+
+// .nes, .gz and .zip
+bool is_rom_file(const std::filesystem::path& path);
@@ -0,0 +1,33 @@
+#include "io/rom_database.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace
+{
+
+using Mirroring = PPUPageTable::NametableMirroring;
+
+// Sorted by crc32 and searched with a binary search. Only add entries checked against a dump
+// and its board, an entry wins over the header.
+constexpr auto ROMS = std::to_array<RomDatabaseEntry>(
+{
+    // test/nes-tutorial.nes
+    {.crc32 = 0x68BEE966, .mapper = 0, .submapper = 0, .mirroring = Mirroring::Vertical,
+     .battery = false, .prg_ram_size = 0x2000, .chr_ram_size = 0},
+});
+
+static_assert(std::ranges::is_sorted(ROMS, {}, &RomDatabaseEntry::crc32), "ROMS must be sorted by crc32");
+
+}
+
+const RomDatabaseEntry* find_rom(uint32_t crc32)
+{
+    auto it = std::ranges::lower_bound(ROMS, crc32, {}, &RomDatabaseEntry::crc32);
+
+    if (it == ROMS.end() || it->crc32 != crc32)
+    {
+        return nullptr;
+    }
+    return &*it;
+}
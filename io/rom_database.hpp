@@ -0,0 +1,22 @@
+#pragma once
+
+#include "processor/ppu_page_table.hpp"
+
+#include <cstdint>
+
+// Known good cartridge parameters for ROMs identified by hash. Dumps are often passed around with
+// wrong headers (the mapper or the mirroring, or garbage in the bytes iNES 1.0 leaves unused),
+// and an entry for the ROM overrides whatever its header says.
+struct RomDatabaseEntry
+{
+    uint32_t crc32; // of PRG-ROM and CHR-ROM, without the header and trainer
+    uint16_t mapper;
+    uint8_t submapper;
+    PPUPageTable::NametableMirroring mirroring;
+    bool battery;
+    uint32_t prg_ram_size; // bytes, volatile and battery backed
+    uint32_t chr_ram_size; // bytes
+};
+
+// nullptr when the ROM isn't in the database
+const RomDatabaseEntry* find_rom(uint32_t crc32);
@@ -0,0 +1,107 @@
+#include "io/rom_image.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+#include <glog/logging.h>
+#include <sys/mman.h>
+
+namespace
+{
+
+// Keyed by the sizes too, so a CRC32 collision between different ROMs needs the same sizes
+using RomKey = std::tuple<uint32_t, size_t, size_t>;
+
+std::mutex registry_mutex;
+std::map<RomKey, std::weak_ptr<const RomImage>> registry;
+
+size_t round_up(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+// size bytes, rounded up to whole huge pages, at a huge page aligned address. Over allocates
+// by a huge page and unmaps what is outside the aligned range.
+uint8_t* allocate_huge_pages(size_t size)
+{
+    const size_t reserved_size = size + RomImage::HUGE_PAGE_SIZE;
+    void* reserved = mmap(nullptr, reserved_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+
+    if (reserved == MAP_FAILED)
+    {
+        LOG(ERROR) << "mmap failed " << strerror(errno);
+        return nullptr;
+    }
+
+    uint8_t* start = static_cast<uint8_t*>(reserved);
+    uint8_t* aligned = reinterpret_cast<uint8_t*>(round_up(reinterpret_cast<uintptr_t>(start), RomImage::HUGE_PAGE_SIZE));
+
+    if (aligned > start)
+    {
+        munmap(start, aligned - start);
+    }
+    if (aligned + size < start + reserved_size)
+    {
+        munmap(aligned + size, start + reserved_size - (aligned + size));
+    }
+
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+    return aligned;
+}
+
+}
+
+std::shared_ptr<const RomImage> RomImage::share(uint32_t crc32, std::span<const uint8_t> prg_rom,
+                                                std::span<const uint8_t> chr_rom)
+{
+    const RomKey key{crc32, prg_rom.size(), chr_rom.size()};
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+
+    if (auto it = registry.find(key); it != registry.end())
+    {
+        if (std::shared_ptr<const RomImage> image = it->second.lock())
+        {
+            return image;
+        }
+    }
+    std::erase_if(registry, [](const auto& entry) { return entry.second.expired(); });
+
+    std::shared_ptr<RomImage> image(new RomImage());
+    image->memory_size_ = round_up(std::max<size_t>(prg_rom.size() + chr_rom.size(), 1), HUGE_PAGE_SIZE);
+    image->memory_ = allocate_huge_pages(image->memory_size_);
+
+    if (!image->memory_)
+    {
+        return nullptr;
+    }
+
+    image->prg_rom_size_ = prg_rom.size();
+    image->chr_rom_size_ = chr_rom.size();
+    image->crc32_ = crc32;
+
+    std::copy(prg_rom.begin(), prg_rom.end(), image->memory_);
+    std::copy(chr_rom.begin(), chr_rom.end(), image->memory_ + prg_rom.size());
+
+    // a stray write through a page table faults instead of changing every instance's ROM
+    if (mprotect(image->memory_, image->memory_size_, PROT_READ) != 0)
+    {
+        LOG(ERROR) << "mprotect failed " << strerror(errno);
+    }
+
+    registry[key] = image;
+    return image;
+}
+
+RomImage::~RomImage()
+{
+    if (memory_)
+    {
+        munmap(memory_, memory_size_);
+    }
+}
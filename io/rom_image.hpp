@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+
+class RomImage
+{
+    // The PRG-ROM and CHR-ROM of a cartridge, copied once into read only memory and shared by
+    // every cartridge of the same ROM in the process. Cartridges only keep their bank registers
+    // and RAM, so many instances of one game map the same ROM pages and share their cache lines
+    // and TLB entries.
+    //
+    // Images are aligned to huge pages and advised to use them where the OS has them (Linux
+    // transparent huge pages), so an image of up to 2MB, which is all of them in practice, is
+    // reached through a single TLB entry. Images are freed when the last cartridge using one is.
+public:
+    static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    // The image of the ROM with the CRC32 (of PRG and CHR, as Cartridge::create computes it),
+    // from the registry or, the first time, copied from prg and chr. nullptr if it can't be
+    // allocated.
+    static std::shared_ptr<const RomImage> share(uint32_t crc32, std::span<const uint8_t> prg_rom,
+                                                 std::span<const uint8_t> chr_rom);
+
+    ~RomImage();
+
+    // The memory is read only, the spans are mutable only because the page tables take mutable
+    // spans for RAM too. ROM is always mapped without write access.
+    std::span<uint8_t> prg_rom() const { return {memory_, prg_rom_size_}; }
+    std::span<uint8_t> chr_rom() const { return {memory_ + prg_rom_size_, chr_rom_size_}; }
+
+    uint32_t crc32() const { return crc32_; }
+
+private:
+    RomImage() = default;
+
+    uint8_t* memory_{nullptr};
+    size_t memory_size_{0};
+
+    size_t prg_rom_size_{0};
+    size_t chr_rom_size_{0};
+    uint32_t crc32_{0};
+};
@@ -0,0 +1,413 @@
+#include "io/rom_library.hpp"
+
+#include "io/cartridge.hpp"
+#include "io/rom_archive.hpp"
+#include "io/rom_database.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+#include <glog/logging.h>
+
+namespace fs = std::filesystem;
+
+struct RomLibrary::CatalogHeader
+{
+    static constexpr uint32_t MAGIC = 0x4C53454E; // "NESL"
+    static constexpr uint32_t VERSION = 2; // 2: CRC32 of only the PRG and CHR, without trailing data
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t strings_size;
+};
+
+struct RomLibrary::CatalogEntry
+{
+    int64_t mtime;       // nanoseconds, of the file when it was indexed
+    uint64_t file_size;
+    int64_t last_played; // seconds since the epoch
+    uint32_t crc32;
+    uint32_t prg_rom_size;
+    uint32_t chr_rom_size;
+    uint32_t title_offset; // into the strings after the entries
+    uint32_t path_offset;
+    uint16_t title_length;
+    uint16_t path_length;
+    uint16_t mapper;
+    uint8_t submapper;
+    uint8_t battery;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(RomLibrary::CatalogHeader) == 16);
+static_assert(sizeof(RomLibrary::CatalogEntry) == 56);
+
+namespace
+{
+
+struct IndexedRom
+{
+    std::string title;
+    std::string path;
+    RomLibrary::CatalogEntry entry;
+};
+
+// game.nes.gz is titled game like game.nes
+std::string rom_title(const fs::path& path)
+{
+    fs::path stem = path.stem();
+    return stem.extension() == ".nes" ? stem.stem().string() : stem.string();
+}
+
+int64_t mtime_ns(const fs::directory_entry& file, std::error_code& ec)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(file.last_write_time(ec).time_since_epoch()).count();
+}
+
+bool less_ignoring_case(std::string_view a, std::string_view b)
+{
+    return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(), [](unsigned char x, unsigned char y)
+    {
+        return std::tolower(x) < std::tolower(y);
+    });
+}
+
+// Reads the header and hashes PRG and CHR, the same identification as Cartridge::create
+std::optional<IndexedRom> index_rom(const fs::path& path, int64_t mtime, uint64_t file_size)
+{
+    std::shared_ptr<MappedFile> file = open_rom_file(path);
+    if (!file)
+    {
+        return std::nullopt;
+    }
+
+    std::span<uint8_t> buffer = file->buffer();
+    Cartridge::Header header = Cartridge::parse_header(buffer);
+
+    if (header.format == Cartridge::Format::Unknown)
+    {
+        return std::nullopt;
+    }
+
+    IndexedRom rom{.title = rom_title(path), .path = path.string(), .entry = {}};
+    rom.entry.mtime = mtime;
+    rom.entry.file_size = file_size;
+    rom.entry.crc32 = Cartridge::rom_crc32(buffer, header);
+    rom.entry.prg_rom_size = header.prg_rom_size;
+    rom.entry.chr_rom_size = header.chr_rom_size;
+    rom.entry.mapper = header.mapper;
+    rom.entry.submapper = header.submapper;
+    rom.entry.battery = header.battery;
+
+    if (const RomDatabaseEntry* known = find_rom(rom.entry.crc32))
+    {
+        rom.entry.mapper = known->mapper;
+        rom.entry.submapper = known->submapper;
+        rom.entry.battery = known->battery;
+    }
+    return rom;
+}
+
+}
+
+RomLibrary::RomLibrary(std::shared_ptr<MappedFile> file)
+: file_(file)
+{
+    std::span<uint8_t> buffer = file_->buffer();
+    const CatalogHeader* header = reinterpret_cast<const CatalogHeader*>(buffer.data());
+
+    entry_count_ = header->entry_count;
+    entries_ = reinterpret_cast<CatalogEntry*>(buffer.data() + sizeof(CatalogHeader));
+
+    const size_t strings_offset = sizeof(CatalogHeader) + entry_count_ * sizeof(CatalogEntry);
+    strings_ = std::span<const char>(reinterpret_cast<const char*>(buffer.data()) + strings_offset, header->strings_size);
+}
+
+std::shared_ptr<RomLibrary> RomLibrary::open(const fs::path& catalog_path)
+{
+    std::error_code ec;
+    const uintmax_t size = fs::file_size(catalog_path, ec);
+
+    if (ec || size < sizeof(CatalogHeader))
+    {
+        return nullptr;
+    }
+
+    // shared and writable for mark_played
+    std::shared_ptr<MappedFile> file = MappedFile::open_shared(catalog_path, size);
+    if (!file)
+    {
+        return nullptr;
+    }
+
+    const CatalogHeader* header = reinterpret_cast<const CatalogHeader*>(file->buffer().data());
+
+    if (header->magic != CatalogHeader::MAGIC || header->version != CatalogHeader::VERSION ||
+        sizeof(CatalogHeader) + uint64_t(header->entry_count) * sizeof(CatalogEntry) + header->strings_size > size)
+    {
+        LOG(ERROR) << catalog_path << " isn't a ROM library catalog";
+        return nullptr;
+    }
+
+    return std::shared_ptr<RomLibrary>(new RomLibrary(file));
+}
+
+const RomLibrary::CatalogEntry& RomLibrary::entry(size_t index) const
+{
+    assert(index < entry_count_);
+    return entries_[index];
+}
+
+std::string_view RomLibrary::string(uint32_t offset, uint16_t length) const
+{
+    if (offset + length > strings_.size())
+    {
+        return {};
+    }
+    return std::string_view(strings_.data() + offset, length);
+}
+
+RomLibrary::Rom RomLibrary::rom(size_t index) const
+{
+    const CatalogEntry& e = entry(index);
+
+    return {.title = string(e.title_offset, e.title_length),
+            .path = string(e.path_offset, e.path_length),
+            .crc32 = e.crc32,
+            .mapper = e.mapper,
+            .submapper = e.submapper,
+            .battery = e.battery != 0,
+            .prg_rom_size = e.prg_rom_size,
+            .chr_rom_size = e.chr_rom_size,
+            .last_played = e.last_played};
+}
+
+std::vector<uint32_t> RomLibrary::find(std::string_view text) const
+{
+    std::vector<uint32_t> result;
+
+    for (uint32_t i = 0;i < entry_count_;++i)
+    {
+        const std::string_view title = string(entries_[i].title_offset, entries_[i].title_length);
+
+        auto match = std::search(title.begin(), title.end(), text.begin(), text.end(), [](unsigned char a, unsigned char b)
+        {
+            return std::tolower(a) == std::tolower(b);
+        });
+
+        if (match != title.end() || text.empty())
+        {
+            result.push_back(i);
+        }
+    }
+    return result;
+}
+
+std::optional<size_t> RomLibrary::index_of(std::string_view path) const
+{
+    for (size_t i = 0;i < entry_count_;++i)
+    {
+        if (string(entries_[i].path_offset, entries_[i].path_length) == path)
+        {
+            return i;
+        }
+    }
+    return std::nullopt;
+}
+
+void RomLibrary::mark_played(size_t index)
+{
+    assert(index < entry_count_);
+
+    const auto now = std::chrono::system_clock::now().time_since_epoch();
+    entries_[index].last_played = std::chrono::duration_cast<std::chrono::seconds>(now).count();
+
+    file_->sync_async();
+}
+
+RomLibrary::ScanStats RomLibrary::scan(const fs::path& root, const fs::path& catalog_path, int32_t thread_count)
+{
+    const auto start_time = std::chrono::steady_clock::now();
+    ScanStats stats;
+
+    // entries of the previous catalog by path, to skip unchanged files
+    std::shared_ptr<RomLibrary> previous = open(catalog_path);
+    std::unordered_map<std::string_view, const CatalogEntry*> previous_entries;
+
+    for (size_t i = 0;previous && i < previous->size();++i)
+    {
+        const CatalogEntry& e = previous->entry(i);
+        previous_entries[previous->string(e.path_offset, e.path_length)] = &e;
+    }
+
+    // Directories are a shared work queue, workers take one, index its ROMs and queue its
+    // subdirectories. The walk is done when the queue is empty and no worker is busy.
+    std::mutex lock;
+    std::condition_variable queue_changed;
+    std::vector<fs::path> directories{root};
+    int32_t busy_workers = 0;
+
+    thread_count = std::max(thread_count, 1);
+    std::vector<std::vector<IndexedRom>> results(thread_count);
+    std::vector<int32_t> reused(thread_count, 0);
+
+    auto index_directory = [&](const fs::path& directory, int32_t worker)
+    {
+        std::error_code ec;
+        const auto options = fs::directory_options::skip_permission_denied;
+
+        for (auto it = fs::directory_iterator(directory, options, ec);!ec && it != fs::directory_iterator();it.increment(ec))
+        {
+            const fs::directory_entry& file = *it;
+            std::error_code file_ec;
+
+            if (file.is_directory(file_ec) && !file.is_symlink(file_ec))
+            {
+                {
+                    std::scoped_lock guard(lock);
+                    directories.push_back(file.path());
+                }
+                queue_changed.notify_one();
+                continue;
+            }
+
+            if (!file.is_regular_file(file_ec) || !is_rom_file(file.path()))
+            {
+                continue;
+            }
+
+            const int64_t mtime = mtime_ns(file, file_ec);
+            const uint64_t file_size = file.file_size(file_ec);
+            const std::string path = file.path().string();
+
+            auto it_previous = previous_entries.find(path);
+            const CatalogEntry* previous_entry = it_previous != previous_entries.end() ? it_previous->second : nullptr;
+
+            if (previous_entry && previous_entry->mtime == mtime && previous_entry->file_size == file_size)
+            {
+                results[worker].push_back({.title = rom_title(file.path()), .path = path, .entry = *previous_entry});
+                reused[worker]++;
+                continue;
+            }
+
+            if (std::optional<IndexedRom> rom = index_rom(file.path(), mtime, file_size))
+            {
+                rom->entry.last_played = previous_entry ? previous_entry->last_played : 0;
+                results[worker].push_back(std::move(*rom));
+            }
+        }
+    };
+
+    auto worker_loop = [&](int32_t worker)
+    {
+        while (true)
+        {
+            fs::path directory;
+            {
+                std::unique_lock guard(lock);
+                queue_changed.wait(guard, [&]() { return !directories.empty() || busy_workers == 0; });
+
+                if (directories.empty())
+                {
+                    return;
+                }
+                directory = std::move(directories.back());
+                directories.pop_back();
+                busy_workers++;
+            }
+
+            index_directory(directory, worker);
+
+            {
+                std::scoped_lock guard(lock);
+                busy_workers--;
+            }
+            queue_changed.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int32_t i = 0;i < thread_count;++i)
+    {
+        workers.emplace_back(worker_loop, i);
+    }
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+
+    std::vector<IndexedRom> roms;
+    for (int32_t i = 0;i < thread_count;++i)
+    {
+        std::move(results[i].begin(), results[i].end(), std::back_inserter(roms));
+        stats.reused += reused[i];
+    }
+    // paths too long for the entry are left out of the library
+    std::erase_if(roms, [](const IndexedRom& rom) { return rom.path.size() > UINT16_MAX; });
+
+    std::sort(roms.begin(), roms.end(), [](const IndexedRom& a, const IndexedRom& b)
+    {
+        const bool title_less = less_ignoring_case(a.title, b.title);
+        if (title_less || less_ignoring_case(b.title, a.title))
+        {
+            return title_less;
+        }
+        return a.path < b.path;
+    });
+
+    stats.roms = static_cast<int32_t>(roms.size());
+    stats.indexed = stats.roms - stats.reused;
+
+    // the strings follow the entries, written to a new file that replaces the catalog so a
+    // mapping of the previous one stays valid
+    std::string strings;
+    for (IndexedRom& rom : roms)
+    {
+        const size_t title_length = std::min<size_t>(rom.title.size(), UINT16_MAX);
+        rom.entry.title_offset = static_cast<uint32_t>(strings.size());
+        rom.entry.title_length = static_cast<uint16_t>(title_length);
+        strings.append(rom.title, 0, title_length);
+
+        rom.entry.path_offset = static_cast<uint32_t>(strings.size());
+        rom.entry.path_length = static_cast<uint16_t>(rom.path.size());
+        strings.append(rom.path);
+    }
+
+    const CatalogHeader header{.magic = CatalogHeader::MAGIC, .version = CatalogHeader::VERSION,
+                               .entry_count = static_cast<uint32_t>(roms.size()),
+                               .strings_size = static_cast<uint32_t>(strings.size())};
+
+    const fs::path temp_path = fs::path(catalog_path).concat(".tmp");
+    {
+        std::ofstream output(temp_path, std::ios::binary | std::ios::trunc);
+        output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        for (const IndexedRom& rom : roms)
+        {
+            output.write(reinterpret_cast<const char*>(&rom.entry), sizeof(rom.entry));
+        }
+        output.write(strings.data(), strings.size());
+
+        if (!output.good())
+        {
+            LOG(ERROR) << "Failed to write " << temp_path;
+            return stats;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(temp_path, catalog_path, ec);
+    LOG_IF(ERROR, ec) << "Failed to replace " << catalog_path << ": " << ec.message();
+
+    stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+    LOG(INFO) << "Indexed " << stats.roms << " ROMs under " << root << " (" << stats.indexed << " read, "
+              << stats.reused << " unchanged) in " << stats.milliseconds << "ms";
+
+    return stats;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "io/files.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+class RomLibrary
+{
+    // Index of a directory tree of ROMs, kept in a binary catalog file that is mapped as is:
+    // a header, a fixed size entry per ROM sorted by title, then the titles and paths. Opening
+    // the library is an mmap and listing or filtering it reads the mapping, nothing is parsed.
+    //
+    // Scanning walks the tree on a pool of threads and reads each ROM's header and CRC32 through
+    // MappedFile. A rescan reuses the entries of the previous catalog whose file still has the
+    // same mtime and size, so only new and changed files are read.
+public:
+    struct Rom
+    {
+        std::string_view title;
+        std::string_view path;
+        uint32_t crc32;
+        uint16_t mapper;
+        uint8_t submapper;
+        bool battery;
+        uint32_t prg_rom_size;
+        uint32_t chr_rom_size;
+        int64_t last_played; // seconds since the epoch, 0 if never
+    };
+
+    struct ScanStats
+    {
+        int32_t roms{0};
+        int32_t reused{0};  // unchanged since the previous catalog
+        int32_t indexed{0}; // new or changed, read and hashed
+        double milliseconds{0};
+    };
+
+    // nullptr when there is no catalog at the path or it isn't one
+    static std::shared_ptr<RomLibrary> open(const std::filesystem::path& catalog_path);
+
+    // Index the ROM files (.nes, .gz and .zip) under root and replace the catalog. The previous
+    // catalog at the path stays valid for anyone who has it open.
+    static ScanStats scan(const std::filesystem::path& root, const std::filesystem::path& catalog_path,
+                          int32_t thread_count = std::thread::hardware_concurrency());
+
+    size_t size() const { return entry_count_; }
+    Rom rom(size_t index) const;
+
+    // Indices of the ROMs whose title contains text, ignoring case, in title order. All of them
+    // for empty text.
+    std::vector<uint32_t> find(std::string_view text) const;
+
+    std::optional<size_t> index_of(std::string_view path) const;
+
+    // Stamps the ROM's last played time, written in place in the catalog
+    void mark_played(size_t index);
+
+    // layout of the catalog file
+    struct CatalogHeader;
+    struct CatalogEntry;
+
+private:
+    explicit RomLibrary(std::shared_ptr<MappedFile> file);
+
+    const CatalogEntry& entry(size_t index) const;
+    std::string_view string(uint32_t offset, uint16_t length) const;
+
+    std::shared_ptr<MappedFile> file_;
+
+    size_t entry_count_{0};
+    CatalogEntry* entries_{nullptr};
+    std::span<const char> strings_;
+};
@@ -0,0 +1,400 @@
+#include "io/scalers.hpp"
+
+#include "lib/magic_enum.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+// The kernels only need these operations. Comparisons return a mask with every bit set where
+// true, select picks from a where the mask is set and from b elsewhere.
+
+struct ScalarOps
+{
+    using V = uint8_t;
+    static constexpr int32_t WIDTH = 1;
+
+    static V load(const uint8_t* p) { return *p; }
+    static V set1(uint8_t v) { return v; }
+    static V eq(V a, V b) { return a == b ? 0xFF : 0x00; }
+    static V ne(V a, V b) { return a != b ? 0xFF : 0x00; }
+    static V and_(V a, V b) { return a & b; }
+    static V or_(V a, V b) { return a | b; }
+    static V add(V a, V b) { return a + b; }
+    static V lt(V a, V b) { return a < b ? 0xFF : 0x00; }
+    static V select(V mask, V a, V b) { return (mask & a) | (~mask & b); }
+
+    static void store2(uint8_t* dst, V a, V b) { dst[0] = a; dst[1] = b; }
+    static void store3(uint8_t* dst, V a, V b, V c) { dst[0] = a; dst[1] = b; dst[2] = c; }
+};
+
+#if defined(__ARM_NEON)
+
+struct VectorOps
+{
+    using V = uint8x16_t;
+    static constexpr int32_t WIDTH = 16;
+
+    static V load(const uint8_t* p) { return vld1q_u8(p); }
+    static V set1(uint8_t v) { return vdupq_n_u8(v); }
+    static V eq(V a, V b) { return vceqq_u8(a, b); }
+    static V ne(V a, V b) { return vmvnq_u8(vceqq_u8(a, b)); }
+    static V and_(V a, V b) { return vandq_u8(a, b); }
+    static V or_(V a, V b) { return vorrq_u8(a, b); }
+    static V add(V a, V b) { return vaddq_u8(a, b); }
+    static V lt(V a, V b) { return vcltq_u8(a, b); }
+    static V select(V mask, V a, V b) { return vbslq_u8(mask, a, b); }
+
+    // the structured stores interleave the outputs of a row
+    static void store2(uint8_t* dst, V a, V b) { vst2q_u8(dst, uint8x16x2_t{{a, b}}); }
+    static void store3(uint8_t* dst, V a, V b, V c) { vst3q_u8(dst, uint8x16x3_t{{a, b, c}}); }
+};
+
+#elif defined(__SSE2__)
+
+struct VectorOps
+{
+    using V = __m128i;
+    static constexpr int32_t WIDTH = 16;
+
+    static V load(const uint8_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    static V set1(uint8_t v) { return _mm_set1_epi8(static_cast<char>(v)); }
+    static V eq(V a, V b) { return _mm_cmpeq_epi8(a, b); }
+    static V ne(V a, V b) { return _mm_xor_si128(_mm_cmpeq_epi8(a, b), _mm_set1_epi8(-1)); }
+    static V and_(V a, V b) { return _mm_and_si128(a, b); }
+    static V or_(V a, V b) { return _mm_or_si128(a, b); }
+    static V add(V a, V b) { return _mm_add_epi8(a, b); }
+    static V lt(V a, V b) { return _mm_cmplt_epi8(a, b); } // signed, the kernels only compare small sums
+    static V select(V mask, V a, V b) { return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); }
+
+    static void store2(uint8_t* dst, V a, V b)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi8(a, b));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_unpackhi_epi8(a, b));
+    }
+
+    static void store3(uint8_t* dst, V a, V b, V c)
+    {
+        // SSE2 has no byte shuffle to interleave three registers, go through memory
+        alignas(16) uint8_t lanes[3][WIDTH];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes[0]), a);
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes[1]), b);
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes[2]), c);
+
+        for (int32_t i = 0;i < WIDTH;++i)
+        {
+            dst[i * 3 + 0] = lanes[0][i];
+            dst[i * 3 + 1] = lanes[1][i];
+            dst[i * 3 + 2] = lanes[2][i];
+        }
+    }
+};
+
+#else
+
+using VectorOps = ScalarOps; // no vector unit available
+
+#endif
+
+// rows and columns of edge pixels replicated around the source, so the kernels never check
+// for the edges. xBR looks two pixels out.
+constexpr int32_t BORDER = 2;
+
+template<typename Ops>
+void nearest_row(const uint8_t* src, int32_t width, int32_t factor, uint8_t* dst)
+{
+    using V = typename Ops::V;
+
+    if (factor == 3)
+    {
+        for (int32_t x = 0;x < width;x += Ops::WIDTH)
+        {
+            const V e = Ops::load(src + x);
+            Ops::store3(dst + x * 3, e, e, e);
+        }
+        return;
+    }
+
+    // 2x, and 4x as 2x twice
+    for (int32_t x = 0;x < width;x += Ops::WIDTH)
+    {
+        const V e = Ops::load(src + x);
+        Ops::store2(dst + x * 2, e, e);
+    }
+
+    if (factor == 4)
+    {
+        uint8_t doubled[1024];
+        assert(width * 2 <= static_cast<int32_t>(sizeof(doubled)));
+        std::memcpy(doubled, dst, width * 2);
+
+        nearest_row<Ops>(doubled, width * 2, 2, dst);
+    }
+}
+
+template<typename Ops>
+void scale2x_row(const uint8_t* e_row, int32_t stride, int32_t width, uint8_t* dst0, uint8_t* dst1)
+{
+    using V = typename Ops::V;
+
+    //  B       E0 E1
+    // D E F    E2 E3
+    //  H
+    for (int32_t x = 0;x < width;x += Ops::WIDTH)
+    {
+        const uint8_t* p = e_row + x;
+
+        const V b = Ops::load(p - stride);
+        const V d = Ops::load(p - 1);
+        const V e = Ops::load(p);
+        const V f = Ops::load(p + 1);
+        const V h = Ops::load(p + stride);
+
+        const V edge = Ops::and_(Ops::ne(b, h), Ops::ne(d, f));
+
+        const V e0 = Ops::select(Ops::and_(edge, Ops::eq(d, b)), d, e);
+        const V e1 = Ops::select(Ops::and_(edge, Ops::eq(b, f)), f, e);
+        const V e2 = Ops::select(Ops::and_(edge, Ops::eq(d, h)), d, e);
+        const V e3 = Ops::select(Ops::and_(edge, Ops::eq(h, f)), f, e);
+
+        Ops::store2(dst0 + x * 2, e0, e1);
+        Ops::store2(dst1 + x * 2, e2, e3);
+    }
+}
+
+template<typename Ops>
+void scale3x_row(const uint8_t* e_row, int32_t stride, int32_t width,
+                 uint8_t* dst0, uint8_t* dst1, uint8_t* dst2)
+{
+    using V = typename Ops::V;
+
+    // A B C    E0 E1 E2
+    // D E F    E3 E4 E5
+    // G H I    E6 E7 E8
+    for (int32_t x = 0;x < width;x += Ops::WIDTH)
+    {
+        const uint8_t* p = e_row + x;
+
+        const V a = Ops::load(p - stride - 1);
+        const V b = Ops::load(p - stride);
+        const V c = Ops::load(p - stride + 1);
+        const V d = Ops::load(p - 1);
+        const V e = Ops::load(p);
+        const V f = Ops::load(p + 1);
+        const V g = Ops::load(p + stride - 1);
+        const V h = Ops::load(p + stride);
+        const V i = Ops::load(p + stride + 1);
+
+        const V edge = Ops::and_(Ops::ne(b, h), Ops::ne(d, f));
+
+        const V db = Ops::and_(edge, Ops::eq(d, b));
+        const V bf = Ops::and_(edge, Ops::eq(b, f));
+        const V dh = Ops::and_(edge, Ops::eq(d, h));
+        const V hf = Ops::and_(edge, Ops::eq(h, f));
+
+        const V e0 = Ops::select(db, d, e);
+        const V e1 = Ops::select(Ops::or_(Ops::and_(db, Ops::ne(e, c)), Ops::and_(bf, Ops::ne(e, a))), b, e);
+        const V e2 = Ops::select(bf, f, e);
+        const V e3 = Ops::select(Ops::or_(Ops::and_(db, Ops::ne(e, g)), Ops::and_(dh, Ops::ne(e, a))), d, e);
+        const V e5 = Ops::select(Ops::or_(Ops::and_(bf, Ops::ne(e, i)), Ops::and_(hf, Ops::ne(e, c))), f, e);
+        const V e6 = Ops::select(dh, d, e);
+        const V e7 = Ops::select(Ops::or_(Ops::and_(dh, Ops::ne(e, i)), Ops::and_(hf, Ops::ne(e, g))), h, e);
+        const V e8 = Ops::select(hf, f, e);
+
+        Ops::store3(dst0 + x * 3, e0, e1, e2);
+        Ops::store3(dst1 + x * 3, e3, e, e5);
+        Ops::store3(dst2 + x * 3, e6, e7, e8);
+    }
+}
+
+// One output corner of xBR level 1. u steps toward the corner vertically and v horizontally,
+// for the bottom right corner u is down and v is right:
+//
+//        B
+//     D  E  F  F4
+//     G  H  I  I4
+//        H5 I5
+//
+// (C, the pixel above F, completes the other diagonal.) The corner takes the color of F or H
+// when the edge weights show an edge along the H-F diagonal. Distances are 0 for the same
+// palette index and 1 otherwise, and the corner picks the nearer neighbor instead of blending,
+// so the output stays indexed.
+template<typename Ops>
+typename Ops::V xbr_corner(const uint8_t* p, int32_t u, int32_t v)
+{
+    using V = typename Ops::V;
+
+    const V e = Ops::load(p);
+    const V b = Ops::load(p - u);
+    const V c = Ops::load(p - u + v);
+    const V d = Ops::load(p - v);
+    const V f = Ops::load(p + v);
+    const V g = Ops::load(p + u - v);
+    const V h = Ops::load(p + u);
+    const V i = Ops::load(p + u + v);
+    const V f4 = Ops::load(p + 2 * v);
+    const V h5 = Ops::load(p + 2 * u);
+    const V i4 = Ops::load(p + u + 2 * v);
+    const V i5 = Ops::load(p + 2 * u + v);
+
+    const V one = Ops::set1(1);
+    const V four = Ops::set1(4);
+    auto distance = [one](V x, V y) { return Ops::and_(Ops::ne(x, y), one); };
+
+    const V edge_weight = Ops::add(Ops::add(distance(e, c), distance(e, g)),
+                                   Ops::add(Ops::add(distance(i, f4), distance(i, h5)),
+                                            Ops::and_(Ops::ne(h, f), four)));
+    const V cross_weight = Ops::add(Ops::add(distance(h, d), distance(h, i5)),
+                                    Ops::add(Ops::add(distance(f, i4), distance(f, b)),
+                                             Ops::and_(Ops::ne(e, i), four)));
+
+    // F unless F is further from E than H is
+    const V nearer = Ops::select(Ops::and_(Ops::ne(e, f), Ops::eq(e, h)), h, f);
+
+    return Ops::select(Ops::lt(edge_weight, cross_weight), nearer, e);
+}
+
+template<typename Ops>
+void xbr_lite_row(const uint8_t* e_row, int32_t stride, int32_t width, uint8_t* dst0, uint8_t* dst1)
+{
+    for (int32_t x = 0;x < width;x += Ops::WIDTH)
+    {
+        const uint8_t* p = e_row + x;
+
+        Ops::store2(dst0 + x * 2, xbr_corner<Ops>(p, -stride, -1), xbr_corner<Ops>(p, -stride, 1));
+        Ops::store2(dst1 + x * 2, xbr_corner<Ops>(p, stride, -1), xbr_corner<Ops>(p, stride, 1));
+    }
+}
+
+// Copy of the source with the edge pixels replicated BORDER times on every side
+const uint8_t* pad_source(const uint8_t* src, int32_t src_stride, int32_t width, int32_t height,
+                          int32_t& padded_stride)
+{
+    thread_local std::vector<uint8_t> padded;
+
+    padded_stride = width + BORDER * 2;
+    padded.resize(padded_stride * (height + BORDER * 2));
+
+    for (int32_t y = 0;y < height + BORDER * 2;++y)
+    {
+        const uint8_t* row = src + std::clamp(y - BORDER, 0, height - 1) * src_stride;
+        uint8_t* padded_row = padded.data() + y * padded_stride;
+
+        std::memset(padded_row, row[0], BORDER);
+        std::memcpy(padded_row + BORDER, row, width);
+        std::memset(padded_row + BORDER + width, row[width - 1], BORDER);
+    }
+    return padded.data() + BORDER * padded_stride + BORDER;
+}
+
+template<typename Ops>
+void scale(Scaler scaler, const uint8_t* src, int32_t src_stride, int32_t width, int32_t height,
+           uint8_t* dst, int32_t dst_stride)
+{
+    assert(width % 16 == 0);
+
+    const int32_t factor = scale_factor(scaler);
+
+    if (scaler == Scaler::None || scaler == Scaler::Nearest2x || scaler == Scaler::Nearest3x ||
+        scaler == Scaler::Nearest4x)
+    {
+        for (int32_t y = 0;y < height;++y)
+        {
+            uint8_t* dst_row = dst + y * factor * dst_stride;
+
+            if (factor == 1)
+            {
+                std::memcpy(dst_row, src + y * src_stride, width);
+                continue;
+            }
+            nearest_row<Ops>(src + y * src_stride, width, factor, dst_row);
+
+            for (int32_t r = 1;r < factor;++r)
+            {
+                std::memcpy(dst_row + r * dst_stride, dst_row, width * factor);
+            }
+        }
+        return;
+    }
+
+    int32_t stride = 0;
+    const uint8_t* padded = pad_source(src, src_stride, width, height, stride);
+
+    for (int32_t y = 0;y < height;++y)
+    {
+        const uint8_t* e_row = padded + y * stride;
+        uint8_t* dst_row = dst + y * factor * dst_stride;
+
+        switch (scaler)
+        {
+            case Scaler::Scale2x:
+                scale2x_row<Ops>(e_row, stride, width, dst_row, dst_row + dst_stride);
+                break;
+
+            case Scaler::Scale3x:
+                scale3x_row<Ops>(e_row, stride, width, dst_row, dst_row + dst_stride, dst_row + 2 * dst_stride);
+                break;
+
+            case Scaler::XBRLite2x:
+                xbr_lite_row<Ops>(e_row, stride, width, dst_row, dst_row + dst_stride);
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+} // namespace
+
+int32_t scale_factor(Scaler scaler)
+{
+    switch (scaler)
+    {
+        case Scaler::None:
+            return 1;
+        case Scaler::Nearest2x:
+        case Scaler::Scale2x:
+        case Scaler::XBRLite2x:
+            return 2;
+        case Scaler::Nearest3x:
+        case Scaler::Scale3x:
+            return 3;
+        case Scaler::Nearest4x:
+            return 4;
+    }
+    return 1;
+}
+
+std::string_view scaler_name(Scaler scaler)
+{
+    return magic_enum::enum_name(scaler);
+}
+
+std::optional<Scaler> scaler_from_name(std::string_view name)
+{
+    return magic_enum::enum_cast<Scaler>(name, magic_enum::case_insensitive);
+}
+
+void scale_indexed(Scaler scaler, const uint8_t* src, int32_t src_stride, int32_t width, int32_t height,
+                   uint8_t* dst, int32_t dst_stride)
+{
+    scale<VectorOps>(scaler, src, src_stride, width, height, dst, dst_stride);
+}
+
+void scale_indexed_scalar(Scaler scaler, const uint8_t* src, int32_t src_stride, int32_t width,
+                          int32_t height, uint8_t* dst, int32_t dst_stride)
+{
+    scale<ScalarOps>(scaler, src, src_stride, width, height, dst, dst_stride);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+// Pixel art upscalers for the consumers of the frames (the view, snapshots, the agent). They run
+// on the indexed frame, before the palette conversion, so a pixel is one byte and the edge rules
+// compare palette indices directly. Each kernel is written once against a small set of vector
+// operations with SSE2, NEON and scalar versions, and processes 16 pixels per step where a
+// vector unit is available.
+
+enum class Scaler
+{
+    None,
+    Nearest2x,
+    Nearest3x,
+    Nearest4x,
+    Scale2x,   // EPX / AdvMAME2x
+    Scale3x,   // AdvMAME3x
+    XBRLite2x, // xBR level 1 edge detection, choosing between neighbors instead of blending
+};
+
+int32_t scale_factor(Scaler scaler);
+
+std::string_view scaler_name(Scaler scaler);
+std::optional<Scaler> scaler_from_name(std::string_view name);
+
+// Scale width x height indexed pixels from src into dst, which holds (width * factor) x
+// (height * factor) pixels. Strides are in bytes. width has to be a multiple of 16.
+void scale_indexed(Scaler scaler, const uint8_t* src, int32_t src_stride, int32_t width, int32_t height,
+                   uint8_t* dst, int32_t dst_stride);
+
+// The same without the vector unit, for checking the vector kernels against
+void scale_indexed_scalar(Scaler scaler, const uint8_t* src, int32_t src_stride, int32_t width,
+                          int32_t height, uint8_t* dst, int32_t dst_stride);
@@ -123,7 +123,8 @@ public:
         int32_t usec_per_period = 1000000 / (frequency_ * 2);
         samples_per_period_ = format_.bytesForDuration(usec_per_period) / format_.bytesPerSample();
 
-        samples_per_triangle_step_ = samples_per_period_ / MAX_TRIANGLE_STEPS;
+        // at least 1, periods shorter than the steps (the 440Hz default) would divide by zero
+        samples_per_triangle_step_ = std::max(samples_per_period_ / MAX_TRIANGLE_STEPS, 1);
     }
 
     int16_t frequency() override { return frequency_; }
@@ -157,7 +158,8 @@ private:
         int32_t usec_per_period = 1000000 / (frequency_ * 2);
         samples_per_period_ = format_.bytesForDuration(usec_per_period) / format_.bytesPerSample();
 
-        samples_per_triangle_step_ = samples_per_period_ / MAX_TRIANGLE_STEPS;
+        // at least 1, periods shorter than the steps (the 440Hz default) would divide by zero
+        samples_per_triangle_step_ = std::max(samples_per_period_ / MAX_TRIANGLE_STEPS, 1);
     }
 
     QAudioFormat format_;
@@ -172,7 +174,7 @@ private:
     int32_t pending_update_{0};
 };
 
-Generator::Generator(const QAudioFormat &format)
+Generator::Generator(const QAudioFormat &format, bool producer_thread)
  : sema_(0)
  , output_buffer_(1024*32)
  , shutdown_(false)
@@ -196,7 +198,10 @@ Generator::Generator(const QAudioFormat &format)
     streams_[to_index(Audio::Channel::Square_Pulse_2)].set_waveform(std::make_shared<SquareWave>(format, 440, 0.5));
     streams_[to_index(Audio::Channel::Triangle)].set_waveform(std::make_shared<TriangleWave>(format, 440));
 
-    producer_ = std::make_shared<std::thread>(&Generator::producer_loop, this);
+    if (producer_thread)
+    {
+        producer_ = std::make_shared<std::thread>(&Generator::producer_loop, this);
+    }
 }
 
 void Generator::start()
@@ -209,7 +214,10 @@ void Generator::stop()
     shutdown_ = true;
     close();
 
-    producer_->join();
+    if (producer_ && producer_->joinable())
+    {
+        producer_->join();
+    }
 }
 
 void Generator::producer_loop()
@@ -233,65 +241,87 @@ void Generator::producer_loop()
                 events_.pop();
             }
 
-            switch (event.first)
+            handle_event(event);
+        }
+    }
+}
+
+void Generator::process_events()
+{
+    while (true)
+    {
+        EventChannel event;
+        {
+            std::scoped_lock lock(queues_lock_);
+
+            if (events_.empty())
             {
-                case Event::Step:
-                {
-                    produce_samples();
-                }
-                break;
+                return;
+            }
 
-                case Event::Parameter_Update:
-                case Event::Parameter_Update_Reset_Phase:
-                {
-                    std::scoped_lock lock(streams_lock_);
-
-                    Audio::Parameters params = param_updates_.front();
-                    param_updates_.pop();
-
-                    QAudioDevice device = QMediaDevices::defaultAudioOutput();
-                    QAudioFormat format = device.preferredFormat();
-
-                    if (params.channel == Audio::Channel::Square_Pulse_1 ||
-                        params.channel == Audio::Channel::Square_Pulse_2)
-                    {
-                        streams_[to_index(params.channel)].reload(params, event.first == Event::Parameter_Update_Reset_Phase);
-                    }
-                    else if (params.channel == Audio::Channel::Triangle)
-                    {
-                        streams_[to_index(params.channel)].reload(params, false);
-                    }
-                    break;
-                }
+            event = events_.front();
+            events_.pop();
+        }
+        handle_event(event);
+    }
+}
 
-                case Event::Decrement_Counter:
-                {
-                    std::scoped_lock lock(streams_lock_);
-                    streams_[to_index(event.second)].decrement_counter();
-                    break;
-                }
+void Generator::handle_event(const EventChannel& event)
+{
+    switch (event.first)
+    {
+        case Event::Step:
+        {
+            produce_samples();
+        }
+        break;
 
-                case Event::Decrement_Linear_Counter:
-                {
-                    std::scoped_lock lock(streams_lock_);
-                    streams_[to_index(event.second)].decrement_linear_counter();
-                    break;
-                }
+        case Event::Parameter_Update:
+        case Event::Parameter_Update_Reset_Phase:
+        {
+            std::scoped_lock lock(streams_lock_);
 
-                case Event::Decrement_Volume:
-                {
-                    std::scoped_lock lock(streams_lock_);
-                    streams_[to_index(event.second)].decrement_volume_envelope();
-                    break;
-                }
+            Audio::Parameters params = param_updates_.front();
+            param_updates_.pop();
 
-                case Event::Step_Sweep:
-                {
-                    std::scoped_lock lock(streams_lock_);
-                    streams_[to_index(event.second)].step_sweep();
-                    break;
-                }
+            if (params.channel == Audio::Channel::Square_Pulse_1 ||
+                params.channel == Audio::Channel::Square_Pulse_2)
+            {
+                streams_[to_index(params.channel)].reload(params, event.first == Event::Parameter_Update_Reset_Phase);
+            }
+            else if (params.channel == Audio::Channel::Triangle)
+            {
+                streams_[to_index(params.channel)].reload(params, false);
             }
+            break;
+        }
+
+        case Event::Decrement_Counter:
+        {
+            std::scoped_lock lock(streams_lock_);
+            streams_[to_index(event.second)].decrement_counter();
+            break;
+        }
+
+        case Event::Decrement_Linear_Counter:
+        {
+            std::scoped_lock lock(streams_lock_);
+            streams_[to_index(event.second)].decrement_linear_counter();
+            break;
+        }
+
+        case Event::Decrement_Volume:
+        {
+            std::scoped_lock lock(streams_lock_);
+            streams_[to_index(event.second)].decrement_volume_envelope();
+            break;
+        }
+
+        case Event::Step_Sweep:
+        {
+            std::scoped_lock lock(streams_lock_);
+            streams_[to_index(event.second)].step_sweep();
+            break;
         }
     }
 }
@@ -346,7 +376,7 @@ void Generator::step()
         std::scoped_lock lock(queues_lock_);
         events_.push(std::make_pair(Event::Step, Audio::Channel::Square_Pulse_1));
     }
-    sema_.release();
+    notify_producer();
 }
 
 qint64 Generator::readData(char *data, qint64 max_len)
@@ -369,6 +399,24 @@ qint64 Generator::readData(char *data, qint64 max_len)
     return total;
 }
 
+void Generator::read_samples(std::vector<int16_t>& samples)
+{
+    std::scoped_lock lock(output_lock_);
+
+    while (!output_buffer_.is_empty())
+    {
+        samples.push_back(static_cast<int16_t>(output_buffer_.pop()));
+    }
+}
+
+void Generator::notify_producer()
+{
+    if (producer_)
+    {
+        sema_.release();
+    }
+}
+
 qint64 Generator::bytesAvailable() const
 {
     return size() + QIODevice::bytesAvailable();
@@ -379,7 +427,7 @@ void Generator::decrement_counter(Audio::Channel channel)
     std::scoped_lock lock(queues_lock_);
     events_.push(std::make_pair(Event::Decrement_Counter, channel));
 
-    sema_.release();
+    notify_producer();
 }
 
 void Generator::decrement_linear_counter()
@@ -387,7 +435,7 @@ void Generator::decrement_linear_counter()
     std::scoped_lock lock(queues_lock_);
     events_.push(std::make_pair(Event::Decrement_Linear_Counter, Audio::Channel::Triangle));
 
-    sema_.release();
+    notify_producer();
 }
 
 void Generator::decrement_volume_envelope(Audio::Channel channel)
@@ -395,7 +443,7 @@ void Generator::decrement_volume_envelope(Audio::Channel channel)
     std::scoped_lock lock(queues_lock_);
     events_.push(std::make_pair(Event::Decrement_Volume, channel));
 
-    sema_.release();
+    notify_producer();
 }
 
 void Generator::step_sweep(Audio::Channel channel)
@@ -403,7 +451,7 @@ void Generator::step_sweep(Audio::Channel channel)
     std::scoped_lock lock(queues_lock_);
     events_.push(std::make_pair(Event::Step_Sweep, channel));
 
-    sema_.release();
+    notify_producer();
 }
 
 void Generator::update_parameters(Audio::Channel channel, Audio::Parameters params, bool reset_phase)
@@ -420,7 +468,7 @@ void Generator::update_parameters(Audio::Channel channel, Audio::Parameters para
     }
     param_updates_.push(params);
 
-    sema_.release();
+    notify_producer();
 }
 
 AudioStream::AudioStream(Audio::Channel channel)
@@ -94,7 +94,8 @@ public:
     };
     using EventChannel = std::pair<Event, Audio::Channel>;
 
-    Generator(const QAudioFormat &format);
+    // Without the producer thread the owner mixes on its own thread with process_events()
+    Generator(const QAudioFormat &format, bool producer_thread = true);
 
     // open and close the QT audio output device
     void start();
@@ -106,6 +107,12 @@ public:
     // producer loop runs on a separate thread and handles the events_ queue
     void producer_loop();
 
+    // Handles every queued event on the calling thread, for generators without a producer thread
+    void process_events();
+
+    // Moves the mixed samples to the end of samples, for generators that aren't read by a sink
+    void read_samples(std::vector<int16_t>& samples);
+
     // retrieves samples from each stream, mixes them, and pushes them to the output buffer
     void produce_samples();
 
@@ -143,6 +150,11 @@ public:
 private:
     inline int32_t to_index(Audio::Channel channel) { return magic_enum::enum_integer<Audio::Channel>(channel); }
 
+    void handle_event(const EventChannel& event);
+
+    // wake the producer thread for a queued event, when there is one
+    void notify_producer();
+
     // For synchronization of stream buffer reading & changes
     std::mutex streams_lock_;
     std::vector<AudioStream> streams_;
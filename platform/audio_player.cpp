@@ -7,16 +7,31 @@
 #include <QAudioDevice>
 #include <QMediaDevices>
 
-AudioPlayer::AudioPlayer()
+AudioPlayer::AudioPlayer(Output output)
+ : output_(output)
 {
-    QAudioDevice device = QMediaDevices::defaultAudioOutput();
-    QAudioFormat format = device.preferredFormat();
+    if (output_ == Output::Device)
+    {
+        QAudioDevice device = QMediaDevices::defaultAudioOutput();
+        QAudioFormat format = device.preferredFormat();
 
-    format.setChannelCount(1);
-    format.setSampleFormat(QAudioFormat::Int16);
+        format.setChannelCount(1);
+        format.setSampleFormat(QAudioFormat::Int16);
 
-    generator_ = std::make_shared<Generator>(format);   
-    audio_sink_ = std::make_shared<QAudioSink>(device, format);
+        generator_ = std::make_shared<Generator>(format);
+        audio_sink_ = std::make_shared<QAudioSink>(device, format);
+        sample_rate_ = format.sampleRate();
+    }
+    else
+    {
+        QAudioFormat format;
+        format.setSampleRate(BUFFER_SAMPLE_RATE);
+        format.setChannelCount(1);
+        format.setSampleFormat(QAudioFormat::Int16);
+
+        generator_ = std::make_shared<Generator>(format, false);
+        sample_rate_ = BUFFER_SAMPLE_RATE;
+    }
 
     if constexpr (ENABLE_APU_PARAMETERS_LOGGING)
     {
@@ -95,6 +110,10 @@ void AudioPlayer::step_sweep(Audio::Channel channel)
 void AudioPlayer::start()
 {
     // Needs to be called from the QT UI thread
+    if (!audio_sink_)
+    {
+        return;
+    }
 
     generator_->start();
     audio_sink_->setVolume(.5);
@@ -104,7 +123,10 @@ void AudioPlayer::start()
 void AudioPlayer::stop()
 {
     generator_->stop();
-    audio_sink_->stop();
+    if (audio_sink_)
+    {
+        audio_sink_->stop();
+    }
 }
 
 void AudioPlayer::reset()
@@ -120,10 +142,25 @@ void AudioPlayer::step()
 {
     audio_player_cycles_++;
     generator_->step();
+
+    if (output_ == Output::Buffer)
+    {
+        generator_->process_events();
+    }
+}
+
+void AudioPlayer::read_samples(std::vector<int16_t>& samples)
+{
+    generator_->read_samples(samples);
 }
 
 void AudioPlayer::test()
 {
+    if (!audio_sink_)
+    {
+        return;
+    }
+
     generator_->start();
     generator_->set_enabled(Audio::Channel::Square_Pulse_1, true);
 
@@ -13,7 +13,15 @@
 class AudioPlayer
 {
 public:
-    AudioPlayer();
+    enum class Output
+    {
+        Device, // the default audio output, in real time
+        Buffer, // mixed on the APU's thread as it steps, for read_samples(). Headless rendering.
+    };
+
+    static constexpr int32_t BUFFER_SAMPLE_RATE = 48000;
+
+    AudioPlayer(Output output = Output::Device);
     ~AudioPlayer();
 
     // Needs to be called from the QT UI thread. Easiest to call once at startup and let run.
@@ -33,12 +41,19 @@ public:
 
     void step_sweep(Audio::Channel channel);
 
+    // Output::Buffer only, moves the samples mixed so far to the end of samples
+    void read_samples(std::vector<int16_t>& samples);
+    int32_t sample_rate() const { return sample_rate_; }
+
     void test();
 
 private:
     std::shared_ptr<Generator> generator_;
     std::shared_ptr<QAudioSink> audio_sink_;
 
+    Output output_;
+    int32_t sample_rate_{0};
+
     uint64_t audio_player_cycles_{0};
 
     std::ofstream log_;
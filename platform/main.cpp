@@ -7,6 +7,7 @@
 #include "system/callbacks.hpp"
 #include "system/nes.hpp"
 
+#include <QActionGroup>
 #include <QApplication>
 #include <QBoxLayout>
 #include <QKeySequence>
@@ -180,6 +181,24 @@ void create_menus()
     debug_menu->addAction(snapshots_action);
     debug_menu->addAction(tests_action);
 
+    // Frame skip submenu, render 1 of N frames
+    QMenu *frame_skip_menu = debug_menu->addMenu("Frame Skip");
+    QActionGroup *frame_skip_group = new QActionGroup(frame_skip_menu);
+
+    for (int32_t frame_skip : {1, 2, 3, 4, 8})
+    {
+        QAction *frame_skip_action = new QAction(frame_skip == 1 ? QString("Off") :
+                                                 QString("Render 1 of %1").arg(frame_skip), ui.menu_bar);
+        frame_skip_action->setCheckable(true);
+        frame_skip_action->setChecked(frame_skip == 1);
+
+        frame_skip_group->addAction(frame_skip_action);
+        frame_skip_menu->addAction(frame_skip_action);
+
+        QObject::connect(frame_skip_action, &QAction::triggered, &ui.menu_handler,
+                         [frame_skip]() { UIContext::instance().menu_handler.frame_skip(frame_skip); });
+    }
+
     QObject::connect(run_action,  &QAction::triggered, &ui.menu_handler, &MenuHandler::run);
     QObject::connect(step_action,  &QAction::triggered, &ui.menu_handler, &MenuHandler::step);
     QObject::connect(stop_action,  &QAction::triggered, &ui.menu_handler, &MenuHandler::stop);
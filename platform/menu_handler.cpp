@@ -3,12 +3,14 @@
 #include "config/constants.hpp"
 #include "io/cartridge.hpp"
 #include "io/prompt.hpp"
+#include "io/rom_library.hpp"
 #include "platform/ui_context.hpp"
 #include "test/6502_tests.hpp"
 
 #include <QDebug>
 #include <QFileDialog>
 #include <QInputDialog>
+#include <QMessageBox>
 
 #include <string>
 
@@ -25,12 +27,29 @@ void MenuHandler::start_nes(std::filesystem::path path)
 
     cartridge = Cartridge::create(path);
 
-    if (!UIContext::instance().nes->load_cartridge(std::move(cartridge)))
+    if (!UIContext::instance().nes->load_cartridge(cartridge))
     {
         // failed to load cartridge
         return;
     }
 
+    if (cartridge->battery_ram_unsaved())
+    {
+        QMessageBox::warning(
+            nullptr,
+            "Save file in use",
+            "Another instance of this game is using its save file, progress won't be saved."
+        );
+    }
+
+    if (std::shared_ptr<RomLibrary> library = RomLibrary::open(ROM_LIBRARY_CATALOG_PATH))
+    {
+        if (std::optional<size_t> index = library->index_of(path.string()))
+        {
+            library->mark_played(*index);
+        }
+    }
+
     vm_thread_ = new std::thread([this]{ CommandPrompt::instance().launch_prompt(*UIContext::instance().nes); });
 }
 
@@ -40,7 +59,7 @@ void MenuHandler::load_rom()
         nullptr,
         tr("Select a Nes ROM"),
         QDir::homePath(),
-        tr("Nes ROMs (*.nes)")
+        tr("Nes ROMs (*.nes *.gz *.zip)")
     );
 
     if (!fileName.isEmpty())
@@ -125,6 +144,11 @@ void MenuHandler::snapshots()
                                                            std::chrono::milliseconds(0));
 }
 
+void MenuHandler::frame_skip(int32_t frame_skip)
+{
+    UIContext::instance().nes->set_frame_skip(frame_skip);
+}
+
 void MenuHandler::run_processor_tests()
 {
     Test6502 test_6502;
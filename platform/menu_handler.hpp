@@ -22,6 +22,7 @@ public slots:
     void goto_memory();
     void command();
     void snapshots();
+    void frame_skip(int32_t frame_skip);
     void run_processor_tests();
 
     void close();
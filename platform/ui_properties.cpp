@@ -82,7 +82,7 @@ void update_ui_memory_view(const AddressBus& m)
                            QString::fromStdString(std::string(UI_LIGHT_BLACK)));
 }
 
-void update_ui_sprites_view(const std::vector<NesPPU::Sprite>& sprite_data)
+void update_ui_sprites_view(const std::function<std::vector<NesPPU::Sprite>()>& make_sprite_data)
 {
     static auto last_update_time = std::chrono::high_resolution_clock::now();
     auto current_time = std::chrono::high_resolution_clock::now();
@@ -93,7 +93,7 @@ void update_ui_sprites_view(const std::vector<NesPPU::Sprite>& sprite_data)
         last_update_time = std::chrono::high_resolution_clock::now();
 
         UIContext& ui = UIContext::instance();
-        ui.sprites_model.update(sprite_data);
+        ui.sprites_model.update(make_sprite_data());
     }
 }
 
@@ -49,7 +49,9 @@ void update_ui(UI property, std::optional<std::string_view> str,
 void update_ui_opacity(UI property, double opacity);
 
 void update_ui_memory_view(const AddressBus& memory);
-void update_ui_sprites_view(const std::vector<NesPPU::Sprite>& sprite_data);
+// Updates the sprites window at most once per second. The sprite data is only generated when
+// an update is due.
+void update_ui_sprites_view(const std::function<std::vector<NesPPU::Sprite>()>& make_sprite_data);
 
 // init_joypad_input initializes gainput classes that setup callbacks for
 // os input callbacks (on macos). It must be called from the main thread in
@@ -2,15 +2,45 @@
 
 #include "processor/processor_6502.hpp"
 
+#include <algorithm>
 
-const uint8_t AddressBus::read(int32_t a, AccessType access) const
+void AddressBus::attach_cpu(std::shared_ptr<Processor6502> cpu)
 {
-    assert(a >= 0 && a < ADDRESSABLE_MEMORY_SIZE);
+    cpu_ = cpu;
 
+    // 2KB of internal memory mirrored up to 0x1FFF. Test6502 runs with all 64KB as memory.
+    const int32_t size = cpu_->internal_memory_size();
+    std::span<uint8_t> memory(cpu_->internal_memory_.data(), size);
+
+    for (int32_t address = 0;address < std::max(size, 0x2000);address += size)
+    {
+        page_table_.map(address, memory, true);
+    }
+}
+
+void AddressBus::attach_cartridge(std::shared_ptr<Cartridge> cartridge)
+{
+    if (cartridge_)
+    {
+        page_table_.unmap(0x4100, ADDRESSABLE_MEMORY_SIZE - 0x4100);
+        page_table_.clear_patches(); // cheats are for the game they were entered for
+    }
+
+    // the cartridge maps its prg banks and prg ram on reset and bank switches
+    cartridge_ = cartridge;
+    cartridge_->attach_cpu_page_table(page_table_);
+}
+
+const uint8_t AddressBus::read_register(int32_t a, AccessType access) const
+{
     if (a < cpu_->internal_memory_size()) // CPU memory
     {
         return cpu_->read(a % cpu_->internal_memory_size()); // mirrored after 0x07FF up to 0x1FFF
     }
+    else if (!ppu_ && (a <= 0x3FFF || a == 0x4014 || a == 0x4016 || a == 0x4017))
+    {
+        return 0; // NsfPlayer runs without the PPU and joypads
+    }
     else if (a <= 0x3FFF) // PPU registers, mirrored after 0x2000 - 0x2007
     {
         return access == AccessType::READ ? ppu_->read_register(0x2000 + (a % 8)) :
@@ -45,27 +75,29 @@ const uint8_t AddressBus::read(int32_t a, AccessType access) const
     }
 }
 
-void AddressBus::write(int32_t a, uint8_t value)
+void AddressBus::write_register(int32_t a, uint8_t value)
 {
-    assert(a >= 0 && a < ADDRESSABLE_MEMORY_SIZE);
-
     if (a < cpu_->internal_memory_size()) // CPU memory
     {
         cpu_->write(a % cpu_->internal_memory_size()) = value; // mirrored after 0x07FF up to 0x1FFF
     }
+    else if (!ppu_ && (a <= 0x3FFF || a == 0x4014 || a == 0x4016))
+    {
+        return; // NsfPlayer runs without the PPU and joypads
+    }
     else if (a <= 0x3FFF) // PPU registers, mirrored after 0x2000 - 0x2007
     {
         ppu_->write_register(0x2000 + (a % 8), value);
     }
     else if (a <= 0x4017) // APU, IO registers
     {
-        if (a == 0x4016 || a == 0x4017)
+        if ((a == 0x4016 || a == 0x4017) && joypads_)
         {
             joypads_->write(a) = value;
         }
         else if (a == 0x4014) // OAM DMA
         {
-            ppu_->write_register(a, value);
+            oam_dma(value);
         }
         else
         {
@@ -76,8 +108,30 @@ void AddressBus::write(int32_t a, uint8_t value)
     {
         assert(false);
     }
-    else
+    else if (cartridge_)
     {
         cartridge_->write(a, value);
     }
 }
+
+void AddressBus::oam_dma(uint8_t page)
+{
+    const uint16_t address = page << CPUPageTable::PAGE_SHIFT;
+
+    // Most games copy from a page of RAM, pages of memory are copied directly. Pages with
+    // registers are read one byte at a time, with the side effects the reads have.
+    if (const uint8_t* source = page_table_.read_page(address))
+    {
+        ppu_->oam_dma(std::span<const uint8_t, 256>(source, 256));
+    }
+    else
+    {
+        std::array<uint8_t, 256> data;
+        for (int32_t i = 0;i < 256;++i)
+        {
+            data[i] = read(address + i, AccessType::READ);
+        }
+        ppu_->oam_dma(data);
+    }
+    cpu_->halt_for_oam_dma();
+}
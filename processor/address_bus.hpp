@@ -2,6 +2,7 @@
 
 #include "io/cartridge.hpp"
 #include "io/joypads.hpp"
+#include "processor/cpu_page_table.hpp"
 #include "processor/nes_apu.hpp"
 #include "processor/nes_ppu.hpp"
 
@@ -68,10 +69,29 @@ public:
     {
     }
 
-    const uint8_t read(int32_t a, AccessType access = AccessType::PEEK) const;
+    // Memory is read and written through the page table, registers through the handlers
+    const uint8_t read(int32_t a, AccessType access = AccessType::PEEK) const
+    {
+        assert(a >= 0 && a < ADDRESSABLE_MEMORY_SIZE);
+
+        if (const uint8_t* page = page_table_.read_page(a))
+        {
+            return page[a & CPUPageTable::PAGE_MASK];
+        }
+        return read_register(a, access);
+    }
+
+    void write(int32_t a, uint8_t value)
+    {
+        assert(a >= 0 && a < ADDRESSABLE_MEMORY_SIZE);
 
-    // returns reference to memory to be written
-    void write(int32_t a, uint8_t value);
+        if (uint8_t* page = page_table_.write_page(a))
+        {
+            page[a & CPUPageTable::PAGE_MASK] = value;
+            return;
+        }
+        write_register(a, value);
+    }
 
     const uint8_t operator [] (int32_t i) const
     {
@@ -107,13 +127,24 @@ public:
         return (*this)[0x0100 + sp];
     }
 
-    void attach_cpu(std::shared_ptr<Processor6502> cpu) { cpu_ = cpu; }
-    void attach_cartridge(std::shared_ptr<Cartridge> cartridge) { cartridge_ = cartridge; }
+    // The cpu maps its internal memory and the cartridge its banks into the page table
+    void attach_cpu(std::shared_ptr<Processor6502> cpu);
+    void attach_cartridge(std::shared_ptr<Cartridge> cartridge);
     void attach_joypads(std::shared_ptr<Joypads> joypads) { joypads_ = joypads; }
     void attach_ppu(std::shared_ptr<NesPPU> ppu) { ppu_ = ppu; }
     void attach_apu(std::shared_ptr<NesAPU> apu) { apu_ = apu; }
 
+    CPUPageTable& page_table() { return page_table_; }
+    const CPUPageTable& page_table() const { return page_table_; }
+
 private:
+    // accesses to the pages without memory
+    const uint8_t read_register(int32_t a, AccessType access) const;
+    void write_register(int32_t a, uint8_t value);
+
+    // Copy the page to OAM and halt the CPU for the transfer
+    void oam_dma(uint8_t page);
+
     void check_notifiers(const std::vector<std::pair<uint16_t, AccessNotifier>>& notifiers, const uint16_t access_addr) const
     {
         for (auto& [addr, notifier] : notifiers)
@@ -130,4 +161,6 @@ private:
     std::shared_ptr<Joypads> joypads_;
     std::shared_ptr<NesPPU> ppu_;
     std::shared_ptr<NesAPU> apu_;
+
+    CPUPageTable page_table_;
 };
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+class CPUPageTable
+{
+    // The CPU address space as 256 pages of 256 bytes, each a direct pointer into host memory:
+    // the internal RAM and its mirrors, and the cartridge's PRG-ROM banks and PRG-RAM. The
+    // cartridge reprograms its pages when it switches banks, so a read from memory is a shift,
+    // an index and a load.
+    //
+    // Pages with registers behind them (PPU, APU and IO, mapper registers) have no pointer and
+    // AddressBus handles them. Reads and writes have separate tables, PRG-ROM pages are readable
+    // but writes to them go to the mapper.
+    //
+    // Cheats patch ROM bytes with overlays. A page with a patch in it reads from a copy of the
+    // ROM page it maps, made with the patches applied when the page is mapped. A patch with a
+    // compare value only applies when the ROM has that value, so it follows bank switches like a
+    // Game Genie does. Reads don't change, every page is still a pointer.
+public:
+    static constexpr int32_t PAGE_SHIFT = 8;
+    static constexpr int32_t PAGE_SIZE = 1 << PAGE_SHIFT;
+    static constexpr uint16_t PAGE_MASK = PAGE_SIZE - 1;
+    static constexpr int32_t PAGE_COUNT = 256;
+
+    // value is read at address in place of the ROM, when the ROM has compare there or always
+    // without a compare value
+    struct Patch
+    {
+        uint16_t address{0};
+        uint8_t value{0};
+        std::optional<uint8_t> compare;
+    };
+
+    CPUPageTable()
+    {
+        read_pages_.fill(nullptr);
+        write_pages_.fill(nullptr);
+    }
+
+    // nullptr when the page isn't memory
+    const uint8_t* read_page(uint16_t a) const { return read_pages_[a >> PAGE_SHIFT]; }
+    uint8_t* write_page(uint16_t a) const { return write_pages_[a >> PAGE_SHIFT]; }
+
+    // The mapped memory without patches, what the ROM chip puts on the bus
+    const uint8_t* unpatched_page(uint16_t a) const
+    {
+        const Overlay* overlay = overlays_[a >> PAGE_SHIFT].get();
+        return overlay && overlay->source ? overlay->source : read_page(a);
+    }
+
+    // Map consecutive pages of memory starting at address
+    void map(uint16_t address, std::span<uint8_t> memory, bool writable)
+    {
+        assert(address % PAGE_SIZE == 0 && memory.size() % PAGE_SIZE == 0);
+        assert(address + memory.size() <= PAGE_COUNT * PAGE_SIZE);
+
+        const int32_t first_page = address >> PAGE_SHIFT;
+        const int32_t page_count = static_cast<int32_t>(memory.size() / PAGE_SIZE);
+
+        for (int32_t i = 0;i < page_count;++i)
+        {
+            read_pages_[first_page + i] = memory.data() + i * PAGE_SIZE;
+            write_pages_[first_page + i] = writable ? memory.data() + i * PAGE_SIZE : nullptr;
+
+            if (Overlay* overlay = overlays_[first_page + i].get())
+            {
+                overlay->source = writable ? nullptr : read_pages_[first_page + i];
+                apply_overlay(first_page + i);
+            }
+        }
+    }
+
+    // Back to the AddressBus handlers for size bytes starting at address
+    void unmap(uint16_t address, int32_t size)
+    {
+        assert(address % PAGE_SIZE == 0 && size % PAGE_SIZE == 0);
+
+        const int32_t first_page = address >> PAGE_SHIFT;
+
+        for (int32_t i = 0;i < size / PAGE_SIZE;++i)
+        {
+            read_pages_[first_page + i] = nullptr;
+            write_pages_[first_page + i] = nullptr;
+
+            if (Overlay* overlay = overlays_[first_page + i].get())
+            {
+                overlay->source = nullptr;
+            }
+        }
+    }
+
+    // Patches apply to read only pages, RAM and registers are never patched
+    void add_patch(const Patch& patch)
+    {
+        const int32_t page = patch.address >> PAGE_SHIFT;
+
+        if (!overlays_[page])
+        {
+            overlays_[page] = std::make_unique<Overlay>();
+            overlays_[page]->source = write_pages_[page] ? nullptr : read_pages_[page];
+        }
+        overlays_[page]->patches.push_back(patch);
+        apply_overlay(page);
+    }
+
+    void clear_patches()
+    {
+        for (int32_t page = 0;page < PAGE_COUNT;++page)
+        {
+            if (overlays_[page] && overlays_[page]->source)
+            {
+                read_pages_[page] = overlays_[page]->source;
+            }
+            overlays_[page].reset();
+        }
+    }
+
+    std::vector<Patch> patches() const
+    {
+        std::vector<Patch> result;
+
+        for (const std::unique_ptr<Overlay>& overlay : overlays_)
+        {
+            if (overlay)
+            {
+                result.insert(result.end(), overlay->patches.begin(), overlay->patches.end());
+            }
+        }
+        return result;
+    }
+
+    // True when the patch changes what the CPU reads with the banks mapped now
+    bool patch_applied(const Patch& patch) const
+    {
+        const uint8_t* source = unpatched_page(patch.address);
+        const uint8_t offset = patch.address & PAGE_MASK;
+
+        return source && read_page(patch.address) != source &&
+               (!patch.compare || source[offset] == *patch.compare);
+    }
+
+private:
+    struct Overlay
+    {
+        std::array<uint8_t, PAGE_SIZE> memory{};
+        const uint8_t* source{nullptr}; // the mapped ROM page, nullptr when RAM or unmapped
+        std::vector<Patch> patches;
+    };
+
+    // Copy the ROM page into the overlay with the patches that match, and read from the copy
+    void apply_overlay(int32_t page)
+    {
+        Overlay& overlay = *overlays_[page];
+
+        if (!overlay.source)
+        {
+            return;
+        }
+        std::copy(overlay.source, overlay.source + PAGE_SIZE, overlay.memory.begin());
+
+        for (const Patch& patch : overlay.patches)
+        {
+            const uint8_t offset = patch.address & PAGE_MASK;
+
+            if (!patch.compare || overlay.source[offset] == *patch.compare)
+            {
+                overlay.memory[offset] = patch.value;
+            }
+        }
+        read_pages_[page] = overlay.memory.data();
+    }
+
+    std::array<const uint8_t*, PAGE_COUNT> read_pages_;
+    std::array<uint8_t*, PAGE_COUNT> write_pages_;
+
+    // only the pages with patches in them have an overlay
+    std::array<std::unique_ptr<Overlay>, PAGE_COUNT> overlays_;
+};
@@ -266,12 +266,17 @@ static uint8_t BRK(const Instruction& i, Registers& r, AddressBus& m)
     // push PC+2, push SR
     // N   Z   C   I   D   V
     // -   -   -   1   -   -
-    uint16_t save_pc = i.nmi ? r.PC : r.PC + 1 + 0 /* was already incremented by 1 to get here */;
+    //
+    // NMI and IRQ are BRKs inserted by the processor in place of the next instruction, they
+    // return to that instruction and push the status register with the break flag clear. IRQ
+    // shares the BRK vector.
+    const bool interrupt = i.nmi || i.irq;
+    uint16_t save_pc = interrupt ? r.PC : r.PC + 1 + 0 /* was already incremented by 1 to get here */;
 
     m.stack_push(r.SP, static_cast<uint8_t>((save_pc >> 8) & 0x00FF));
     m.stack_push(r.SP, static_cast<uint8_t>(save_pc & 0x00FF));
 
-    m.stack_push(r.SP, r.SR());
+    m.stack_push(r.SP, interrupt ? static_cast<uint8_t>(r.SR() & ~Registers::BREAK_FLAG) : r.SR());
 
     r.set_status_register_flag(Registers::BREAK_FLAG, true);
     r.set_status_register_flag(Registers::INTERRUPT_DISABLE_FLAG, true);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+class IrqLine
+{
+    // The 6502's /IRQ input. Unlike NMI it is level triggered and shared: any device can hold it
+    // asserted, and the CPU keeps taking the interrupt at instruction boundaries while it is
+    // asserted and the I flag is clear. A device releases it when the game acknowledges the
+    // interrupt through that device's registers.
+public:
+    enum class Source : uint8_t
+    {
+        Mapper = 1 << 0,
+    };
+
+    void set(Source source, bool asserted)
+    {
+        if (asserted)
+        {
+            sources_ |= static_cast<uint8_t>(source);
+        }
+        else
+        {
+            sources_ &= ~static_cast<uint8_t>(source);
+        }
+    }
+
+    bool asserted() const { return sources_ != 0; }
+    bool asserted(Source source) const { return sources_ & static_cast<uint8_t>(source); }
+
+    void clear() { sources_ = 0; }
+
+private:
+    uint8_t sources_{0};
+};
@@ -16,7 +16,8 @@ int32_t get_cycles_per_frame()
     return 21477272 / 60;
 }
 
-NesAPU::NesAPU()
+NesAPU::NesAPU(AudioPlayer::Output output)
+ : player_(output)
 {
     LOG(INFO) << "NesAPU created";
 
@@ -7,6 +7,7 @@
 
 #include <array>
 #include <cstdint>
+#include <vector>
 
 class NesAPU
 {
@@ -84,11 +85,15 @@ public:
         std::array<bool, REGISTER_COUNT> had_write_flags_;
     };
 
-    NesAPU();
+    NesAPU(AudioPlayer::Output output = AudioPlayer::Output::Device);
 
     void reset();
     void step(uint64_t clock_ticks);
 
+    // AudioPlayer::Output::Buffer only, the samples mixed since the last call
+    void read_samples(std::vector<int16_t>& samples) { player_.read_samples(samples); }
+    int32_t sample_rate() const { return player_.sample_rate(); }
+
     // Needs to be called from the QT UI thread. Easiest to call once at startup and let run.
     void start();
     void stop();
@@ -1,5 +1,6 @@
 #include "processor/nes_ppu.hpp"
 
+#include "config/flags.hpp"
 #include "platform/ui_properties.hpp"
 #include "processor/address_bus.hpp"
 #include "processor/ppu_address_bus.hpp"
@@ -23,7 +24,6 @@ NesPPU::NesPPU(AddressBus& address_bus, PPUAddressBus& ppu_address_bus, NesDispl
     registers_[PPUSCROLL] = 0x00;
     registers_[PPUADDR] = 0x00;
     registers_[PPUDATA] = 0x00;
-    registers_[OAMDMA] = 0x00;
 }
 
 NesPPU::~NesPPU()
@@ -32,57 +32,125 @@ NesPPU::~NesPPU()
 
 void NesPPU::reset()
 {
+    if (access_log_)
+    {
+        log_access(PPUAccessLog::Access::Reset, 0);
+    }
+
     internal_memory_.fill(0);
-    display_.clear_screen(NesDisplay::Color({0x00, 0x00, 0x00, 0xFF}));
+
+    if (mode_ != Mode::TimingOnly)
+    {
+        display_.clear_screen(NesDisplay::BLACK);
+    }
 
     cycle_ = 341;
     scanline_ = 260;
     frame_ = 0;
+    update_draw_pixels();
 
+    global_change_frame_ = frame_;
+    published_frame_ = UINT64_MAX;
+    drawn_frame_ = UINT64_MAX;
+    line_states_.fill(LineState());
 
-    cached_nametable_address_ = nametable_base_address();
-    cached_patterntable_address = pattern_table_base_address();
-    nametable_ptr = nametable_base_address();
+    v_ = 0;
+    t_ = 0;
+    x_ = 0;
+    w_ = false;
 
-    scroll_ = std::make_pair(0, 0);
+    sprite0_hit_cycle_ = NO_SPRITE0_HIT;
+    a12_rise_cycle_ = NO_A12_RISE;
+    event_cycle_ = NO_SPRITE0_HIT;
 }
 
 void NesPPU::run()
 {
 }
 
+void NesPPU::set_access_log(PPUAccessLog* access_log)
+{
+    access_log_ = access_log;
+    mode_ = access_log_ ? Mode::TimingOnly : Mode::Full;
+    update_draw_pixels();
+
+    if (!access_log_)
+    {
+        ppu_address_bus_.page_table().set_mapping_observer(nullptr);
+        return;
+    }
+    ppu_address_bus_.page_table().set_mapping_observer([this](int32_t page, uint8_t* memory, bool writable)
+    {
+        log_page_mapping(page, memory, writable);
+    });
+}
+
+void NesPPU::log_page_mapping(int32_t page, uint8_t* memory, bool writable)
+{
+    // CIRAM is logged as an offset so the replaying PPU can map its own CIRAM
+    const uint8_t* ciram = internal_memory_.data();
+
+    if (memory >= ciram && memory < ciram + internal_memory_.size())
+    {
+        access_log_->append({.dot = dot_count_, .access = PPUAccessLog::Access::MapCiram, .value = 0,
+                             .writable = true, .address = static_cast<uint16_t>(page),
+                             .offset = static_cast<uint16_t>(memory - ciram), .memory = nullptr});
+        return;
+    }
+    access_log_->append({.dot = dot_count_, .access = PPUAccessLog::Access::MapChr, .value = 0,
+                         .writable = writable, .address = static_cast<uint16_t>(page),
+                         .offset = writable ? access_log_->snapshot_page(memory) : uint16_t(0),
+                         .memory = memory});
+}
+
 bool NesPPU::step()
 {
     increment_cycle();
 
-    handle_oam_data_register();
-    handle_ppu_data_register();
-    handle_oam_dma_register();
-    handle_scroll_register();
-
     if (is_rendering_scanline())
     {
-        if (cycle_ < NesDisplay::WIDTH) // TODO proper timing
+        if (cycle_ == 0)
         {
-            if (registers_[PPUMASK] & PPUMASK_BACKGROUND)
+            if (draw_pixels_)
+            {
+                display_.set_emphasis(scanline_, (registers_[PPUMASK] & PPUMASK_COLOR_EMPHASIS) >> 5);
+            }
+
+            if (is_rendering_enabled())
+            {
+                render_scanline();
+            }
+            else if (draw_pixels_)
             {
-                render_pixel();
+                // the scanline isn't drawn, it has to be drawn in full the next time it is
+                line_states_[scanline_] = LineState();
+                display_.mark_dirty(scanline_, NesDisplay::ALL_TILE_COLUMNS);
             }
+            schedule_scanline_events();
         }
     }
+    else if (scanline_ == PRE_RENDER_SCANLINE && cycle_ == 0)
+    {
+        schedule_scanline_events(); // the pre-render line fetches too
+    }
 
-    if (check_rendering_falling_edge())
+    if (cycle_ == event_cycle_)
     {
-        if (registers_[PPUMASK] & PPUMASK_SPRITES)
-        {
-            render_sprites(Sprite::Layer::Foreground); // TODO integrate with proper timing and background rendering
-        }
+        run_scanline_events();
+    }
 
+    if ((is_rendering_scanline() || scanline_ == PRE_RENDER_SCANLINE) && is_rendering_enabled())
+    {
+        update_vram_address();
+    }
 
-        if (is_rendering_enabled())
+    if (check_rendering_falling_edge() && draw_pixels_)
+    {
+        if (is_rendering_enabled() && display_.render())
         {
-            display_.render();
+            published_frame_ = frame_;
         }
+        drawn_frame_ = frame_;
     }
 
     if (check_vblank_raising_edge()) // vsync
@@ -94,20 +162,14 @@ bool NesPPU::step()
             nmi_signal_ = true;
         }
 
+        if (mode_ != Mode::RenderOnly)
         {
-            if (registers_[PPUMASK] & PPUMASK_BACKGROUND)
-            {
-                display_.clear_screen(fetch_color_from_palette(0, 0)); // background color
-            }
-
-            cached_nametable_address_ = nametable_base_address();
-            cached_patterntable_address = pattern_table_base_address();
+            update_ui_sprites_view([this]() { return debug_sprites(); });
+        }
 
-            if (registers_[PPUMASK] & PPUMASK_SPRITES)
-            {
-                read_sprite_oam(); // TODO proper timing for reading oam
-                render_sprites(Sprite::Layer::Background); // TODO integrate with proper timing and background rendering
-            }
+        if (access_log_)
+        {
+            access_log_->end_frame(dot_count_);
         }
     }
 
@@ -115,8 +177,7 @@ bool NesPPU::step()
     {
         registers_[PPUSTATUS] &= ~PPUSTATUS_vblank;
         registers_[PPUSTATUS] &= ~PPUSTATUS_sprite0_hit;
-
-        scroll_ = std::make_pair(pending_scroll_x_, pending_scroll_y_);
+        registers_[PPUSTATUS] &= ~PPUSTATUS_sprite_overflow;
     }
 
     return true;
@@ -126,6 +187,10 @@ uint8_t NesPPU::peek_register(uint16_t a)
 {
     assert(a == 0x4014 || (a >= 0x2000 && a <= 0x2007));
 
+    if (a == OAMDMA)
+    {
+        return 0; // write only
+    }
     return registers_[a];
 }
 
@@ -133,89 +198,460 @@ uint8_t NesPPU::read_register(uint16_t a)
 {
     assert(a == 0x4014 || (a >= 0x2000 && a <= 0x2007));
 
-    uint8_t result = registers_[a];
-
-    if (a == PPUSTATUS)
+    switch (a)
     {
-        write_latch_ = 0;
-        registers_[a] &= ~PPUSTATUS_vblank;
+        case PPUSTATUS:
+        {
+            const uint8_t result = registers_[a];
+
+            // the only side effect that matters to rendering is the write latch reset, games
+            // poll PPUSTATUS in tight loops so only log the reads that change it
+            if (access_log_ && w_)
+            {
+                log_access(PPUAccessLog::Access::RegisterRead, a);
+            }
+
+            w_ = false;
+            registers_[a] &= ~PPUSTATUS_vblank;
+            return result;
+        }
+
+        case OAMDATA:
+            return oam_memory_[oam_addr_];
+
+        case PPUDATA:
+        {
+            // Reads are delayed by one through the read buffer, except palette ram which is
+            // returned directly. The buffer is then filled with the nametable byte "under" the
+            // palette. https://www.nesdev.org/wiki/PPU_registers#The_PPUDATA_read_buffer
+            const uint16_t addr = v_ & 0x3FFF;
+            uint8_t result = ppu_data_read_buffer_;
+
+            if (access_log_)
+            {
+                log_access(PPUAccessLog::Access::RegisterRead, a);
+            }
+
+            if (addr >= 0x3F00)
+            {
+                result = ppu_address_bus_.read(addr);
+                ppu_data_read_buffer_ = ppu_address_bus_.read(addr - 0x1000);
+            }
+            else
+            {
+                ppu_data_read_buffer_ = ppu_address_bus_.read(addr);
+            }
+            v_ += ppu_addr_increment_amount();
+            return result;
+        }
+
+        case OAMDMA:
+            return 0; // write only
     }
 
-    return result;
+    return registers_[a];
 }
 
 void NesPPU::write_register(uint16_t a, uint8_t v)
 {
-    assert(a == 0x4014 || (a >= 0x2000 && a <= 0x2007));
+    // $4014 goes to oam_dma
+    assert(a >= 0x2000 && a <= 0x2007);
 
-    if (a == OAMDMA)
+    if (access_log_)
+    {
+        log_access(PPUAccessLog::Access::RegisterWrite, a, v);
+    }
+
+    switch (a)
+    {
+        case PPUCTRL:
+        {
+            // enabling NMI during vblank generates an NMI right away
+            if (!(registers_[a] & PPUCTRL_Generate_NMI) && (v & PPUCTRL_Generate_NMI) &&
+                (registers_[PPUSTATUS] & PPUSTATUS_vblank))
+            {
+                nmi_signal_ = true;
+            }
+            registers_[a] = v;
+
+            // t: ...GH.. ........ <- d: ......GH
+            t_ = (t_ & ~0x0C00) | ((v & PPUCTRL_Nametable_Select) << 10);
+            return;
+        }
+
+        case PPUSTATUS:
+            // VBL flag should not be affected by write to PPUSTATUS
+            registers_[a] |= v & ~PPUSTATUS_vblank;
+            return;
+
+        case OAMADDR:
+            registers_[a] = v;
+            oam_addr_ = v;
+            return;
+
+        case OAMDATA:
+            registers_[a] = v;
+            oam_memory_[oam_addr_++] = v;
+            return;
+
+        case PPUSCROLL:
+            registers_[a] = v;
+
+            if (!w_)
+            {
+                // t: ....... ...ABCDE <- d: ABCDE...
+                // x:              FGH <- d: .....FGH
+                t_ = (t_ & ~0x001F) | (v >> 3);
+                x_ = v & 0x07;
+            }
+            else
+            {
+                // t: FGH..AB CDE..... <- d: ABCDEFGH
+                t_ = (t_ & ~0x73E0) | ((v & 0x07) << 12) | ((v & 0xF8) << 2);
+            }
+            w_ = !w_;
+            return;
+
+        case PPUADDR:
+            registers_[a] = v;
+
+            if (!w_)
+            {
+                // first write, high address byte. t: .CDEFGH ........ <- d: ..CDEFGH
+                t_ = (t_ & 0x00FF) | ((v & 0x3F) << 8);
+            }
+            else
+            {
+                // second write, low address byte. t: ....... ABCDEFGH <- d: ABCDEFGH
+                t_ = (t_ & 0xFF00) | v;
+                v_ = t_;
+            }
+            w_ = !w_;
+            return;
+
+        case PPUDATA:
+            // Write the data to the address pointed to by v in video memory. Then increment the
+            // address by the amount specified by the control register (either horizontal or down).
+            registers_[a] = v;
+
+            if (mode_ != Mode::TimingOnly)
+            {
+                mark_vram_write(v_ & 0x3FFF);
+            }
+            ppu_address_bus_.write(v_ & 0x3FFF, v);
+            v_ += ppu_addr_increment_amount();
+            return;
+
+    }
+
+    registers_[a] = v;
+}
+
+void NesPPU::render_scanline()
+{
+    // The whole scanline is composed at once from line buffers. Each buffer keeps a bitmask of its
+    // opaque pixels so sprite priority and sprite 0 hit are resolved a word (64 pixels) at a time
+    // rather than with per pixel checks.
+    const uint8_t mask = registers_[PPUMASK];
+
+    sprite0_hit_cycle_ = NO_SPRITE0_HIT;
+
+    evaluate_sprites();
+
+    // Without pixels to draw the background is only needed to find the sprite 0 hit
+    const bool find_sprite0_hit = sprite_zero_on_line_ && !(registers_[PPUSTATUS] & PPUSTATUS_sprite0_hit);
+
+    if (!draw_pixels_ && !find_sprite0_hit)
     {
-        oam_dma_register_.write(v);
         return;
     }
-    registers_.set_had_write(a);
 
-    if (a == PPUSTATUS)
+    if (draw_pixels_)
+    {
+        const uint32_t dirty_columns = update_dirty_tiles();
+
+        if (ENABLE_PPU_CLEAN_SCANLINE_SKIP && dirty_columns == 0 && !find_sprite0_hit)
+        {
+            display_.copy_scanline_from_display_buffer(scanline_);
+            return;
+        }
+    }
+    render_background_line();
+
+    ScanlineMask left_edge_clip = ScanlineMask::all();
+    left_edge_clip.words[0] &= ~uint64_t(0xFF);
+
+    if (!(mask & PPUMASK_SHOW_BACKGROUND_LEFT_EDGE))
+    {
+        background_opaque_ &= left_edge_clip;
+    }
+    if (!(mask & PPUMASK_SHOW_SPRITES_LEFT_EDGE))
+    {
+        sprite_opaque_ &= left_edge_clip;
+        sprite_zero_ &= left_edge_clip;
+    }
+
+    // sprite 0 hit, the first opaque pixel of sprite 0 overlapping an opaque background pixel.
+    // It never triggers at x=255. The flag is raised when the PPU reaches that pixel's dot.
+    if (find_sprite0_hit)
+    {
+        ScanlineMask hits = background_opaque_ & sprite_zero_;
+        hits.words[ScanlineMask::WORDS - 1] &= ~(uint64_t(1) << 63);
+
+        const int32_t hit_x = hits.first_set();
+        if (hit_x >= 0)
+        {
+            sprite0_hit_cycle_ = hit_x + 1; // pixel x is output on dot x + 1
+        }
+    }
+
+    if (!draw_pixels_)
     {
-        // VBL flag should not be affected by write to PPUSTATUS
-        registers_[a] |= v & ~PPUSTATUS_vblank;
         return;
     }
+    update_line_palette();
 
-    registers_[a] = v;
+    // sprites are drawn unless they are behind an opaque background pixel
+    const ScanlineMask sprite_visible = sprite_opaque_ & ~(background_opaque_ & sprite_behind_);
+
+    // transparent background pixels are 0 and were cleared by the left edge clip, the line
+    // palette maps every color table index 0 to the backdrop color
+    uint8_t* line = display_.scanline(scanline_);
+
+    for (int32_t w = 0;w < ScanlineMask::WORDS;w++)
+    {
+        const uint64_t sprites = sprite_visible.words[w];
+        const uint64_t background = background_opaque_.words[w];
+        const int32_t base = w * ScanlineMask::BITS_PER_WORD;
+
+        for (int32_t i = 0;i < ScanlineMask::BITS_PER_WORD;i++)
+        {
+            const int32_t x = base + i;
+
+            if ((sprites >> i) & 1)
+            {
+                line[x] = line_palette_[SPRITE_PALETTE_OFFSET | sprite_line_[x]];
+            }
+            else
+            {
+                line[x] = line_palette_[((background >> i) & 1) ? background_line_[x] : 0];
+            }
+        }
+    }
 }
 
-void NesPPU::render_pixel()
-{
-    // Direct indexing into nametable is easier code to understand, but it is also a lot slower
-    // than just incrementing the position each cycle. Keeping this commented out for any debugging
-    // of cycle increment changes.
-    //
-    // const uint8_t pixel_x = cycle_;
-    // const uint8_t pixel_y = scanline_;
-    // const uint16_t background_pixel_x = pixel_x + scroll_.first;
-    // const uint16_t background_pixel_y = pixel_y + scroll_.second;
-    //
-    // const uint16_t tile_y = background_pixel_y % 240 / NAMETABLE_TILE_SIZE;
-    // const uint16_t tile_x = background_pixel_x % 256 / NAMETABLE_TILE_SIZE;
-    // const uint16_t nt_addr = nametable_base_address_for_pixel(background_pixel_x, background_pixel_y) +
-    //                          tile_x + tile_y * NAMETABLE_WIDTH;
-    // assert(nt_addr == nametable_ptr);
-
-    // Get the index of the pattern tile from the nametable
-    const uint8_t pattern_tile_index = ppu_address_bus_.read(nametable_ptr);
-
-    // Get the index into the color table from the pattern table tile
-    const uint8_t colortable_index = get_colortable_index_for_tile_and_pixel(cached_patterntable_address,
-                                                                             tile_x_pixel_,
-                                                                             tile_y_pixel_,
-                                                                             pattern_tile_index);
-    // Determine which palette to use
-    const uint8_t palette_index = get_palette_index_for_pixel(pixel_x_, pixel_y_);
-
-    // Retrieve the RGB color for this pixel
-    const NesDisplay::Color pixel_color = fetch_color_from_palette(palette_index, colortable_index);
-
-    if (colortable_index == 0)
-    {
-        // transparent
+void NesPPU::render_background_line()
+{
+    // Decode the background for the scanline into the background line buffer, a tile (8 pixels)
+    // at a time. Fetching starts at v, which holds the scroll position for the start of the line,
+    // and steps across the nametables with coarse X increments the same way the PPU does.
+    // https://www.nesdev.org/wiki/PPU_scrolling
+    background_line_.fill(0);
+    background_opaque_.clear();
+
+    if (!(registers_[PPUMASK] & PPUMASK_BACKGROUND))
+    {
         return;
     }
 
-    // Draw the pixel!
-    display_.draw_pixel(cycle_, scanline_, pixel_color);
+    const uint16_t pattern_table_address = pattern_table_base_address();
+    const uint16_t fine_y = (v_ & VRAM_FINE_Y) >> 12;
+
+    uint16_t v = v_;
+    int32_t tile_pixel_x = x_;
+
+    int32_t x = 0;
+    while (x < NesDisplay::WIDTH)
+    {
+        // Get the index of the pattern tile from the nametable
+        const uint8_t pattern_tile_index = ppu_address_bus_.read(0x2000 | (v & 0x0FFF));
+        const uint16_t pattern_tile_addr = pattern_table_address | (pattern_tile_index << 4) | fine_y;
+
+        const uint8_t lo_bit_plane = ppu_address_bus_.read(pattern_tile_addr);
+        const uint8_t hi_bit_plane = ppu_address_bus_.read(pattern_tile_addr | 0x0008);
+
+        // Each attribute byte holds the palettes of 4x4 tiles, 2 bits for each 2x2 quadrant
+        const uint16_t attribute_addr = 0x23C0 | (v & (VRAM_NAMETABLE_Y | VRAM_NAMETABLE_X)) |
+                                        ((v >> 4) & 0x38) | ((v >> 2) & 0x07);
+        const uint8_t attribute_shift = ((v >> 4) & 0x04) | (v & 0x02);
+        const uint8_t palette_bits = ((ppu_address_bus_.read(attribute_addr) >> attribute_shift) & 0x03) << 2;
+
+        for (;tile_pixel_x < NAMETABLE_TILE_SIZE && x < NesDisplay::WIDTH;tile_pixel_x++, x++)
+        {
+            const int32_t bit = 7 - tile_pixel_x;
+            const uint8_t colortable_index = ((lo_bit_plane >> bit) & 0x01) |
+                                             (((hi_bit_plane >> bit) & 0x01) << 1);
+            if (colortable_index == 0)
+            {
+                continue; // transparent
+            }
+            background_line_[x] = palette_bits | colortable_index;
+            background_opaque_.set(x);
+        }
+
+        tile_pixel_x = 0;
+        increment_coarse_x(v);
+    }
 }
 
-uint8_t NesPPU::get_pattern_tile_index_for_pixel(uint16_t pixel_x, uint16_t pixel_y)
+uint32_t NesPPU::update_dirty_tiles()
 {
-    // Retrieve the nametable data for this pixel. The nametable is broken up into 8x8 tiles
-    // which contain an index into the pattern table.
-    const uint16_t tile_y = pixel_y % 240 / NAMETABLE_TILE_SIZE;
-    const uint16_t tile_x = pixel_x % 256 / NAMETABLE_TILE_SIZE;
-    const uint16_t nt_addr = nametable_base_address_for_pixel(pixel_x, pixel_y) +
-                             tile_x + tile_y * NAMETABLE_WIDTH;
+    // Mapping changes don't go through the PPU registers, catch them here
+    const uint64_t generation = ppu_address_bus_.page_table().generation();
+    if (generation != page_table_generation_)
+    {
+        page_table_generation_ = generation;
+        global_change_frame_ = frame_;
+    }
+
+    const LineState state{.v = v_, .x = x_, .ctrl = registers_[PPUCTRL], .mask = registers_[PPUMASK]};
+
+    LineSprites sprites;
+    sprites.count = secondary_oam_count_;
+    std::copy_n(secondary_oam_.begin(), secondary_oam_count_, sprites.sprites.begin());
+
+    // Everything is dirty if the last frame drawn wasn't displayed or the line's scroll and
+    // settings changed. A change during that frame could have happened after this scanline was
+    // drawn, so changes since the start of it count, including the frames skipped since.
+    const bool previous_frame_displayed = published_frame_ != UINT64_MAX && published_frame_ == drawn_frame_;
+    const bool global_change = global_change_frame_ >= published_frame_;
+
+    uint32_t dirty_columns = 0;
+
+    if (!previous_frame_displayed || global_change || !(line_states_[scanline_] == state))
+    {
+        dirty_columns = NesDisplay::ALL_TILE_COLUMNS;
+    }
+    else
+    {
+        dirty_columns = dirty_background_columns();
 
-    return ppu_address_bus_.read(nt_addr);
+        const LineSprites& previous_sprites = line_sprites_[scanline_];
+
+        if (previous_sprites.count != sprites.count ||
+            !std::equal(sprites.sprites.begin(), sprites.sprites.begin() + sprites.count,
+                        previous_sprites.sprites.begin()))
+        {
+            // sprite movement dirties where the sprites were and where they are now
+            dirty_columns |= sprite_columns(previous_sprites) | sprite_columns(sprites);
+        }
+    }
+
+    line_states_[scanline_] = state;
+    line_sprites_[scanline_] = sprites;
+
+    display_.mark_dirty(scanline_, dirty_columns);
+    return dirty_columns;
+}
+
+uint32_t NesPPU::dirty_background_columns() const
+{
+    // Walk the tiles the scanline fetches, the same as render_background_line, and mark the
+    // screen tile columns of any that were written since the start of the last displayed frame
+    uint32_t dirty_columns = 0;
+    uint16_t v = v_;
+
+    for (int32_t tile = 0;tile <= NAMETABLE_WIDTH;tile++)
+    {
+        const int32_t nametable = (v >> 10) & 0x03;
+        const int32_t tile_index = v & (VRAM_COARSE_Y | VRAM_COARSE_X);
+
+        // coarse Y 30 and 31 fetch the attribute table as tiles, always treat those as dirty
+        const bool dirty = tile_index >= NAMETABLE_WIDTH * NAMETABLE_HEIGHT ||
+                           nametable_write_frames_[nametable][tile_index] >= published_frame_;
+
+        if (dirty)
+        {
+            const int32_t first_x = std::max(tile * NAMETABLE_TILE_SIZE - x_, 0);
+            const int32_t last_x = std::min(tile * NAMETABLE_TILE_SIZE - x_ + NAMETABLE_TILE_SIZE - 1,
+                                            NesDisplay::WIDTH - 1);
+            if (first_x <= last_x)
+            {
+                for (int32_t column = first_x / NesDisplay::TILE_SIZE;column <= last_x / NesDisplay::TILE_SIZE;column++)
+                {
+                    dirty_columns |= 1u << column;
+                }
+            }
+        }
+        increment_coarse_x(v);
+    }
+    return dirty_columns;
+}
+
+uint32_t NesPPU::sprite_columns(const LineSprites& line_sprites)
+{
+    uint32_t columns = 0;
+
+    for (int32_t n = 0;n < line_sprites.count;n++)
+    {
+        const int32_t first_x = line_sprites.sprites[n].x_pos;
+        const int32_t last_x = std::min(first_x + NAMETABLE_TILE_SIZE - 1, NesDisplay::WIDTH - 1);
+
+        columns |= 1u << (first_x / NesDisplay::TILE_SIZE);
+        columns |= 1u << (last_x / NesDisplay::TILE_SIZE);
+    }
+    return columns;
+}
+
+void NesPPU::mark_vram_write(uint16_t addr)
+{
+    if (addr < 0x2000 || addr >= 0x3F00)
+    {
+        // pattern or palette data, can change anything on screen
+        global_change_frame_ = frame_;
+        return;
+    }
+
+    // The same vram can be mapped as more than one nametable, mark the write in each of them
+    const PPUPageTable& page_table = ppu_address_bus_.page_table();
+    const uint8_t* written_page = page_table.page(addr >> PPUPageTable::PAGE_SHIFT);
+    const uint16_t offset = addr & PPUPageTable::PAGE_MASK;
+
+    for (int32_t nametable = 0;nametable < PPUPageTable::NAMETABLE_COUNT;nametable++)
+    {
+        if (page_table.page(PPUPageTable::NAMETABLE_PAGE + nametable) != written_page)
+        {
+            continue;
+        }
+
+        if (offset < NAMETABLE_WIDTH * NAMETABLE_HEIGHT)
+        {
+            nametable_write_frames_[nametable][offset] = frame_;
+            continue;
+        }
+
+        // attribute byte, covers 4x4 tiles
+        const int32_t attribute = offset - NAMETABLE_WIDTH * NAMETABLE_HEIGHT;
+        const int32_t first_tile_x = (attribute % 8) * 4;
+        const int32_t first_tile_y = (attribute / 8) * 4;
+
+        for (int32_t tile_y = first_tile_y;tile_y < first_tile_y + 4 && tile_y < NAMETABLE_HEIGHT;tile_y++)
+        {
+            for (int32_t tile_x = first_tile_x;tile_x < first_tile_x + 4;tile_x++)
+            {
+                nametable_write_frames_[nametable][tile_y * NAMETABLE_WIDTH + tile_x] = frame_;
+            }
+        }
+    }
+}
+
+void NesPPU::update_draw_pixels()
+{
+    const int32_t frame_skip = frame_skip_;
+    draw_pixels_ = mode_ != Mode::TimingOnly && (frame_skip <= 1 || frame_ % frame_skip == 0);
+}
+
+void NesPPU::update_line_palette()
+{
+    // Resolve the palette ram into system colors once per scanline. Color table index 0 of every
+    // palette shows the backdrop color.
+    const uint8_t backdrop = fetch_system_color(0, 0);
+
+    for (int32_t i = 0;i < static_cast<int32_t>(line_palette_.size());i++)
+    {
+        line_palette_[i] = (i & PIXEL_COLORTABLE_MASK) ? fetch_system_color(i >> 2, i & PIXEL_COLORTABLE_MASK)
+                                                       : backdrop;
+    }
 }
 
 uint8_t NesPPU::get_colortable_index_for_tile_and_pixel(uint16_t pattern_table_base_address,
@@ -252,320 +688,205 @@ uint8_t NesPPU::get_colortable_index_for_tile_and_pixel(uint16_t pattern_table_b
     return static_cast<uint8_t>(patterntable_value);
 }
 
-uint8_t NesPPU::get_palette_index_for_pixel(uint16_t pixel_x, uint16_t pixel_y)
-{
-    // Get attribute table for the pixel in order to identify which palette should be used.
-    // The palette indices for each nametable tile are stored with a byte for each 4x4 set tiles
-    static constexpr uint16_t ATTRIBUTETABLE_TILE_SIZE = 32; // in pixels
-    static constexpr uint16_t TILES_PER_ATTR_BYTE = 4; // bytes hold 4x4 tile data
-    static constexpr uint16_t ATTRIBUTETABLE_WIDTH = 8; // bytes
-    const uint8_t attributetable_x = pixel_x % 256 / ATTRIBUTETABLE_TILE_SIZE;
-    const uint8_t attributetable_y = pixel_y % 240 / ATTRIBUTETABLE_TILE_SIZE;
-    const uint16_t attribute_addr = nametable_base_address_for_pixel(pixel_x, pixel_y) +
-                                    NAMETABLE_WIDTH * NAMETABLE_HEIGHT +
-                                    attributetable_x + attributetable_y * ATTRIBUTETABLE_WIDTH;
-
-    const uint8_t tile_offset_x = tile_x_ % TILES_PER_ATTR_BYTE;
-    const uint8_t tile_offset_y = tile_y_ % TILES_PER_ATTR_BYTE;
-    
-    const uint8_t palette_index_byte = ppu_address_bus_.read(attribute_addr);
-
-    if (tile_offset_x >= 2 && tile_offset_y >= 2) // bottom right
-    {
-        return (palette_index_byte >> 6) & 0x03;
-    }
-    else if (tile_offset_x <= 1 && tile_offset_y >= 2) // bottom left
-    {
-        return (palette_index_byte >> 4) & 0x03;
-    }
-    else if (tile_offset_x <= 1 && tile_offset_y <= 1) // top left
-    {
-        return (palette_index_byte >> 0) & 0x03;
-    }
-    else if (tile_offset_x >= 2 && tile_offset_y <= 1) // top right
-    {
-        return (palette_index_byte >> 2) & 0x03;
-    }
-
-    assert(false);
-    return 0;
-}
-
-NesDisplay::Color NesPPU::fetch_color_from_palette(uint8_t palette_index, uint8_t colortable_index) const
+uint8_t NesPPU::fetch_system_color(uint8_t palette_index, uint8_t colortable_index) const
 {
     const uint16_t palette_base_address = 0x3F00;
     const uint16_t palette_addr = palette_base_address +
                                   (3 + 1) * palette_index; // 3 colors per, one space between
     const uint8_t palette_value = ppu_address_bus_.read(palette_addr + colortable_index);
 
-    // RGB with each represented from 0-7. Scale each component to fill the 0-255 range when
-    // generating the NestDisplay color to return.
-    // This is the 2C03 palette from the nesdev wiki: https://www.nesdev.org/wiki/PPU_palettes
-    static constexpr int32_t NUM_VALUES = 64;
-
-    static constexpr uint16_t COLOR_PALETTE[] =
-    {0x333,0x014,0x006,0x326,0x403,0x503,0x510,0x420,0x320,0x120,0x031,0x040,0x022,0x00,0x00,0x00,
-     0x555,0x036,0x027,0x407,0x507,0x704,0x700,0x630,0x430,0x140,0x040,0x053,0x044,0x00,0x00,0x00,
-     0x777,0x357,0x447,0x637,0x707,0x737,0x740,0x750,0x660,0x360,0x070,0x276,0x077,0x00,0x00,0x00,
-     0x777,0x567,0x657,0x757,0x747,0x755,0x764,0x772,0x773,0x572,0x473,0x276,0x467,0x00,0x00,0x00};
-
-    static uint16_t SCALED_RED[NUM_VALUES];
-    static uint16_t SCALED_GREEN[NUM_VALUES];
-    static uint16_t SCALED_BLUE[NUM_VALUES];
-    static bool precompute_colortable = true;
-
-    if (precompute_colortable)
+    if (registers_[PPUMASK] & PPUMASK_GREYSCALE)
     {
-        static constexpr uint8_t COLOR_SCALE_FACTOR = 31;
-
-        for (int32_t i = 0;i < NUM_VALUES;++i)
-        {
-            SCALED_RED[i] = ((COLOR_PALETTE[i] >> 8) & 0x000F) * COLOR_SCALE_FACTOR;
-            SCALED_GREEN[i] = ((COLOR_PALETTE[i] >> 4) & 0x000F) * COLOR_SCALE_FACTOR;
-            SCALED_BLUE[i] = ((COLOR_PALETTE[i] >> 0) & 0x000F) * COLOR_SCALE_FACTOR;
-        }
-        precompute_colortable = false;
+        return palette_value & 0x30;
     }
-
-    NesDisplay::Color color;
-    color.r = SCALED_RED[palette_value];
-    color.g = SCALED_GREEN[palette_value];
-    color.b = SCALED_BLUE[palette_value];
-    color.a = 0xFF;
-    return color;
+    return palette_value & 0x3F;
 }
 
-void NesPPU::read_sprite_oam()
+NesDisplay::Color NesPPU::fetch_color_from_palette(uint8_t palette_index, uint8_t colortable_index) const
 {
-    sprites_.clear();
+    return NesDisplay::palette_color(fetch_system_color(palette_index, colortable_index));
+}
 
-    for (int16_t i = 0;i < 64;i++)
+void NesPPU::evaluate_sprites()
+{
+    // Sprite evaluation for the current scanline. The first 8 sprites in OAM that cover the
+    // scanline are copied to secondary OAM, then their pattern rows are decoded into the sprite
+    // line buffer and opacity masks that render_scanline merges with the background.
+    // https://www.nesdev.org/wiki/PPU_sprite_evaluation
+    sprite_line_.fill(0);
+    sprite_opaque_.clear();
+    sprite_behind_.clear();
+    sprite_zero_.clear();
+    secondary_oam_count_ = 0;
+    sprite_zero_on_line_ = false;
+
+    const bool tall_sprites = sprite_type() == SpriteType::Sprite_8x16;
+    const int32_t sprite_height = tall_sprites ? 2 * NAMETABLE_TILE_SIZE : NAMETABLE_TILE_SIZE;
+
+    for (int32_t i = 0;i < OAM_SPRITE_COUNT;i++)
     {
-        sprites_.push_back(sprite(i));
+        const OamSprite& s = oam_sprite(i);
 
-        NesPPU::Sprite& s = sprites_.back();
+        // sprite data is delayed by one scanline https://www.nesdev.org/wiki/PPU_OAM
+        const int32_t row = static_cast<int32_t>(scanline_) - (s.y_pos + 1);
 
-        if (s.tile_index == 0)
+        if (row < 0 || row >= sprite_height)
         {
             continue;
         }
 
-        s.canvas = std::make_shared<Sprite::Canvas>();
+        if (secondary_oam_count_ == SPRITES_PER_SCANLINE)
+        {
+            // The hardware's overflow check has a bug that produces false positives and
+            // negatives. This sets the flag the way it was intended to work.
+            registers_[PPUSTATUS] |= PPUSTATUS_sprite_overflow;
+            break;
+        }
+
+        if (i == 0)
+        {
+            sprite_zero_on_line_ = true;
+        }
+        secondary_oam_[secondary_oam_count_++] = s;
     }
-}
 
-void NesPPU::render_sprites(Sprite::Layer layer)
-{
-    if (sprites_.size() == 0)
+    if (!(registers_[PPUMASK] & PPUMASK_SPRITES))
     {
         return;
     }
-    NesPPU::SpriteType sprite_size = sprite_type();
 
-    for (int16_t i = 63;i >= 0;i--) // sprite with lower address wins with overlapping sprites
+    const uint16_t sprite_table_address = sprite_pattern_table_address(0);
+
+    // without pixels to draw only sprite 0 is decoded, for the sprite 0 hit
+    const int32_t decode_count = draw_pixels_ ? secondary_oam_count_ :
+                                 sprite_zero_on_line_ ? 1 : 0;
+
+    // sprite with lower address wins with overlapping sprites, so pixels are only filled in
+    // where no earlier sprite was opaque
+    for (int32_t n = 0;n < decode_count;n++)
     {
-        const NesPPU::Sprite& s = sprites_[i];
+        const OamSprite& s = secondary_oam_[n];
 
-        if (layer != s.layer()) // foreground / background check
+        int32_t row = static_cast<int32_t>(scanline_) - (s.y_pos + 1);
+        if (s.attributes & SPRITE_ATTR_FLIP_VERTICAL)
         {
-            continue;
+            row = sprite_height - 1 - row;
         }
 
-        if (s.tile_index == 0)
+        uint16_t pattern_tile_addr = 0;
+        if (tall_sprites)
         {
-            continue;
-        }
+            const uint16_t table_address = (s.tile_index & 0x01) ? 0x1000 : 0x0000;
+            const uint8_t tile_index = (s.tile_index & 0xFE) + (row / NAMETABLE_TILE_SIZE);
 
-        auto render_sprite_tile = [this, &s, &i](int32_t tile_index, uint8_t y_pos)
+            pattern_tile_addr = table_address | (tile_index << 4) | (row % NAMETABLE_TILE_SIZE);
+        }
+        else
         {
-            for (uint8_t p = 0;p < NAMETABLE_TILE_SIZE * NAMETABLE_TILE_SIZE;p++)
-            {
-                uint8_t tile_pixel_x = p % NAMETABLE_TILE_SIZE;
-                uint8_t tile_pixel_y = p / NAMETABLE_TILE_SIZE;
-                uint8_t debug_tile_pixel_x = tile_pixel_x;
-                uint8_t debug_tile_pixel_y = tile_pixel_y;
+            pattern_tile_addr = sprite_table_address | (s.tile_index << 4) | row;
+        }
 
-                uint8_t pixel_x = s.x_pos + tile_pixel_x;
-                uint8_t pixel_y = y_pos + tile_pixel_y + 1; // sprite data is delayed by one scanline https://www.nesdev.org/wiki/PPU_OAM
+        const uint8_t lo_bit_plane = ppu_address_bus_.read(pattern_tile_addr);
+        const uint8_t hi_bit_plane = ppu_address_bus_.read(pattern_tile_addr | 0x0008);
 
-                if (s.flip_horizontal())
-                {
-                    tile_pixel_x = NAMETABLE_TILE_SIZE - (p % NAMETABLE_TILE_SIZE) - 1;
-                }
-                if (s.flip_vertical())
-                {
-                    tile_pixel_y = NAMETABLE_TILE_SIZE - (p / NAMETABLE_TILE_SIZE) - 1;
-                }
-                
-                // Get the index into the color table from the pattern table tile
-                const uint8_t colortable_index = get_colortable_index_for_tile_and_pixel(s.pattern_table_base_address,
-                                                                                         tile_pixel_x,
-                                                                                         tile_pixel_y,
-                                                                                         tile_index);
-                if (colortable_index == 0)
-                {
-                    continue; // transparent
-                }
+        const uint8_t palette_bits = (s.attributes & 0x03) << 2;
+        const bool behind_background = s.attributes & SPRITE_ATTR_BEHIND_BACKGROUND;
+        const bool sprite_zero = n == 0 && sprite_zero_on_line_;
 
-                if (i == 0) // sprite 0 hit check
-                {
-                    // TODO only when hitting a non-transparent background pixel
-                    if (!(registers_[PPUSTATUS] & PPUSTATUS_sprite0_hit))
-                    {
-                        registers_[PPUSTATUS] |= PPUSTATUS_vblank;
-                    }
-                }
-
-                // Determine which palette to use
-                const uint8_t palette_index = 4 + (s.attributes & 0x3);
+        for (int32_t p = 0;p < NAMETABLE_TILE_SIZE;p++)
+        {
+            const int32_t pixel_x = s.x_pos + p;
+            if (pixel_x >= NesDisplay::WIDTH)
+            {
+                break;
+            }
 
-                // Retrieve the RGB color for this pixel
-                const NesDisplay::Color pixel_color = fetch_color_from_palette(palette_index, colortable_index);
+            const int32_t bit = (s.attributes & SPRITE_ATTR_FLIP_HORIZONTAL) ? p : 7 - p;
+            const uint8_t colortable_index = ((lo_bit_plane >> bit) & 0x01) |
+                                             (((hi_bit_plane >> bit) & 0x01) << 1);
 
-                // Draw the pixel!
-                display_.draw_pixel(pixel_x, pixel_y, pixel_color);
-                s.canvas.get()[debug_tile_pixel_y][debug_tile_pixel_x] = pixel_color;
+            if (colortable_index == 0 || sprite_opaque_.test(pixel_x))
+            {
+                continue; // transparent or covered by a lower index sprite
             }
-        };
+            sprite_line_[pixel_x] = palette_bits | colortable_index;
+            sprite_opaque_.set(pixel_x);
 
-        if (sprite_size == SpriteType::Sprite_8x8)
-        {
-            render_sprite_tile(s.tile_index, s.y_pos);
-        }
-        else // (sprite_size == SpriteType::Sprite_8x16)
-        {
-            if (s.flip_vertical())
+            if (behind_background)
             {
-                render_sprite_tile(s.tile_index + 0, s.y_pos + NAMETABLE_TILE_SIZE);
-                render_sprite_tile(s.tile_index + 1, s.y_pos);
+                sprite_behind_.set(pixel_x);
             }
-            else
+            if (sprite_zero)
             {
-                render_sprite_tile(s.tile_index + 0, s.y_pos);
-                render_sprite_tile(s.tile_index + 1, s.y_pos + NAMETABLE_TILE_SIZE);
+                sprite_zero_.set(pixel_x);
             }
         }
     }
-
-    if (layer == Sprite::Layer::Foreground)
-    {
-        update_ui_sprites_view(sprites_);
-    }
 }
 
-NesPPU::Sprite NesPPU::sprite(uint16_t index)
+std::vector<NesPPU::Sprite> NesPPU::debug_sprites()
 {
-    struct OamSprite
-    {
-        // maps to the data layout of oam data
-        uint8_t y_pos;
-        uint8_t tile_index;
-        uint8_t attributes;
-        uint8_t x_pos;
-    };
-
-    const uint8_t* oam_p = std::addressof(oam_memory_[index * sizeof(OamSprite)]);
-    const OamSprite* sprite_p = reinterpret_cast<const OamSprite*>(oam_p);
-    uint8_t pattern_table_base = sprite_pattern_table_address(sprite_p->tile_index);
-
-    return Sprite(sprite_p->y_pos, sprite_p->tile_index, sprite_p->attributes, sprite_p->x_pos,
-                  pattern_table_base);
-}
+    // Sprite list with decoded tile images for the sprites debug window. Only built when the
+    // window is due for an update, never as part of rendering.
+    std::vector<Sprite> sprites;
+    sprites.reserve(OAM_SPRITE_COUNT);
 
-void NesPPU::handle_oam_data_register()
-{
-    if (registers_.had_write(OAMADDR))
+    for (int16_t i = 0;i < OAM_SPRITE_COUNT;i++)
     {
-        registers_.clear_write_flag(OAMADDR);
-        oam_data_addr_ = registers_[OAMADDR];
-    }
+        sprites.push_back(sprite(i));
 
-    if (registers_.had_write(OAMDATA))
-    {
-        registers_.clear_write_flag(OAMDATA);
+        NesPPU::Sprite& s = sprites.back();
 
-        // If the processor wrote to the PPUDATA register, write that data to the address pointed to
-        // by ppu_data_addr in video memory. Then increment the address by the amount specified by
-        // the control register (either horizontal or down).
-        LOG_IF(ERROR, oam_addr_write_count % 2 != 0) << "Error: "
-             << " write to OAMDATA without a fully set OAMADDR";
+        if (s.tile_index == 0)
+        {
+            continue;
+        }
 
-        oam_memory_[oam_data_addr_] = registers_[OAMDATA];
-        oam_data_addr_ += 1;
-    }
-}
+        s.canvas = std::make_shared<Sprite::Canvas>();
 
-void NesPPU::handle_ppu_data_register()
-{
-    if (registers_.had_write(PPUADDR))
-    {
-        registers_.clear_write_flag(PPUADDR);
-        if (write_latch_ % 2 == 0)
+        for (uint8_t p = 0;p < NAMETABLE_TILE_SIZE * NAMETABLE_TILE_SIZE;p++)
         {
-            ppu_data_addr_ = 0x0;
+            const uint8_t tile_pixel_x = p % NAMETABLE_TILE_SIZE;
+            const uint8_t tile_pixel_y = p / NAMETABLE_TILE_SIZE;
+
+            const uint8_t colortable_index = get_colortable_index_for_tile_and_pixel(
+                                                s.pattern_table_base_address,
+                                                s.flip_horizontal() ? 7 - tile_pixel_x : tile_pixel_x,
+                                                s.flip_vertical() ? 7 - tile_pixel_y : tile_pixel_y,
+                                                s.tile_index);
+            if (colortable_index == 0)
+            {
+                continue; // transparent
+            }
 
-            // first write, high address byte
-            ppu_data_addr_ = registers_[PPUADDR] << 8;
-        }
-        else
-        {
-            // second write, low address byte
-            ppu_data_addr_ |= registers_[PPUADDR];
+            s.canvas.get()[tile_pixel_y][tile_pixel_x] =
+                fetch_color_from_palette(4 + (s.attributes & 0x3), colortable_index);
         }
-        write_latch_++;
-    }
-
-    if (registers_.had_write(PPUDATA))
-    {
-        registers_.clear_write_flag(PPUDATA);
-        // If the processor wrote to the PPUDATA register, write that data to the address pointed to
-        // by ppu_data_addr in video memory. Then increment the address by the amount specified by
-        // the control register (either horizontal or down).
-        LOG_IF(ERROR, write_latch_ % 2 != 0) << "Error: "
-                << " write to PPUDATA without a fully set PPUADDR";
-
-        ppu_address_bus_.write(ppu_data_addr_, registers_[PPUDATA]);
-        ppu_data_addr_ += ppu_addr_increment_amount();
     }
+    return sprites;
 }
 
-uint8_t NesPPU::read_ppu_data()
+NesPPU::Sprite NesPPU::sprite(uint16_t index)
 {
-    LOG(FATAL) << "assertion for notification when a game actually uses this";
-    assert(ppu_data_addr_ <= 0x3FFF);
-
-    ppu_data_addr_ += ppu_addr_increment_amount();
+    const OamSprite& s = oam_sprite(index);
+    const uint16_t pattern_table_base = sprite_pattern_table_address(s.tile_index);
 
-    return ppu_address_bus_.read(ppu_data_addr_);
+    return Sprite(s.y_pos, s.tile_index, s.attributes, s.x_pos, pattern_table_base);
 }
 
-void NesPPU::handle_oam_dma_register()
+void NesPPU::oam_dma(std::span<const uint8_t, 256> page)
 {
-    if (oam_dma_register_.had_write())
-    {
-        oam_dma_register_.clear_write_flag();
+    // the copy wraps around OAM when OAMADDR isn't 0
+    const size_t first_part = oam_memory_.size() - oam_addr_;
 
-        uint16_t oam_src_addr = oam_dma_register_.value() << 8;
-        for (uint16_t i = 0;i < oam_memory_.size();i++)
-        {
-            oam_memory_[i] = address_bus_.read(oam_src_addr + i);
-        }
-    }
-}
+    std::copy_n(page.begin(), first_part, oam_memory_.begin() + oam_addr_);
+    std::copy_n(page.begin() + first_part, oam_addr_, oam_memory_.begin());
 
-void NesPPU::handle_scroll_register()
-{
-    if (registers_.had_write(PPUSCROLL))
+    if (access_log_)
     {
-        registers_.clear_write_flag(PPUSCROLL);
-
-        if (write_latch_++ % 2 == 0)
+        for (uint8_t data : page)
         {
-            pending_scroll_x_ = registers_[PPUSCROLL];
-        }
-        else
-        {
-            pending_scroll_y_ = registers_[PPUSCROLL];
+            log_access(PPUAccessLog::Access::RegisterWrite, OAMDATA, data);
         }
     }
 }
@@ -573,11 +894,7 @@ void NesPPU::handle_scroll_register()
 void NesPPU::increment_cycle()
 {
     cycle_++;
-
-    if (cycle_ < NesDisplay::WIDTH)
-    {
-        increment_nametable_x_offsets();
-    }
+    dot_count_++;
 
     if ( (cycle_ >= 341) ||
         // There is one fewer cycle for odd frames when rendering is enabled
@@ -590,76 +907,123 @@ void NesPPU::increment_cycle()
         {
             scanline_ = 0;
             frame_++;
+            update_draw_pixels();
         }
-        increment_nametable_y_offsets();
    }
 }
 
-void NesPPU::increment_nametable_x_offsets()
+void NesPPU::schedule_scanline_events()
 {
-    tile_x_pixel_++;
-    pixel_x_++;
+    a12_rise_cycle_ = NO_A12_RISE;
 
-    if (tile_x_pixel_ == NAMETABLE_TILE_SIZE)
+    if (scanline_counter_ && is_rendering_enabled())
     {
-        tile_x_pixel_ = 0;
-        tile_x_++;
-        nametable_ptr++;
-
-        if (tile_x_ == NAMETABLE_WIDTH)
-        {
-            tile_x_ = 0;
-
-            nametable_ptr ^= 0x0400;
-            nametable_ptr -= NAMETABLE_WIDTH;
-        }
+        a12_rise_cycle_ = a12_rise_cycle();
     }
+    event_cycle_ = std::min(sprite0_hit_cycle_, a12_rise_cycle_);
 }
 
-void NesPPU::increment_nametable_y_offsets()
+void NesPPU::run_scanline_events()
 {
-    pixel_x_ = scroll_.first;
-    tile_x_ = (pixel_x_ % 256) / NAMETABLE_TILE_SIZE;
-    tile_x_pixel_ = (pixel_x_ % 256) % NAMETABLE_TILE_SIZE;
-
-    tile_y_pixel_++;
-    pixel_y_++;
+    if (cycle_ == sprite0_hit_cycle_)
+    {
+        registers_[PPUSTATUS] |= PPUSTATUS_sprite0_hit;
+        sprite0_hit_cycle_ = NO_SPRITE0_HIT;
+    }
 
-    if (tile_y_pixel_ == NAMETABLE_TILE_SIZE)
+    if (cycle_ == a12_rise_cycle_)
     {
-        tile_y_pixel_ = 0;
-        tile_y_++;
+        a12_rise_cycle_ = NO_A12_RISE;
 
-        if (tile_y_ == NAMETABLE_HEIGHT)
+        // rendering turned off mid line stops the fetches
+        if (is_rendering_enabled())
         {
-            tile_y_ = 0;
+            scanline_counter_->clock_scanline_counter();
         }
     }
+    event_cycle_ = std::min(sprite0_hit_cycle_, a12_rise_cycle_);
+}
 
-    if (scanline_ == 0) // It just rolled around this cycle update
+uint32_t NesPPU::a12_rise_cycle() const
+{
+    // Background tiles are fetched on dots 1 - 256 and 321 - 336, sprite tiles on 257 - 320. A12
+    // is high while fetching from the $1000 pattern table. It also drops for the nametable and
+    // attribute fetches between pattern fetches, but those are too short for the mapper's filter,
+    // so A12 only rises where the fetches switch from the $0000 table to the $1000 table.
+    const bool background_high = registers_[PPUCTRL] & PPUCTRL_Backgroundtable_Select;
+
+    // 8x16 sprites pick the table per sprite and empty sprite slots fetch tile $FF, which is in
+    // the $1000 table
+    const bool sprites_high = (registers_[PPUCTRL] & PPUCTRL_SpriteSize_Select) ||
+                              (registers_[PPUCTRL] & PPUCTRL_SpriteTable_Addr);
+
+    if (!background_high && sprites_high)
+    {
+        return 260; // the first sprite pattern fetch
+    }
+    if (background_high && !sprites_high)
     {
-        pixel_x_ = scroll_.first;
-        pixel_y_ = scroll_.second;
+        return 324; // the first pattern fetch for the next line's tiles
+    }
+    return NO_A12_RISE;
+}
 
-        uint16_t screen_local_pixel_x = pixel_x_ % 256;
-        uint16_t screen_local_pixel_y = pixel_y_ % 240;
+void NesPPU::update_vram_address()
+{
+    // Scroll updates to v while rendering. The background of a scanline is rendered in one pass
+    // from v at the start of the line, so the per tile coarse X increments happen on a copy in
+    // render_background_line and v only sees the end of line updates.
+    if (cycle_ == 256)
+    {
+        increment_fine_y(v_);
+    }
+    else if (cycle_ == 257)
+    {
+        v_ = (v_ & ~VRAM_HORIZONTAL) | (t_ & VRAM_HORIZONTAL);
+    }
+    else if (scanline_ == PRE_RENDER_SCANLINE && cycle_ >= 280 && cycle_ <= 304)
+    {
+        v_ = (v_ & ~VRAM_VERTICAL) | (t_ & VRAM_VERTICAL);
+    }
+}
 
-        tile_x_ =       screen_local_pixel_x / NAMETABLE_TILE_SIZE;
-        tile_x_pixel_ = screen_local_pixel_x % NAMETABLE_TILE_SIZE;
-        tile_y_ =       screen_local_pixel_y / NAMETABLE_TILE_SIZE;
-        tile_y_pixel_ = screen_local_pixel_y % NAMETABLE_TILE_SIZE;
+void NesPPU::increment_coarse_x(uint16_t& v)
+{
+    if ((v & VRAM_COARSE_X) == VRAM_COARSE_X)
+    {
+        v &= ~VRAM_COARSE_X;
+        v ^= VRAM_NAMETABLE_X; // wrap into the horizontally adjacent nametable
     }
+    else
+    {
+        v++;
+    }
+}
 
-    nametable_ptr = nametable_base_address() + tile_x_ + tile_y_ * NAMETABLE_WIDTH;
+void NesPPU::increment_fine_y(uint16_t& v)
+{
+    if ((v & VRAM_FINE_Y) != VRAM_FINE_Y)
+    {
+        v += 0x1000;
+        return;
+    }
+    v &= ~VRAM_FINE_Y;
 
-    if (pixel_x_ >= 256)
+    uint16_t coarse_y = (v & VRAM_COARSE_Y) >> 5;
+    if (coarse_y == NAMETABLE_HEIGHT - 1)
+    {
+        coarse_y = 0;
+        v ^= VRAM_NAMETABLE_Y; // wrap into the vertically adjacent nametable
+    }
+    else if (coarse_y == 31)
     {
-        nametable_ptr ^= 0x0400;
+        coarse_y = 0; // coarse Y set out of bounds into the attribute table wraps without switching
     }
-    if (pixel_y_ >= 240)
+    else
     {
-        nametable_ptr ^= 0x0800;
+        coarse_y++;
     }
+    v = (v & ~VRAM_COARSE_Y) | (coarse_y << 5);
 }
 
 bool NesPPU::check_vblank_raising_edge() const
@@ -669,7 +1033,7 @@ bool NesPPU::check_vblank_raising_edge() const
 
 bool NesPPU::check_vblank_falling_edge() const
 {
-    return (scanline_ == 261 && cycle_ == 1);
+    return (scanline_ == PRE_RENDER_SCANLINE && cycle_ == 1);
 }
 
 bool NesPPU::is_rendering_scanline() const
@@ -679,7 +1043,8 @@ bool NesPPU::is_rendering_scanline() const
 
 bool NesPPU::check_rendering_falling_edge() const
 {
-    return (scanline_ == 239 && cycle_ == 340);
+    // the first dot after the last visible scanline, odd frames skip dot 340 of every line
+    return (scanline_ == 240 && cycle_ == 0);
 }
 
 bool NesPPU::is_rendering_enabled() const
@@ -689,7 +1054,7 @@ bool NesPPU::is_rendering_enabled() const
 
 uint16_t NesPPU::pattern_table_base_address()
 {
-    switch (read_register(PPUCTRL) & PPUCTRL_Backgroundtable_Select)
+    switch (registers_[PPUCTRL] & PPUCTRL_Backgroundtable_Select)
     {
         case 0:
             return 0x0000;
@@ -703,7 +1068,7 @@ uint16_t NesPPU::pattern_table_base_address()
 
 uint16_t NesPPU::nametable_base_address()
 {
-    switch (read_register(PPUCTRL) & PPUCTRL_Nametable_Select)
+    switch (registers_[PPUCTRL] & PPUCTRL_Nametable_Select)
     {
         case 0:
             return 0x2000;
@@ -721,26 +1086,11 @@ uint16_t NesPPU::nametable_base_address()
     return 0;
 }
 
-uint16_t NesPPU::nametable_base_address_for_pixel(uint16_t pixel_x, uint16_t pixel_y)
-{
-    uint16_t nt_base = cached_nametable_address_;
-
-    if (pixel_x >= 256)
-    {
-        nt_base ^= 0x0400;
-    }
-    if (pixel_y >= 240)
-    {
-        nt_base ^= 0x0800;
-    }
-    return nt_base;
-}
-
 uint16_t NesPPU::sprite_pattern_table_address(std::optional<uint8_t> tile_byte_1)
 {
     if (sprite_type() == SpriteType::Sprite_8x8)
     {
-        switch(read_register(PPUCTRL) & PPUCTRL_SpriteTable_Addr)
+        switch(registers_[PPUCTRL] & PPUCTRL_SpriteTable_Addr)
         {
             case 0:
                 return 0x0000;
@@ -761,7 +1111,7 @@ uint16_t NesPPU::sprite_pattern_table_address(std::optional<uint8_t> tile_byte_1
 
 NesPPU::SpriteType NesPPU::sprite_type()
 {
-    if (read_register(PPUCTRL) & PPUCTRL_SpriteSize_Select)
+    if (registers_[PPUCTRL] & PPUCTRL_SpriteSize_Select)
     {
         return SpriteType::Sprite_8x16;
     }
@@ -770,7 +1120,7 @@ NesPPU::SpriteType NesPPU::sprite_type()
 
 uint16_t NesPPU::ppu_addr_increment_amount()
 {
-    switch (read_register(PPUCTRL) & PPUCTRL_Incrmement_Direction)
+    switch (registers_[PPUCTRL] & PPUCTRL_Incrmement_Direction)
     {
         case 0:
             return 1; // increment horizontally across the buffer
@@ -782,16 +1132,6 @@ uint16_t NesPPU::ppu_addr_increment_amount()
     return 0;
 }
 
-uint8_t NesPPU::read(uint16_t a) const
-{
-    return internal_memory_[a];
-}
-
-uint8_t& NesPPU::write(uint16_t a)
-{
-    return internal_memory_[a];
-}
-
 uint8_t NesPPU::read_palette_ram(uint16_t a) const
 {
     return palette_ram_[a];
@@ -1,11 +1,18 @@
 #pragma once
 
 #include "io/display.hpp"
+#include "processor/ppu_access_log.hpp"
+#include "processor/ppu_page_table.hpp"
+#include "processor/scanline_counter.hpp"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <bit>
 #include <cstdint>
 #include <iostream>
 #include <memory>
+#include <span>
 
 class AddressBus;
 class PPUAddressBus;
@@ -22,15 +29,16 @@ public:
     static constexpr uint8_t  PPUCTRL_Backgroundtable_Select = 0x10;
     static constexpr uint8_t  PPUCTRL_SpriteSize_Select = 0x20;
     static constexpr uint16_t PPUMASK   = 0x2001;
-    static constexpr uint16_t PPUMASK_GREYSCALE   = 0x01; // TODO
-    static constexpr uint16_t PPUMASK_SHOW_BACKGROUND_LEFT_EDGE   = 0x02; // TODO
-    static constexpr uint16_t PPUMASK_SHOW_SPRITES_LEFT_EDGE   = 0x04; // TODO
-    static constexpr uint16_t PPUMASK_BACKGROUND   = 0x08; // TODO
-    static constexpr uint16_t PPUMASK_SPRITES   = 0x10; // TODO
-    static constexpr uint16_t PPUMASK_COLOR_EMPHASIS   = 0xE0; // TODO
+    static constexpr uint16_t PPUMASK_GREYSCALE   = 0x01;
+    static constexpr uint16_t PPUMASK_SHOW_BACKGROUND_LEFT_EDGE   = 0x02;
+    static constexpr uint16_t PPUMASK_SHOW_SPRITES_LEFT_EDGE   = 0x04;
+    static constexpr uint16_t PPUMASK_BACKGROUND   = 0x08;
+    static constexpr uint16_t PPUMASK_SPRITES   = 0x10;
+    static constexpr uint16_t PPUMASK_COLOR_EMPHASIS   = 0xE0;
     static constexpr uint16_t PPUSTATUS = 0x2002;
     static constexpr uint8_t  PPUSTATUS_vblank = 0x80;
     static constexpr uint8_t  PPUSTATUS_sprite0_hit = 0x40;
+    static constexpr uint8_t  PPUSTATUS_sprite_overflow = 0x20;
     static constexpr uint16_t OAMADDR   = 0x2003;
     static constexpr uint16_t OAMDATA   = 0x2004;
     static constexpr uint16_t PPUSCROLL = 0x2005;
@@ -40,73 +48,50 @@ public:
 
     static constexpr uint16_t SCANLINES = 262;
     static constexpr uint16_t PIXELS_PER_LINE = 341;
+    static constexpr uint16_t PRE_RENDER_SCANLINE = 261;
 
     static constexpr uint16_t NAMETABLE_WIDTH = 32;
     static constexpr uint16_t NAMETABLE_HEIGHT = 30;
     static constexpr uint16_t NAMETABLE_TILE_SIZE = 8;
 
-    using OAMMemory = std::array<uint8_t, 256>;
-    using PaletteRam = std::array<uint8_t, 0x20>;
-    using VideoMemory = std::array<uint8_t, 2 * 1024>;
-
+    static constexpr int32_t OAM_SPRITE_COUNT = 64;
+    static constexpr int32_t SPRITES_PER_SCANLINE = 8;
 
-    class OamDmaRegister
-    {
-    public:
-        uint8_t value() { return value_; }
-        bool had_write() { return had_write_; }
+    static constexpr uint8_t SPRITE_ATTR_FLIP_VERTICAL = 0x80;
+    static constexpr uint8_t SPRITE_ATTR_FLIP_HORIZONTAL = 0x40;
+    static constexpr uint8_t SPRITE_ATTR_BEHIND_BACKGROUND = 0x20;
 
-        void write(uint8_t v)
-        {
-            had_write_ = true;
-            value_ = v;
-        }
+    using OAMMemory = std::array<uint8_t, 256>;
+    using PaletteRam = std::array<uint8_t, 0x20>;
+    using VideoMemory = std::array<uint8_t, PPUPageTable::CIRAM_SIZE>;
 
-        void clear_write_flag()
-        {
-            had_write_ = false;
-        }
-
-    private:
-        uint8_t value_;
-        bool had_write_;
-    };
 
     class Registers
     {
         // Fast lookup for registers with [] notation. Relies on the PPU register addresses
-        // being contiguous from 0x2000 through 0x2007, special case for OAMDMA which is at
-        // 0x4014 and actually supposed to be handled by the main CPU.
+        // being contiguous from 0x2000 through 0x2007. Side effects of register accesses are
+        // applied by NesPPU::read_register and NesPPU::write_register.
 
     public:
         static constexpr int32_t REGISTER_COUNT = 8;
 
-        Registers() : values_(REGISTER_COUNT, 0x00), had_write_flags_(REGISTER_COUNT, false) {}
-
-        // Operator[] for assignment
-        uint8_t& operator[](uint16_t reg)
-        {
-            return values_[to_index(reg)];
-        }
-
+        uint8_t& operator[](uint16_t reg) { return values_[to_index(reg)]; }
         uint8_t operator[](uint16_t reg) const { return values_[to_index(reg)]; }
 
-        bool had_write(uint16_t reg) { return had_write_flags_[to_index(reg)]; }
-        void set_had_write(uint16_t reg) { had_write_flags_[to_index(reg)] = true; }
-
-        void clear_write_flag(int16_t reg)
-        {
-             had_write_flags_[to_index(reg)] = false;
-        }
-
     private:
         inline uint16_t to_index(uint16_t reg) const
         {
             return reg - 0x2000;
         }
 
-        std::vector<uint8_t> values_;
-        std::vector<bool> had_write_flags_;
+        std::array<uint8_t, REGISTER_COUNT> values_{};
+    };
+
+    enum class Mode
+    {
+        Full,       // timing and rendering
+        TimingOnly, // registers, vblank/NMI, sprite 0 hit and status flags, logs accesses
+        RenderOnly  // replays an access log from a TimingOnly PPU and draws the frames
     };
 
     enum class SpriteType
@@ -156,6 +141,27 @@ public:
     // Run and execute instructions from memory
     void run();
 
+    // Pipelined rendering. The PPU switches to TimingOnly and logs everything the renderer needs
+    // to the access log, which a RenderOnly PPU on another thread replays.
+    void set_access_log(PPUAccessLog* access_log);
+    void set_mode(Mode mode) { mode_ = mode; update_draw_pixels(); }
+
+    // Draw 1 of every frame_skip frames. The skipped frames keep everything the game can see
+    // (vblank/NMI, PPUSTATUS, sprite 0 hit, OAM and vram side effects) and only drop the pixel
+    // output, the same as TimingOnly. Takes effect at the next frame.
+    void set_frame_skip(int32_t frame_skip) { frame_skip_ = std::max(frame_skip, 1); }
+    int32_t frame_skip() const { return frame_skip_; }
+
+    // The mapper's scanline counter, clocked on the scanlines where A12 rises. nullptr for
+    // mappers without one.
+    void set_scanline_counter(ScanlineCounter* scanline_counter) { scanline_counter_ = scanline_counter; }
+
+    // number of dots since the PPU was created, timestamps the access log
+    uint64_t dot_count() const { return dot_count_; }
+
+    // number of the frame being drawn, incremented at the start of each frame
+    uint64_t frame() const { return frame_; }
+
     // Step the processor 1 cycle. Returns true if the processor should continue running
     bool step();
 
@@ -164,11 +170,14 @@ public:
     uint8_t read_register(uint16_t a);
     void write_register(uint16_t a, uint8_t v);
 
+    // OAM DMA, copies a page of CPU memory to OAM starting at OAMADDR. AddressBus reads the page
+    // when $4014 is written.
+    void oam_dma(std::span<const uint8_t, 256> page);
+
     const PPUAddressBus& cmemory() { return ppu_address_bus_; }
 
     // get the base address of the current nametable
     uint16_t nametable_base_address();
-    uint16_t nametable_base_address_for_pixel(uint16_t pixel_x, uint16_t pixel_y);
 
     // get the base address of the current pattern table
     uint16_t pattern_table_base_address();
@@ -178,15 +187,13 @@ public:
 
     SpriteType sprite_type();
 
-    // Get index into the pattern table for the provided pixel, retreived from the nametable
-    uint8_t get_pattern_tile_index_for_pixel(uint16_t pixel_x, uint16_t pixel_y);
-
     // Get the index into the color table from the pattern table tile
     uint8_t get_colortable_index_for_tile_and_pixel(uint16_t pattern_table_base_address,
                                                     uint16_t pixel_x, uint16_t pixel_y,
                                                     uint8_t pattern_tile_index) const;
-    // Determine which palette to use
-    uint8_t get_palette_index_for_pixel(uint16_t pixel_x, uint16_t pixel_y);
+
+    // Retrieve the system palette color (0x00 - 0x3F) for the provided palette and color table index
+    uint8_t fetch_system_color(uint8_t palette_index, uint8_t colortable_index) const;
 
     // Retrieve the RGB color for the provided palette and color table index
     NesDisplay::Color fetch_color_from_palette(uint8_t palette_index, uint8_t colortable_index) const;
@@ -194,42 +201,175 @@ public:
     // Retrieve sprite data from OAM memory
     Sprite sprite(uint16_t index);
 
+    // Sprites with decoded tile images, for the sprites debug window
+    std::vector<Sprite> debug_sprites();
+
 protected:
     friend class Nes;
     PPUAddressBus& memory() { return ppu_address_bus_; }
 
     friend class PPUAddressBus;
-    uint8_t read(uint16_t a) const;
-    uint8_t& write(uint16_t a);
+    uint8_t* ciram() { return internal_memory_.data(); }
     uint8_t read_palette_ram(uint16_t a) const;
     uint8_t& write_palette_ram(uint16_t a);
 
 private:
-    // Draws the background pixel for the current cycle
-    void render_pixel();
+    struct OamSprite
+    {
+        // maps to the data layout of oam data
+        uint8_t y_pos;
+        uint8_t tile_index;
+        uint8_t attributes;
+        uint8_t x_pos;
 
-    // Read oam sprite data
-    // Populates a list of Sprite structures with data from OAM
-    void read_sprite_oam();
+        bool operator==(const OamSprite&) const = default;
+    };
+    static_assert(sizeof(OamSprite) == 4);
 
-    // Draws all the foreground or background sprites at once
-    void render_sprites(Sprite::Layer layer);
+    struct ScanlineMask
+    {
+        // One bit per pixel of a scanline, pixel x is bit x % 64 of word x / 64
+        static constexpr int32_t BITS_PER_WORD = 64;
+        static constexpr int32_t WORDS = NesDisplay::WIDTH / BITS_PER_WORD;
 
-    // Make vram updates based on any activity on OAMADDR and OAMDATA
-    void handle_oam_data_register();
+        std::array<uint64_t, WORDS> words{};
 
-    // Make vram updates based on any activity on PPUADDR and PPUDATA
-    void handle_ppu_data_register();
-    uint8_t read_ppu_data();
+        static ScanlineMask all()
+        {
+            ScanlineMask m;
+            m.words.fill(~uint64_t(0));
+            return m;
+        }
 
-    // Make vram updates based on any activity on OAMDMA
-    void handle_oam_dma_register();
+        void clear() { words.fill(0); }
+        void set(int32_t x) { words[x / BITS_PER_WORD] |= uint64_t(1) << (x % BITS_PER_WORD); }
+        bool test(int32_t x) const { return (words[x / BITS_PER_WORD] >> (x % BITS_PER_WORD)) & 1; }
 
-    void handle_scroll_register();
+        // x of the first set bit, -1 if no bits are set
+        int32_t first_set() const
+        {
+            for (int32_t w = 0;w < WORDS;w++)
+            {
+                if (words[w])
+                {
+                    return w * BITS_PER_WORD + std::countr_zero(words[w]);
+                }
+            }
+            return -1;
+        }
+
+        ScanlineMask operator&(const ScanlineMask& o) const
+        {
+            ScanlineMask m;
+            for (int32_t w = 0;w < WORDS;w++) { m.words[w] = words[w] & o.words[w]; }
+            return m;
+        }
+
+        ScanlineMask operator~() const
+        {
+            ScanlineMask m;
+            for (int32_t w = 0;w < WORDS;w++) { m.words[w] = ~words[w]; }
+            return m;
+        }
+
+        ScanlineMask& operator&=(const ScanlineMask& o) { return *this = *this & o; }
+    };
+
+    // Line buffer pixels (background and sprites) pack the color table index and palette
+    // into one byte, which is also the index into the line palette. Opacity and sprite
+    // priority are kept in ScanlineMasks next to the line buffers.
+    static constexpr uint8_t PIXEL_COLORTABLE_MASK = 0x03;
+    static constexpr uint8_t PIXEL_PALETTE_MASK = 0x0C;
+    static constexpr uint8_t SPRITE_PALETTE_OFFSET = 0x10;
+
+    static constexpr uint32_t NO_SPRITE0_HIT = UINT32_MAX;
+    static constexpr uint32_t NO_A12_RISE = UINT32_MAX;
+
+    // Layout of the v and t vram address registers
+    // yyy NN YYYYY XXXXX
+    // ||| || ||||| +++++-- coarse X scroll
+    // ||| || +++++-------- coarse Y scroll
+    // ||| ++-------------- nametable select
+    // +++----------------- fine Y scroll
+    static constexpr uint16_t VRAM_COARSE_X = 0x001F;
+    static constexpr uint16_t VRAM_COARSE_Y = 0x03E0;
+    static constexpr uint16_t VRAM_NAMETABLE_X = 0x0400;
+    static constexpr uint16_t VRAM_NAMETABLE_Y = 0x0800;
+    static constexpr uint16_t VRAM_FINE_Y = 0x7000;
+    static constexpr uint16_t VRAM_HORIZONTAL = VRAM_NAMETABLE_X | VRAM_COARSE_X;
+    static constexpr uint16_t VRAM_VERTICAL = VRAM_FINE_Y | VRAM_NAMETABLE_Y | VRAM_COARSE_Y;
+
+    using LineBuffer = std::array<uint8_t, NesDisplay::WIDTH>;
+    using LinePalette = std::array<uint8_t, 0x20>;
+    using SecondaryOAM = std::array<OamSprite, SPRITES_PER_SCANLINE>;
+
+    // Inputs of a scanline compared with the previous frame to find dirty tiles. Changes to
+    // pattern data, the palette and the page table are tracked for the whole frame, nametable
+    // writes per tile.
+    struct LineState
+    {
+        uint16_t v{0xFFFF};
+        uint8_t x{0};
+        uint8_t ctrl{0};
+        uint8_t mask{0};
+
+        bool operator==(const LineState&) const = default;
+    };
+
+    struct LineSprites
+    {
+        int32_t count{0};
+        SecondaryOAM sprites{};
+    };
+
+    using NametableWriteFrames = std::array<std::array<uint64_t, NAMETABLE_WIDTH * NAMETABLE_HEIGHT>,
+                                            PPUPageTable::NAMETABLE_COUNT>;
+
+    const OamSprite& oam_sprite(int32_t index) const
+    {
+        return reinterpret_cast<const OamSprite*>(oam_memory_.data())[index];
+    }
+
+    // Draws the current scanline, merging the background and sprite line buffers
+    void render_scanline();
+
+    // Decodes the background of the current scanline into the background line buffer
+    void render_background_line();
+
+    // System colors for the background and sprite palettes
+    void update_line_palette();
+
+    void update_draw_pixels();
+
+    // Compares the scanline's inputs with the previous frame and marks its dirty tiles in the
+    // display. Returns the dirty tile columns.
+    uint32_t update_dirty_tiles();
+    uint32_t dirty_background_columns() const;
+    static uint32_t sprite_columns(const LineSprites& line_sprites);
+
+    // Record writes that change what gets drawn
+    void mark_vram_write(uint16_t addr);
+
+    // Finds the sprites on the current scanline (secondary OAM) and decodes them into the
+    // sprite line buffer. Sets the sprite overflow flag.
+    void evaluate_sprites();
 
     void increment_cycle();
-    void increment_nametable_x_offsets();
-    void increment_nametable_y_offsets();
+
+    // Events that happen at a dot of the scanline: the sprite 0 hit and the A12 rise clocking the
+    // scanline counter. Both are known at the start of the line, the earliest is kept in
+    // event_cycle_ so the dots in between only compare against it.
+    void schedule_scanline_events();
+    void run_scanline_events();
+
+    // Dot where A12 rises on the current scanline given the pattern tables of the background and
+    // sprites, NO_A12_RISE if it doesn't
+    uint32_t a12_rise_cycle() const;
+
+    // Copies from t and increments of v at the end of each rendered scanline
+    void update_vram_address();
+    static void increment_coarse_x(uint16_t& v);
+    static void increment_fine_y(uint16_t& v);
 
     // check the current scanline and cycle and return true if it represents the start or end
     // of vertical blanking
@@ -239,14 +379,15 @@ private:
     bool check_rendering_falling_edge() const;
     bool is_rendering_enabled() const;
 
-    // amount to increment PPUADDR after a write to PPUDATA
+    // amount to increment PPUADDR after an access to PPUDATA
     uint16_t ppu_addr_increment_amount();
-    
-    bool oamaddr_written_{false};
-    bool oamdata_written_{false};
-    bool ppuaddr_written_{false};
-    bool ppudata_written_{false};
-    bool oamdma_written_{false};
+
+    void log_access(PPUAccessLog::Access access, uint16_t address, uint8_t value = 0)
+    {
+        access_log_->append({.dot = dot_count_, .access = access, .value = value, .writable = false,
+                             .address = address, .offset = 0, .memory = nullptr});
+    }
+    void log_page_mapping(int32_t page, uint8_t* memory, bool writable);
 
     AddressBus& address_bus_;
     PPUAddressBus& ppu_address_bus_;
@@ -255,15 +396,49 @@ private:
     OAMMemory oam_memory_;
     bool& nmi_signal_;
 
+    Mode mode_{Mode::Full};
+    PPUAccessLog* access_log_{nullptr};
+
+    // set from the UI, prompt and agent threads
+    std::atomic<int32_t> frame_skip_{1};
+
+    // pixels are drawn this frame, decided by the mode and frame skip at the start of the frame
+    bool draw_pixels_{true};
+
     Registers registers_;
-    OamDmaRegister oam_dma_register_;
     VideoMemory internal_memory_;
     PaletteRam palette_ram_;
 
-    std::vector<Sprite> sprites_;
+    SecondaryOAM secondary_oam_;
+    int32_t secondary_oam_count_{0};
+    bool sprite_zero_on_line_{false};
+    LineBuffer sprite_line_;
+    ScanlineMask sprite_opaque_;
+    ScanlineMask sprite_behind_;
+    ScanlineMask sprite_zero_;
+
+    LineBuffer background_line_;
+    ScanlineMask background_opaque_;
+
+    LinePalette line_palette_;
+
+    // dot on the current scanline where the sprite 0 hit flag gets set
+    uint32_t sprite0_hit_cycle_{NO_SPRITE0_HIT};
+
+    ScanlineCounter* scanline_counter_{nullptr};
+    uint32_t a12_rise_cycle_{NO_A12_RISE};
+
+    // the earlier of the two above
+    uint32_t event_cycle_{NO_SPRITE0_HIT};
 
-    uint16_t cached_nametable_address_{0};
-    uint16_t cached_patterntable_address{0};
+    // dirty tile tracking
+    std::array<LineState, NesDisplay::HEIGHT> line_states_;
+    std::array<LineSprites, NesDisplay::HEIGHT> line_sprites_;
+    NametableWriteFrames nametable_write_frames_{};
+    uint64_t global_change_frame_{0};    // last frame with a pattern, palette or mapping change
+    uint64_t published_frame_{UINT64_MAX}; // last frame handed to the display
+    uint64_t drawn_frame_{UINT64_MAX};     // last frame drawn, published or not
+    uint64_t page_table_generation_{0};
 
     // scanline_
     // 0-239 rendering
@@ -273,25 +448,20 @@ private:
     uint32_t    cycle_{341};
     uint32_t    scanline_{260};
     uint64_t    frame_{0};
-
-    uint16_t nametable_ptr{0};
-    uint16_t pixel_x_;
-    uint16_t pixel_y_;
-    uint16_t tile_x_;
-    int16_t tile_x_pixel_;
-    uint16_t tile_y_;
-    uint16_t tile_y_pixel_;
-
-    uint16_t oam_data_addr_{0};
-    uint64_t oam_addr_write_count{0};
-
-    // write latch for tracking first vs second write. it is shared between PPUADDR and PPUSCROLL
-    // is reset by reads from PPUSTATUS
-    uint64_t write_latch_{0};
-
-    uint16_t ppu_data_addr_{0};
-
-    std::pair<int32_t, int32_t> scroll_;
-    int32_t pending_scroll_x_{0};
-    int32_t pending_scroll_y_{0};
+    uint64_t    dot_count_{0};
+
+    uint8_t oam_addr_{0};
+
+    // Internal registers https://www.nesdev.org/wiki/PPU_scrolling
+    // v: current vram address (15 bits), t: temporary vram address, the top left of the screen
+    // x: fine x scroll (3 bits)
+    // w: write latch for tracking first vs second write. it is shared between PPUADDR and
+    //    PPUSCROLL and is reset by reads from PPUSTATUS
+    uint16_t v_{0};
+    uint16_t t_{0};
+    uint8_t x_{0};
+    bool w_{false};
+
+    // PPUDATA reads outside of palette ram return the contents of this buffer, then refill it
+    uint8_t ppu_data_read_buffer_{0};
 };
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "processor/ppu_page_table.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+class PPUAccessLog
+{
+    // Everything that can change what the PPU draws, in the order it happened and stamped with
+    // the PPU dot it happened on: register accesses with side effects (OAM DMA is logged as the
+    // OAMDATA writes it performs), PPU page table mapping changes and resets. A second PPU that
+    // replays the log dot for dot ends up in the same state and draws the same frame.
+public:
+    enum class Access : uint8_t
+    {
+        RegisterWrite, // address: register, value: data written
+        RegisterRead,  // address: register
+        MapCiram,      // address: page, offset: offset into the 2KB of CIRAM
+        MapChr,        // address: page, memory: cartridge memory, writable: CHR-RAM,
+                       // offset: the page's contents in pages_ when writable
+        Reset,
+    };
+
+    struct Entry
+    {
+        uint64_t dot;
+        Access access;
+        uint8_t value;
+        bool writable;
+        uint16_t address;
+        uint16_t offset;
+        uint8_t* memory;
+    };
+
+    using Page = std::array<uint8_t, PPUPageTable::PAGE_SIZE>;
+
+    virtual ~PPUAccessLog() = default;
+
+    void append(const Entry& entry) { entries_.push_back(entry); }
+
+    // Writable memory keeps changing after it is logged, the replaying PPU starts its own copy
+    // from the contents at the time of the mapping. Returns the index for the entry's offset.
+    uint16_t snapshot_page(const uint8_t* memory)
+    {
+        Page& page = pages_.emplace_back();
+        std::copy(memory, memory + page.size(), page.begin());
+        return static_cast<uint16_t>(pages_.size() - 1);
+    }
+
+    // Called by the logging PPU when it reaches the end of a frame, dot is its current dot
+    virtual void end_frame(uint64_t dot) = 0;
+
+protected:
+    std::vector<Entry> entries_;
+    std::vector<Page> pages_;
+};
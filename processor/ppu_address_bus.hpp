@@ -2,6 +2,7 @@
 
 #include "io/cartridge.hpp"
 #include "processor/nes_ppu.hpp"
+#include "processor/ppu_page_table.hpp"
 
 #include <array>
 #include <cstdint>
@@ -34,23 +35,13 @@ public:
     {
         assert(a >= 0 && a < ADDRESSABLE_MEMORY_SIZE);
 
-        if (a < 0x2000) // cartridge
+        if (a >= 0x3F00) // Palette RAM indices
         {
-            return cartridge_->ppu_read(a);
-        }
-        else if (a <= 0x3EFF) // video memory
-        {
-            return ppu_->read(handle_nametable_mirroring(a, vertical_mirroring_));
-        }
-        else if (a >= 0x3F00 && a < 0x4000) // Palette RAM indices
-        {
-            // return palette_ram_[(a - 0x3F00) % 0x20];
             return ppu_->read_palette_ram((a - 0x3F00) % 0x20);
         }
 
-        assert(false);
-        static uint8_t dummy = 0;
-        return dummy;
+        // cartridge chr and video memory (nametables)
+        return page_table_.read(a);
     }
 
     // returns reference to memory to be written
@@ -58,18 +49,13 @@ public:
     {
         assert(a >= 0 && a < ADDRESSABLE_MEMORY_SIZE);
 
-        if (a < 0x2000) // cartridge
-        {
-            cartridge_->write(a, v);
-        }
-        else if (a <= 0x3EFF) // video memory
-        {
-            ppu_->write(handle_nametable_mirroring(a, vertical_mirroring_)) = v;
-        }
-        else if (a >= 0x3F00 && a < 0x4000) // Palette RAM indices
+        if (a >= 0x3F00) // Palette RAM indices
         {
             ppu_->write_palette_ram((a - 0x3F00) % 0x20) = v;
+            return;
         }
+
+        page_table_.write(a, v);
     }
 
     const uint8_t operator [] (int i) const
@@ -97,54 +83,21 @@ public:
 
     void attach_cartridge(std::shared_ptr<Cartridge> cartridge)
     {
+        // the cartridge maps its chr banks and the nametables on reset and bank switches
         cartridge_ = cartridge;
-        vertical_mirroring_ = cartridge_->vertical_nametable_mirroring();
+        cartridge_->attach_ppu_page_table(page_table_);
     }
-    void attach_ppu(std::shared_ptr<NesPPU> ppu) { ppu_ = ppu; }
-
-private:
-    uint16_t handle_nametable_mirroring(uint16_t addr, bool vertical_mirroring) const
+    void attach_ppu(std::shared_ptr<NesPPU> ppu)
     {
-        // There are two levels of mirroring. The 4 nametable address space 0x2000 - 0x2FFF is
-        // mirrored to the memory above it. Then the 4 nametable address spaces are reflected to
-        // only 2 banks of 0x400 sized vram.
-
-        // $2000-$23FF $0400   Nametable 0
-        // $2400-$27FF $0400   Nametable 1
-        // $2800-$2BFF $0400   Nametable 2
-        // $2C00-$2FFF $0400   Nametable 3
-        // $3000-$3EFF $0F00   Mirrors of $2000-$2EFF
-
-        const uint16_t addr_unmirrored = addr >= 0x3000 ? addr - 0x1000 : addr; // shift everything to 0x2000 space
-        const uint16_t nametable_number = (addr_unmirrored - 0x2000) / 0x400;
-        const uint16_t nametable_offset = addr_unmirrored % 0x400;
-
-        if (vertical_mirroring)
-        {
-            // vertical mirroring
-            // A = nametable 0,1
-            // B = nametable 2,3
-
-            static const std::array<int32_t, 4> vertical_mirroring_vram_map = {0x0, 0x0, 0x400, 0x400};
-
-            // map to physical vram
-            return vertical_mirroring_vram_map[nametable_number] + nametable_offset;
-        }
-        else
-        {
-            // horizontal mirroring
-            // A = nametable 0,2
-            // B = nametable 1,4
-
-            static const std::array<int32_t, 4> vertical_mirroring_vram_map = {0x0, 0x400, 0x00, 0x400};
-
-            // map to physical vram
-            return vertical_mirroring_vram_map[nametable_number] + nametable_offset;
-        }
+        ppu_ = ppu;
+        page_table_.set_ciram(ppu_->ciram());
     }
 
+    PPUPageTable& page_table() { return page_table_; }
+
+private:
     std::shared_ptr<Cartridge> cartridge_;
     std::shared_ptr<NesPPU> ppu_;
 
-    bool vertical_mirroring_{false};
+    PPUPageTable page_table_;
 };
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <span>
+
+class PPUPageTable
+{
+    // The PPU address space below the palette ($0000 - $3EFF) as 16 pages of 1KB, each a direct
+    // pointer into host memory. Pages 0-7 are the pattern tables (CHR-ROM/RAM banks), pages 8-11
+    // the nametables and pages 12-15 mirror the nametables. The cartridge reprograms the pages
+    // when it switches banks or changes the nametable mirroring, so a PPU fetch is a shift, an
+    // index and a load.
+    //
+    // Reads and writes have separate tables. Pages that are read only (CHR-ROM) have their
+    // write pointer aimed at a sink page, so writes never need to check.
+public:
+    static constexpr int32_t PAGE_SHIFT = 10;
+    static constexpr int32_t PAGE_SIZE = 1 << PAGE_SHIFT;
+    static constexpr uint16_t PAGE_MASK = PAGE_SIZE - 1;
+    static constexpr int32_t PAGE_COUNT = 16;
+    static constexpr int32_t CHR_PAGE_COUNT = 8;
+    static constexpr int32_t NAMETABLE_PAGE = 8;
+    static constexpr int32_t NAMETABLE_MIRROR_PAGE = 12;
+    static constexpr int32_t NAMETABLE_COUNT = 4;
+
+    // 2KB of vram inside the NES, holds two nametables
+    static constexpr int32_t CIRAM_SIZE = 2 * PAGE_SIZE;
+
+    // Using the nesdev wiki names, which describe the arrangement of the mirrored nametables
+    // https://www.nesdev.org/wiki/Mirroring#Nametable_Mirroring
+    enum class NametableMirroring
+    {
+        Horizontal,        // $2000 = $2400, $2800 = $2C00
+        Vertical,          // $2000 = $2800, $2400 = $2C00
+        SingleScreenLower, // all nametables are the first 1KB of CIRAM
+        SingleScreenUpper, // all nametables are the second 1KB of CIRAM
+        FourScreen         // nametables 2 and 3 are 2KB of extra vram on the cartridge
+    };
+
+    PPUPageTable()
+    {
+        read_pages_.fill(unmapped_page_.data());
+        write_pages_.fill(sink_page_.data());
+    }
+
+    uint8_t read(uint16_t a) const { return read_pages_[(a >> PAGE_SHIFT) & 0x0F][a & PAGE_MASK]; }
+    void write(uint16_t a, uint8_t v) { write_pages_[(a >> PAGE_SHIFT) & 0x0F][a & PAGE_MASK] = v; }
+
+    // Map consecutive 1KB pages of CHR memory starting at a pattern table address
+    void map_chr(uint16_t address, std::span<uint8_t> memory, bool writable)
+    {
+        assert(address % PAGE_SIZE == 0 && memory.size() % PAGE_SIZE == 0);
+
+        const int32_t first_page = address >> PAGE_SHIFT;
+        const int32_t page_count = static_cast<int32_t>(memory.size() / PAGE_SIZE);
+
+        for (int32_t i = 0;i < page_count && first_page + i < CHR_PAGE_COUNT;++i)
+        {
+            map_page(first_page + i, memory.data() + i * PAGE_SIZE, writable);
+        }
+    }
+
+    void set_ciram(uint8_t* ciram) { ciram_ = ciram; }
+    uint8_t* ciram() const { return ciram_; }
+
+    const uint8_t* page(int32_t page) const { return read_pages_[page]; }
+
+    // incremented by every mapping change
+    uint64_t generation() const { return generation_; }
+
+    // Map all four nametables for the mirroring. extra_vram is only used for four screen.
+    void map_nametables(NametableMirroring mirroring, uint8_t* extra_vram = nullptr)
+    {
+        // 1KB page backing each nametable, 0-1 are CIRAM and 2-3 the cartridge's extra vram
+        static constexpr std::array<std::array<int32_t, NAMETABLE_COUNT>, 5> LAYOUTS =
+        {{
+            {0, 0, 1, 1}, // Horizontal
+            {0, 1, 0, 1}, // Vertical
+            {0, 0, 0, 0}, // SingleScreenLower
+            {1, 1, 1, 1}, // SingleScreenUpper
+            {0, 1, 2, 3}, // FourScreen
+        }};
+        assert(ciram_);
+        assert(mirroring != NametableMirroring::FourScreen || extra_vram);
+
+        const std::array<int32_t, NAMETABLE_COUNT>& layout = LAYOUTS[static_cast<int32_t>(mirroring)];
+
+        for (int32_t n = 0;n < NAMETABLE_COUNT;++n)
+        {
+            uint8_t* page = layout[n] < 2 ? ciram_ + layout[n] * PAGE_SIZE
+                                          : extra_vram + (layout[n] - 2) * PAGE_SIZE;
+            map_nametable(n, page);
+        }
+    }
+
+    // Map a single nametable (0-3) to 1KB of vram, for mappers with their own nametable control
+    void map_nametable(int32_t nametable, uint8_t* memory)
+    {
+        assert(nametable >= 0 && nametable < NAMETABLE_COUNT);
+
+        // $3000 - $3EFF mirror $2000 - $2EFF
+        map_page(NAMETABLE_PAGE + nametable, memory, true);
+        map_page(NAMETABLE_MIRROR_PAGE + nametable, memory, true);
+    }
+
+    // Point a page at 1KB of host memory, all of the mapping functions end up here
+    void map_page(int32_t page, uint8_t* memory, bool writable)
+    {
+        assert(page >= 0 && page < PAGE_COUNT);
+
+        read_pages_[page] = memory;
+        write_pages_[page] = writable ? memory : sink_page_.data();
+        generation_++;
+
+        if (mapping_observer_)
+        {
+            mapping_observer_(page, memory, writable);
+        }
+    }
+
+    // Notified of every page mapping change, used to log them for pipelined rendering
+    using MappingObserver = std::function<void(int32_t page, uint8_t* memory, bool writable)>;
+    void set_mapping_observer(MappingObserver observer) { mapping_observer_ = observer; }
+
+private:
+    std::array<const uint8_t*, PAGE_COUNT> read_pages_;
+    std::array<uint8_t*, PAGE_COUNT> write_pages_;
+
+    uint8_t* ciram_{nullptr};
+    uint64_t generation_{0};
+
+    MappingObserver mapping_observer_;
+
+    std::array<uint8_t, PAGE_SIZE> unmapped_page_{}; // reads 0, never written
+    std::array<uint8_t, PAGE_SIZE> sink_page_{};     // absorbs writes to read only pages
+};
@@ -65,6 +65,8 @@ void Processor6502::reset()
 
     pending_operation_.reset();
     cycles_to_wait_ = 0;
+    oam_dma_pending_ = false;
+    irq_line_.clear();
 }
 
 void Processor6502::run()
@@ -95,7 +97,7 @@ bool Processor6502::step()
         return false;
     }
 
-    if (check_nmi())
+    if (check_interrupts())
     {
         // BRK was inserted as the next operation, do not touch the PC
         should_continue = false; // DEBUG
@@ -113,6 +115,14 @@ bool Processor6502::step()
 
         cycles_to_wait_ += execute_instruction(pending_operation_);
 
+        if (oam_dma_pending_)
+        {
+            const uint64_t dma_start_cycle = cycle_count_ + cycles_to_wait_;
+
+            cycles_to_wait_ += OAM_DMA_CYCLES + (dma_start_cycle % 2);
+            oam_dma_pending_ = false;
+        }
+
         should_continue = check_watchpoints(pending_operation_);
 
         pending_operation_.reset();
@@ -349,20 +359,32 @@ bool Processor6502::ready_to_execute(const Instruction& pending_op)
     return instr_table_[pending_op.opcode()].bytes == pending_op.values.size();
 }
 
-bool Processor6502::check_nmi()
+bool Processor6502::check_interrupts()
 {
-    if (!non_maskable_interrupt_  || pending_operation_.values.size())
+    if (pending_operation_.values.size())
     {
-        // do not break until NMI and the currently queued operation is complete
+        // do not break until the currently queued operation is complete
         return false;
     }
 
-    assert(pending_operation_.values.size() == 0);
-    pending_operation_.values.push_back(0x00); // break
-    pending_operation_.nmi = true;
+    if (non_maskable_interrupt_)
+    {
+        pending_operation_.values.push_back(0x00); // break
+        pending_operation_.nmi = true;
+
+        non_maskable_interrupt_ = false;
+        return true;
+    }
 
-    non_maskable_interrupt_ = false;
-    return true;
+    // IRQ is level triggered, the line stays asserted until the device is acknowledged and
+    // the I flag set by the BRK keeps the handler from being interrupted again
+    if (irq_line_.asserted() && !registers_.is_status_register_flag_set(Registers::INTERRUPT_DISABLE_FLAG))
+    {
+        pending_operation_.values.push_back(0x00); // break
+        pending_operation_.irq = true;
+        return true;
+    }
+    return false;
 }
 
 bool Processor6502::check_breakpoints()
@@ -5,6 +5,7 @@
 
 #include "processor/instructions.hpp"
 #include "processor/address_bus.hpp"
+#include "processor/irq_line.hpp"
 
 #include <array>
 #include <cassert>
@@ -147,6 +148,7 @@ struct Instruction
 	AddressingMode addr_mode{AddressingMode::INVALID};
 	bool fetch_crossed_page_boundary{false};
 	bool nmi{false};
+	bool irq{false};
 
 	uint8_t opcode() const { return values[0]; }
 	uint8_t data() const { return values[1]; }
@@ -158,6 +160,7 @@ struct Instruction
         addr_mode = AddressingMode::INVALID;
 		fetch_crossed_page_boundary = false;
 		nmi = false;
+		irq = false;
 	}
 };
 
@@ -232,6 +235,9 @@ public:
 	uint64_t instruction_count() { return instr_count_; }
 	uint64_t cycle_count() { return cycle_count_; }
 
+	// The /IRQ input, devices that raise interrupts (mappers) set and release it
+	IrqLine& irq_line() { return irq_line_; }
+
 	// Generates an instruction that is ready to execute for the provided assembly string
 	Instruction assemble_instruction(std::string inst_string);
 
@@ -242,6 +248,7 @@ protected:
 	friend class Test6502;
 	friend class Nes;
 	friend class CommandPrompt;
+	friend class NsfPlayer;
 	AddressBus& memory() { return address_bus_; }
 	Registers& registers() { return registers_; }
 
@@ -253,12 +260,16 @@ protected:
 
 	void set_non_maskable_interrupt() { non_maskable_interrupt_ = true; }
 
+	// The CPU is halted for OAM DMA from the end of the instruction that wrote $4014
+	void halt_for_oam_dma() { oam_dma_pending_ = true; }
+
 private:
 	// Check whether all of the data has been loaded for the pending instruction
 	bool ready_to_execute(const Instruction& pending_op);
 
-	// Insert a BRK if the NMI flag is set, prior to running the next instruction
-	bool check_nmi();
+	// Insert a BRK if the NMI flag is set, or the IRQ line is asserted and interrupts are enabled,
+	// prior to running the next instruction
+	bool check_interrupts();
 
 	// returns true if execution should continue, false if a breakpoint has been hit
 	bool check_breakpoints();
@@ -273,9 +284,15 @@ private:
 
 	int32_t cycles_to_wait_{0};
 
+	// 1 cycle waiting for the write to $4014 to finish, then 256 read and write pairs. DMA reads
+	// happen on even cycles, starting on an odd cycle costs one more to align.
+	static constexpr int32_t OAM_DMA_CYCLES = 513;
+	bool oam_dma_pending_{false};
+
 	AddressBus& address_bus_;
 	Registers registers_{};
 	bool& non_maskable_interrupt_;
+	IrqLine irq_line_;
 
     CPUMemory internal_memory_;
     int32_t internal_memory_size_;
@@ -0,0 +1,15 @@
+#pragma once
+
+class ScanlineCounter
+{
+    // Mappers that count scanlines by watching the PPU's A12 address line (MMC3). The PPU doesn't
+    // fetch pattern data dot by dot, so instead of every address it works out from the pattern
+    // table selection whether A12 rises on a scanline and at which dot, and clocks the counter
+    // once there. The usual setup, background at $0000 and sprites at $1000, rises once per
+    // scanline at dot 260 when the sprite fetches start.
+public:
+    virtual ~ScanlineCounter() = default;
+
+    // A12 rose on a rendered scanline (0 - 239 or the pre-render line) with rendering enabled
+    virtual void clock_scanline_counter() = 0;
+};
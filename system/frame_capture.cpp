@@ -0,0 +1,158 @@
+#include "system/frame_capture.hpp"
+
+#include <fstream>
+
+#include <glog/logging.h>
+
+FrameCapture::FrameCapture(NesDisplay& display, std::shared_ptr<AgentInterface> agent_interface)
+: display_(display)
+, agent_interface_(agent_interface)
+{
+    display_.add_consumer(&snapshot_.frames);
+    display_.add_consumer(&agent_.frames);
+
+    thread_ = std::make_shared<std::thread>(&FrameCapture::capture_loop, this);
+}
+
+FrameCapture::~FrameCapture()
+{
+    {
+        std::scoped_lock lock(requests_lock_);
+        shutdown_ = true;
+    }
+    requests_changed_.notify_all();
+
+    thread_->join();
+
+    display_.remove_consumer(&snapshot_.frames);
+    display_.remove_consumer(&agent_.frames);
+}
+
+void FrameCapture::request_snapshot(std::string path_base, nlohmann::json metadata)
+{
+    queue_request({.type = Type::Snapshot, .path_base = std::move(path_base), .metadata = std::move(metadata)});
+}
+
+void FrameCapture::request_agent_screenshot()
+{
+    {
+        std::scoped_lock lock(requests_lock_);
+
+        // the agent only wants the newest frame, one queued request covers it
+        if (agent_request_queued_)
+        {
+            return;
+        }
+        agent_request_queued_ = true;
+        requests_.push({.type = Type::Agent});
+    }
+    requests_changed_.notify_one();
+}
+
+void FrameCapture::queue_request(Request request)
+{
+    {
+        std::scoped_lock lock(requests_lock_);
+        requests_.push(std::move(request));
+    }
+    requests_changed_.notify_one();
+}
+
+void FrameCapture::capture_loop()
+{
+    while (true)
+    {
+        Request request;
+        {
+            std::unique_lock lock(requests_lock_);
+
+            requests_changed_.wait(lock, [this]() { return !requests_.empty() || shutdown_; });
+
+            if (shutdown_)
+            {
+                return;
+            }
+            request = std::move(requests_.front());
+            requests_.pop();
+
+            if (request.type == Type::Agent)
+            {
+                agent_request_queued_ = false;
+            }
+        }
+
+        switch (request.type)
+        {
+            case Type::Snapshot:
+                write_snapshot(request);
+                break;
+
+            case Type::Agent:
+                send_agent_screenshot();
+                break;
+        }
+    }
+}
+
+void FrameCapture::write_snapshot(const Request& request)
+{
+    const QByteArray& png = encode_png(snapshot_);
+
+    std::ofstream img_output(request.path_base + ".png", std::ios::binary);
+    img_output.write(png.constData(), png.size());
+    bool success = !png.isEmpty() && img_output.good();
+
+    LOG_IF(ERROR, !success) << "failed to write snapshot";
+
+    std::ofstream metadata_output(request.path_base + ".json");
+    metadata_output << request.metadata.dump(4);
+}
+
+void FrameCapture::send_agent_screenshot()
+{
+    const QByteArray& byte_array = encode_png(agent_);
+
+    std::vector<int8_t> image_data(byte_array.begin(), byte_array.end());
+    LOG(INFO) << "qbytearray size " << byte_array.size() << " " << image_data.size();
+
+    agent_interface_->send_screenshot(std::move(image_data));
+}
+
+const QByteArray& FrameCapture::encode_png(Consumer& consumer)
+{
+    // keep the frame already held when nothing newer was published
+    if (FrameRef frame = consumer.frames.take())
+    {
+        consumer.frame = std::move(frame);
+    }
+
+    if (!consumer.frame)
+    {
+        consumer.png.clear();
+        return consumer.png;
+    }
+
+    const Scaler scaler = consumer.frames.scaler();
+    const bool ntsc_filter = consumer.frames.ntsc_filter();
+
+    if (consumer.png_frame != UINT64_MAX && !consumer.frame->changed_since(consumer.png_frame) &&
+        consumer.png_scaler == scaler && consumer.png_ntsc_filter == ntsc_filter)
+    {
+        return consumer.png;
+    }
+
+    const NesDisplay::Color* pixels = rgba_.update(*consumer.frame, scaler, ntsc_filter);
+
+    QImage image((const uchar*)pixels, rgba_.width(), rgba_.height(), QImage::Format_RGBA8888);
+
+    consumer.png.clear();
+    QBuffer buffer(&consumer.png);
+    buffer.open(QIODevice::WriteOnly);
+
+    image.save(&buffer, "PNG");
+
+    consumer.png_frame = consumer.frame->number();
+    consumer.png_scaler = scaler;
+    consumer.png_ntsc_filter = ntsc_filter;
+    return consumer.png;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "agent/agent_interface.hpp"
+#include "io/display.hpp"
+#include "io/frame_pool.hpp"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+
+#include <nlohmann/json.hpp>
+
+class FrameCapture
+{
+    // The snapshot and agent screenshot consumers of the display's frames. The emulation thread
+    // decides when a capture is due and queues a request. PNG encoding, file writes and sending
+    // to the agent happen on the capture thread, from the newest frame in that consumer's
+    // mailbox, so the emulation never waits on them.
+public:
+    FrameCapture(NesDisplay& display, std::shared_ptr<AgentInterface> agent_interface);
+    ~FrameCapture();
+
+    // Writes <path_base>.png and <path_base>.json with the metadata
+    void request_snapshot(std::string path_base, nlohmann::json metadata);
+    void request_agent_screenshot();
+
+private:
+    enum class Type
+    {
+        Snapshot,
+        Agent
+    };
+
+    struct Request
+    {
+        Type type;
+        std::string path_base;
+        nlohmann::json metadata;
+    };
+
+    // A consumer's mailbox, the frame it last took and that frame encoded as PNG
+    struct Consumer
+    {
+        explicit Consumer(std::string_view name) : frames(name) {}
+
+        FrameMailbox frames;
+        FrameRef frame;
+
+        uint64_t png_frame{UINT64_MAX};
+        Scaler png_scaler{Scaler::None};
+        bool png_ntsc_filter{false};
+        QByteArray png;
+    };
+
+    void capture_loop();
+    void queue_request(Request request);
+
+    void write_snapshot(const Request& request);
+    void send_agent_screenshot();
+
+    // PNG of the newest frame the consumer has. PNG can't be updated in place for the dirty
+    // tiles, but an unchanged frame (paused game, static screen) reuses the previous encode.
+    const QByteArray& encode_png(Consumer& consumer);
+
+    NesDisplay& display_;
+    std::shared_ptr<AgentInterface> agent_interface_;
+
+    Consumer snapshot_{"snapshot"};
+    Consumer agent_{"agent"};
+    RGBAFrameBuffer rgba_;
+
+    std::mutex requests_lock_;
+    std::condition_variable requests_changed_;
+    std::queue<Request> requests_;
+    bool agent_request_queued_{false};
+    bool shutdown_{false};
+
+    std::shared_ptr<std::thread> thread_;
+};
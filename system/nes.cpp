@@ -1,5 +1,6 @@
 #include "nes.hpp"
 
+#include "config/flags.hpp"
 #include "platform/ui_properties.hpp"
 #include "minitrace.h"
 
@@ -33,6 +34,12 @@ Nes::Nes(std::shared_ptr<Cartridge> cartridge)
 
     ppu_address_bus_.attach_ppu(ppu_);
 
+    if constexpr (ENABLE_PIPELINED_PPU_RENDERING)
+    {
+        ppu_render_thread_ = std::make_unique<PPURenderThread>(address_bus_, display_);
+        ppu_->set_access_log(ppu_render_thread_.get());
+    }
+
     load_cartridge(cartridge);
     display_.init();
 
@@ -43,6 +50,7 @@ Nes::Nes(std::shared_ptr<Cartridge> cartridge)
     apu_->start();
 
     agent_interface_ = std::make_shared<AgentInterface>();
+    frame_capture_ = std::make_unique<FrameCapture>(display_, agent_interface_);
 }
 
 Nes::~Nes()
@@ -51,25 +59,53 @@ Nes::~Nes()
 
 bool Nes::load_cartridge(std::shared_ptr<Cartridge> cartridge)
 {
-    bool success = true;
+    // a ROM that couldn't be opened or has an unsupported mapper leaves the current one loaded
+    if (!cartridge || !cartridge->valid())
+    {
+        return false;
+    }
 
     user_interrupt();
 
-    cartridge_ = cartridge;
-    if (cartridge_ && cartridge_->valid())
+    if (ppu_render_thread_)
     {
-        address_bus_.attach_cartridge(cartridge_);
-        ppu_address_bus_.attach_cartridge(cartridge_);
+        // queued frames reference the memory of the current cartridge
+        ppu_render_thread_->flush();
+    }
 
-        cartridge_->reset();
-        processor_->reset();
-        ppu_->reset();
-        apu_->reset();
+    ppu_->set_scanline_counter(nullptr);
 
-        update_state(State::IDLE);
+    if (cartridge_)
+    {
+        // reloading the running game, its save file is still locked by the current cartridge
+        cartridge->take_save_file(*cartridge_);
     }
+    cartridge_ = cartridge;
+    address_bus_.attach_cartridge(cartridge_);
+    ppu_address_bus_.attach_cartridge(cartridge_);
+    cartridge_->attach_irq_line(processor_->irq_line());
+    ppu_->set_scanline_counter(cartridge_->scanline_counter());
+
+    cartridge_->reset();
+    processor_->reset();
+    ppu_->reset();
+    apu_->reset();
+
+    update_state(State::IDLE);
 
-    return success;
+    return true;
+}
+
+void Nes::add_cheat(const CPUPageTable::Patch& patch)
+{
+    user_interrupt();
+    address_bus_.page_table().add_patch(patch);
+}
+
+void Nes::clear_cheats()
+{
+    user_interrupt();
+    address_bus_.page_table().clear_patches();
 }
 
 void Nes::run()
@@ -115,6 +151,8 @@ bool Nes::step()
     }
     check_capture_snapshot();
     check_send_screenshot_to_agent();
+    check_agent_settings();
+    check_sync_battery_ram();
 
     return should_continue;
 }
@@ -146,6 +184,20 @@ void Nes::user_interrupt()
     }
 }
 
+void Nes::check_sync_battery_ram()
+{
+    if (ppu_->frame() == battery_ram_sync_frame_)
+    {
+        return;
+    }
+    battery_ram_sync_frame_ = ppu_->frame();
+
+    if (cartridge_)
+    {
+        cartridge_->sync_battery_ram();
+    }
+}
+
 void Nes::check_capture_snapshot()
 {
     if (snapshot_interval_ticks_ == 0)
@@ -167,13 +219,6 @@ void Nes::check_capture_snapshot()
     {
         last_snapshot_ticks_ = clock_ticks_;
 
-        // write snapshot
-        std::scoped_lock lock(display_.display_buffer_lock());
-
-        QImage image((const uchar*)display_.display_buffer(),
-                     NesDisplay::WIDTH, NesDisplay::HEIGHT,
-                     QImage::Format_RGBA8888);
-
         std::stringstream ts;
         {
             auto now = std::chrono::system_clock::now();
@@ -189,17 +234,7 @@ void Nes::check_capture_snapshot()
         std::stringstream file_basename;;
         file_basename << "nes_screenshot_" << ts.str();
 
-        std::stringstream img_path;
-        img_path << snapshots_directory_ << file_basename.str() << ".png";
-
-        bool success = image.save(img_path.str().c_str(), "PNG");
-
-        LOG_IF(ERROR, !success) << "failed to write snapshot";
-
-        // write metadata
-        std::stringstream metadata_path;
-        metadata_path << snapshots_directory_ << file_basename.str() << ".json";
-
+        // metadata, the png and json are written on the capture thread
         json j;
         j["timestamp"] = ts.str();
         j["image"] = std::string(file_basename.str() + ".png");
@@ -214,8 +249,7 @@ void Nes::check_capture_snapshot()
         j["buttons"]["select"]  = is_button_pressed(Joypads::Button::Select);
         j["buttons"]["start"]   = is_button_pressed(Joypads::Button::Start);
 
-        std::ofstream metadata_output(metadata_path.str());
-        metadata_output << j.dump(4);
+        frame_capture_->request_snapshot(snapshots_directory_ + file_basename.str(), std::move(j));
         LOG(INFO) << "snapshot " << file_basename.str();
     }
 }
@@ -255,25 +289,29 @@ void Nes::check_send_screenshot_to_agent()
     }
     last_agent_screenshot_ticks_ = clock_ticks_;
 
-    std::scoped_lock lock(display_.display_buffer_lock());
+    frame_capture_->request_agent_screenshot();
+}
 
-    std::vector<int8_t> image_data;
-    {
-        QImage image((const uchar*)display_.display_buffer(),
-                     NesDisplay::WIDTH, NesDisplay::HEIGHT,
-                     QImage::Format_RGBA8888);
+void Nes::check_agent_settings()
+{
+    const int32_t frame_skip = agent_interface_->take_frame_skip_request();
 
-        QByteArray byte_array;
-        QBuffer buffer(&byte_array);
-        buffer.open(QIODevice::WriteOnly);
+    if (frame_skip != AgentInterface::NO_REQUEST)
+    {
+        set_frame_skip(frame_skip);
+    }
+}
 
-        image.save(&buffer, "PNG");
+void Nes::set_frame_skip(int32_t frame_skip)
+{
+    frame_skip = std::max(frame_skip, 1);
 
-        image_data = std::vector<int8_t>(byte_array.begin(), byte_array.end());
-        LOG(INFO) << "qbytearray size " << byte_array.size() << " " << image_data.size();
+    ppu_->set_frame_skip(frame_skip);
+    if (ppu_render_thread_)
+    {
+        ppu_render_thread_->set_frame_skip(frame_skip);
     }
-
-    agent_interface_->send_screenshot(std::move(image_data));
+    LOG(INFO) << "frame skip " << frame_skip;
 }
 
 void Nes::adjust_emulation_speed()
@@ -329,6 +367,8 @@ void Nes::print_emulation_speed()
                   << "cycle " << processor_->cycle_count() << ", "
                   << "uptime: " << uptime_seconds.count() << " seconds" << std::endl;
 
+        display_.log_consumer_stats();
+
         last_update_time = std::chrono::high_resolution_clock::now();
         last_cycle_count = processor_->cycle_count();
     }
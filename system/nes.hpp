@@ -9,6 +9,8 @@
 #include "processor/nes_ppu.hpp"
 #include "processor/ppu_address_bus.hpp"
 #include "processor/processor_6502.hpp"
+#include "system/frame_capture.hpp"
+#include "system/ppu_render_thread.hpp"
 
 #include <atomic>
 #include <chrono>
@@ -26,6 +28,7 @@ public:
     Nes(std::shared_ptr<Cartridge> cartridge = nullptr);
 	virtual ~Nes();
 
+    // false without loading it when the cartridge is null or not valid
     bool load_cartridge(std::shared_ptr<Cartridge> cartridge);
     
 	// Run and execute instructions from memory
@@ -52,9 +55,29 @@ public:
     void check_capture_snapshot();
     
 	void check_send_screenshot_to_agent();
+	void check_agent_settings();
+
+	// Battery RAM is synced to its save file once a frame
+	void check_sync_battery_ram();
+
+    // Render 1 of every frame_skip frames, for fast forward and agent training. Emulation is
+    // unchanged, only the pixel output of the skipped frames is dropped.
+    void set_frame_skip(int32_t frame_skip);
+    int32_t frame_skip() const { return ppu_->frame_skip(); }
+
+    // Scaler for one of the frame consumers: display, snapshot or agent
+    bool set_scaler(std::string_view consumer, Scaler scaler) { return display_.set_consumer_scaler(consumer, scaler); }
+    bool set_ntsc_filter(std::string_view consumer, bool enabled) { return display_.set_consumer_ntsc_filter(consumer, enabled); }
 
     std::shared_ptr<AgentInterface> agent_interface() { return agent_interface_; }
 
+    // Cheats patch the ROM the CPU reads through the page table, see CPUPageTable. They're
+    // cleared when another cartridge is loaded.
+    void add_cheat(const CPUPageTable::Patch& patch);
+    void clear_cheats();
+    std::vector<CPUPageTable::Patch> cheats() const { return address_bus_.page_table().patches(); }
+    bool cheat_applied(const CPUPageTable::Patch& patch) const { return address_bus_.page_table().patch_applied(patch); }
+
 protected:
 	friend class CommandPrompt;
 	Processor6502& processor() { return *processor_; }
@@ -84,6 +107,9 @@ private:
 	std::shared_ptr<Joypads> joypads_;
 	bool nmi_signal_{false};
 
+	// only with ENABLE_PIPELINED_PPU_RENDERING
+	std::unique_ptr<PPURenderThread> ppu_render_thread_;
+
 	std::shared_ptr<AgentInterface> agent_interface_;
 
     std::atomic<State> state_{State::IDLE};
@@ -95,4 +121,8 @@ private:
     std::string snapshots_directory_;
 
     uint64_t last_agent_screenshot_ticks_;
+
+    uint64_t battery_ram_sync_frame_{0};
+
+    std::unique_ptr<FrameCapture> frame_capture_;
 };
@@ -0,0 +1,152 @@
+#include "system/nsf_player.hpp"
+
+#include <fstream>
+
+#include <glog/logging.h>
+
+NsfPlayer::NsfPlayer(std::shared_ptr<Cartridge_NSF> nsf)
+ : nsf_(nsf)
+{
+    processor_ = std::make_shared<Processor6502>(address_bus_, nmi_signal_);
+    apu_ = std::make_shared<NesAPU>(AudioPlayer::Output::Buffer);
+
+    address_bus_.attach_cpu(processor_);
+    address_bus_.attach_apu(apu_);
+    address_bus_.attach_cartridge(nsf_);
+
+    play_period_ticks_ = MASTER_CLOCK_HZ * nsf_->info().play_period_us / 1000000;
+}
+
+void NsfPlayer::start_track(int32_t track)
+{
+    // https://www.nesdev.org/wiki/NSF#Initializing_a_tune
+    nsf_->reset();
+    processor_->reset();
+    apu_->reset();
+
+    for (uint16_t a = 0;a < Processor6502::INTERNAL_MEMORY_SIZE;++a)
+    {
+        address_bus_.write(a, 0);
+    }
+
+    for (uint16_t a = NesAPU::PULSE1_REG1;a <= NesAPU::DMC_REG4;++a)
+    {
+        address_bus_.write(a, 0);
+    }
+    address_bus_.write(NesAPU::APU_STATUS, 0x00);
+    address_bus_.write(NesAPU::APU_STATUS, 0x0F);
+    address_bus_.write(NesAPU::APU_FRAME_COUNTER, 0x40);
+
+    processor_->registers().set_status_register_flag(Registers::INTERRUPT_DISABLE_FLAG);
+
+    clock_ticks_ = 0;
+    next_play_ticks_ = play_period_ticks_;
+
+    // X selects NTSC (0) or PAL (1), the clocks are NTSC
+    call(nsf_->info().init_address, static_cast<uint8_t>(track), 0);
+}
+
+void NsfPlayer::step()
+{
+    clock_ticks_ += CPU_CLOCK_DIVIDER;
+
+    if (in_routine_)
+    {
+        processor_->step();
+        in_routine_ = processor_->cregisters().PC != RETURN_ADDRESS;
+    }
+    else if (clock_ticks_ >= next_play_ticks_)
+    {
+        // a PLAY that ran past its period is followed by the next one right away
+        call(nsf_->info().play_address, 0, 0);
+        next_play_ticks_ += play_period_ticks_;
+    }
+
+    if (clock_ticks_ % APU_CLOCK_DIVIDER == 0)
+    {
+        apu_->step(clock_ticks_);
+    }
+}
+
+std::vector<int16_t> NsfPlayer::render(int32_t track, double seconds)
+{
+    // the APU's sample buffer holds under a second, it's emptied every 1/10th
+    static constexpr uint64_t READ_INTERVAL_TICKS = MASTER_CLOCK_HZ / 10;
+
+    std::vector<int16_t> samples;
+    samples.reserve(static_cast<size_t>(seconds * sample_rate()) + sample_rate());
+
+    start_track(track);
+    apu_->read_samples(samples);
+    samples.clear();
+
+    const uint64_t end_ticks = static_cast<uint64_t>(seconds * MASTER_CLOCK_HZ);
+    uint64_t next_read_ticks = READ_INTERVAL_TICKS;
+
+    while (clock_ticks_ < end_ticks)
+    {
+        step();
+
+        if (clock_ticks_ >= next_read_ticks)
+        {
+            apu_->read_samples(samples);
+            next_read_ticks += READ_INTERVAL_TICKS;
+        }
+    }
+    apu_->read_samples(samples);
+
+    return samples;
+}
+
+bool NsfPlayer::write_wav(const std::filesystem::path& path, const std::vector<int16_t>& samples, int32_t sample_rate)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+    {
+        LOG(ERROR) << "Could not write " << path;
+        return false;
+    }
+
+    auto write32 = [&out](uint32_t v) { out.write(reinterpret_cast<const char*>(&v), sizeof(v)); };
+    auto write16 = [&out](uint16_t v) { out.write(reinterpret_cast<const char*>(&v), sizeof(v)); };
+
+    // RIFF header and a PCM format chunk, mono 16 bit, then the samples. Little endian.
+    static constexpr uint16_t CHANNELS = 1;
+    static constexpr uint16_t BITS_PER_SAMPLE = 16;
+    const uint32_t data_size = static_cast<uint32_t>(samples.size() * sizeof(int16_t));
+
+    out.write("RIFF", 4);
+    write32(36 + data_size);
+    out.write("WAVE", 4);
+
+    out.write("fmt ", 4);
+    write32(16);
+    write16(1); // PCM
+    write16(CHANNELS);
+    write32(sample_rate);
+    write32(sample_rate * CHANNELS * BITS_PER_SAMPLE / 8);
+    write16(CHANNELS * BITS_PER_SAMPLE / 8);
+    write16(BITS_PER_SAMPLE);
+
+    out.write("data", 4);
+    write32(data_size);
+    out.write(reinterpret_cast<const char*>(samples.data()), data_size);
+
+    return out.good();
+}
+
+void NsfPlayer::call(uint16_t address, uint8_t a, uint8_t x)
+{
+    Registers& registers = processor_->registers();
+
+    // RTS returns to the pushed address + 1
+    const uint16_t return_address = RETURN_ADDRESS - 1;
+    address_bus_.stack_push(registers.SP, return_address >> 8);
+    address_bus_.stack_push(registers.SP, return_address & 0xFF);
+
+    registers.PC = address;
+    registers.A = a;
+    registers.X = x;
+
+    in_routine_ = true;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "io/nsf.hpp"
+#include "processor/address_bus.hpp"
+#include "processor/nes_apu.hpp"
+#include "processor/processor_6502.hpp"
+
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+class NsfPlayer
+{
+    // Plays an NSF with only the CPU and the APU, no PPU, display or joypads. The scheduler
+    // steps the CPU and APU on the master clock like Nes::step does, and calls the NSF's PLAY
+    // routine every play period from the header once INIT has returned.
+    //
+    // The APU mixes into a buffer on the calling thread instead of the audio device, so a
+    // track renders as fast as the CPU can be stepped. For listening to APU changes and for
+    // comparing the output of a change against a previous render.
+public:
+    static constexpr uint64_t MASTER_CLOCK_HZ = 21477272;
+
+    explicit NsfPlayer(std::shared_ptr<Cartridge_NSF> nsf);
+
+    // Resets the CPU, RAM and APU and runs INIT for the track, 0 based
+    void start_track(int32_t track);
+
+    // Step the system 1 CPU cycle
+    void step();
+
+    // Renders seconds of the track, 16 bit mono at sample_rate()
+    std::vector<int16_t> render(int32_t track, double seconds);
+    int32_t sample_rate() const { return apu_->sample_rate(); }
+
+    static bool write_wav(const std::filesystem::path& path, const std::vector<int16_t>& samples, int32_t sample_rate);
+
+    const Cartridge_NSF& nsf() const { return *nsf_; }
+
+private:
+    // INIT and PLAY return here with RTS. It is open bus, nothing executes it, the CPU isn't
+    // stepped again until the next call.
+    static constexpr uint16_t RETURN_ADDRESS = 0x4100;
+
+    static constexpr uint64_t CPU_CLOCK_DIVIDER = 12;
+    static constexpr uint64_t APU_CLOCK_DIVIDER = 24;
+
+    // JSR to the routine from outside the program
+    void call(uint16_t address, uint8_t a, uint8_t x);
+
+    std::shared_ptr<Cartridge_NSF> nsf_;
+
+    uint64_t clock_ticks_{0};
+    uint64_t play_period_ticks_{0};
+    uint64_t next_play_ticks_{0};
+    bool in_routine_{false}; // the CPU is running INIT or PLAY
+
+    AddressBus address_bus_;
+    bool nmi_signal_{false};
+
+    std::shared_ptr<Processor6502> processor_;
+    std::shared_ptr<NesAPU> apu_;
+};
@@ -0,0 +1,151 @@
+#include "system/ppu_render_thread.hpp"
+
+#include "processor/address_bus.hpp"
+
+#include <glog/logging.h>
+
+PPURenderThread::PPURenderThread(AddressBus& address_bus, NesDisplay& display)
+{
+    ppu_ = std::make_shared<NesPPU>(address_bus, ppu_address_bus_, display, nmi_signal_);
+    ppu_->set_mode(NesPPU::Mode::RenderOnly);
+
+    ppu_address_bus_.attach_ppu(ppu_);
+
+    thread_ = std::make_shared<std::thread>(&PPURenderThread::render_loop, this);
+}
+
+PPURenderThread::~PPURenderThread()
+{
+    {
+        std::scoped_lock lock(queue_lock_);
+        shutdown_ = true;
+    }
+    queue_changed_.notify_all();
+
+    thread_->join();
+}
+
+void PPURenderThread::end_frame(uint64_t dot)
+{
+    std::unique_lock lock(queue_lock_);
+
+    queue_changed_.wait(lock, [this]() { return frames_.size() < MAX_QUEUED_FRAMES || shutdown_; });
+
+    std::vector<Entry> next_entries;
+    if (!free_entries_.empty())
+    {
+        next_entries = std::move(free_entries_.back());
+        free_entries_.pop_back();
+    }
+
+    frames_.push({.entries = std::move(entries_), .pages = std::move(pages_), .end_dot = dot});
+    entries_ = std::move(next_entries);
+    pages_.clear();
+
+    queue_changed_.notify_all();
+}
+
+void PPURenderThread::flush()
+{
+    std::unique_lock lock(queue_lock_);
+
+    queue_changed_.wait(lock, [this]() { return (frames_.empty() && !replaying_) || shutdown_; });
+
+    // the pages were copied from memory that may be about to be released
+    shadow_pages_.clear();
+}
+
+void PPURenderThread::render_loop()
+{
+    while (true)
+    {
+        Frame frame;
+        {
+            std::unique_lock lock(queue_lock_);
+
+            queue_changed_.wait(lock, [this]() { return !frames_.empty() || shutdown_; });
+
+            if (shutdown_)
+            {
+                return;
+            }
+            frame = std::move(frames_.front());
+            frames_.pop();
+            replaying_ = true;
+        }
+        queue_changed_.notify_all();
+
+        replay(frame);
+
+        {
+            std::scoped_lock lock(queue_lock_);
+
+            frame.entries.clear();
+            free_entries_.push_back(std::move(frame.entries));
+            replaying_ = false;
+        }
+        queue_changed_.notify_all();
+    }
+}
+
+void PPURenderThread::replay(const Frame& frame)
+{
+    // Step the PPU up to the dot of each access and apply it, the same order the emulation
+    // thread's PPU saw them in
+    PPUPageTable& page_table = ppu_address_bus_.page_table();
+
+    for (const Entry& entry : frame.entries)
+    {
+        while (ppu_->dot_count() < entry.dot)
+        {
+            ppu_->step();
+        }
+
+        switch (entry.access)
+        {
+            case Access::RegisterWrite:
+                ppu_->write_register(entry.address, entry.value);
+                break;
+
+            case Access::RegisterRead:
+                ppu_->read_register(entry.address);
+                break;
+
+            case Access::MapCiram:
+                page_table.map_page(entry.address, page_table.ciram() + entry.offset, true);
+                break;
+
+            case Access::MapChr:
+                page_table.map_page(entry.address,
+                                    entry.writable ? shadow_page(entry.memory, frame.pages[entry.offset]) : entry.memory,
+                                    entry.writable);
+                break;
+
+            case Access::Reset:
+                ppu_->reset();
+                break;
+        }
+    }
+
+    while (ppu_->dot_count() < frame.end_dot)
+    {
+        ppu_->step();
+    }
+}
+
+uint8_t* PPURenderThread::shadow_page(uint8_t* memory, const Page& snapshot)
+{
+    // Read only memory is shared with the emulation thread, but the emulation thread keeps
+    // writing the writable pages while the renderer is frames behind. The renderer's copy only
+    // changes as the logged writes are replayed, starting from the snapshot the emulation thread
+    // took at the mapping. The copy and the snapshot are the same when the page was mapped
+    // before, resetting it keeps every page mapping the memory on the one copy.
+    std::unique_ptr<Page>& page = shadow_pages_[memory];
+
+    if (!page)
+    {
+        page = std::make_unique<Page>();
+    }
+    *page = snapshot;
+    return page->data();
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "io/display.hpp"
+#include "processor/nes_ppu.hpp"
+#include "processor/ppu_access_log.hpp"
+#include "processor/ppu_address_bus.hpp"
+
+#include <array>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class AddressBus;
+
+class PPURenderThread : public PPUAccessLog
+{
+    // Pipelined PPU rendering. The emulation thread's PPU runs in TimingOnly mode and logs its
+    // accesses here. At the end of each frame the log is handed to a render thread which replays
+    // it into its own RenderOnly PPU. That PPU draws the frame into the display, one frame behind
+    // the emulation, while the emulation thread moves on to the next frame.
+public:
+    // frames the emulation thread can get ahead of the renderer before it waits
+    static constexpr size_t MAX_QUEUED_FRAMES = 2;
+
+    PPURenderThread(AddressBus& address_bus, NesDisplay& display);
+    ~PPURenderThread();
+
+    // Called on the emulation thread, queues the frame's log for rendering
+    void end_frame(uint64_t dot) override;
+
+    // Blocks until every queued frame has been rendered. Call before the cartridge memory that
+    // the logged mappings point to goes away.
+    void flush();
+
+    // Frame skip is applied by the renderer's PPU, the emulation thread's PPU never draws
+    void set_frame_skip(int32_t frame_skip) { ppu_->set_frame_skip(frame_skip); }
+
+private:
+    struct Frame
+    {
+        std::vector<Entry> entries;
+        std::vector<Page> pages; // the snapshots of the writable MapChr entries
+        uint64_t end_dot;
+    };
+
+    void render_loop();
+    void replay(const Frame& frame);
+
+    // The renderer's copy of a page of writable cartridge memory (CHR-RAM, four screen vram),
+    // reset to the snapshot taken when the emulation thread mapped it
+    uint8_t* shadow_page(uint8_t* memory, const Page& snapshot);
+
+    PPUAddressBus ppu_address_bus_;
+    std::shared_ptr<NesPPU> ppu_;
+    bool nmi_signal_{false}; // the renderer's NMIs go nowhere
+
+    std::unordered_map<uint8_t*, std::unique_ptr<Page>> shadow_pages_;
+
+    std::mutex queue_lock_;
+    std::condition_variable queue_changed_;
+    std::queue<Frame> frames_;
+    std::vector<std::vector<Entry>> free_entries_; // recycled log buffers
+    bool replaying_{false};
+    bool shutdown_{false};
+
+    std::shared_ptr<std::thread> thread_;
+};
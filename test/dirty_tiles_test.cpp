@@ -0,0 +1,154 @@
+#include "test/dirty_tiles_test.hpp"
+
+#include "processor/address_bus.hpp"
+#include "processor/nes_ppu.hpp"
+#include "processor/ppu_address_bus.hpp"
+
+#include <glog/logging.h>
+
+#include <array>
+#include <vector>
+
+bool DirtyTilesTest::run()
+{
+    AddressBus address_bus;
+    PPUAddressBus ppu_address_bus;
+    NesDisplay display;
+    display.set_refresh_callback([]() {});
+    bool nmi_signal = false;
+
+    std::shared_ptr<NesPPU> ppu = std::make_shared<NesPPU>(address_bus, ppu_address_bus, display, nmi_signal);
+    ppu_address_bus.attach_ppu(ppu);
+
+    // tile 1 is striped, the nametable is filled with it
+    std::vector<uint8_t> chr(0x2000, 0);
+    std::fill(chr.begin() + 0x10, chr.begin() + 0x18, 0x55);
+
+    PPUPageTable& page_table = ppu_address_bus.page_table();
+    page_table.map_chr(0x0000, chr, false);
+    page_table.map_nametables(PPUPageTable::NametableMirroring::Horizontal);
+
+    ppu->reset();
+
+    FrameMailbox mailbox("dirty_tiles_test");
+    display.add_consumer(&mailbox);
+
+    auto write_vram = [&ppu](uint16_t address, uint8_t value)
+    {
+        ppu->write_register(NesPPU::PPUADDR, address >> 8);
+        ppu->write_register(NesPPU::PPUADDR, address & 0xFF);
+        ppu->write_register(NesPPU::PPUDATA, value);
+
+        // back to scroll 0, PPUADDR shares its register with the scroll
+        ppu->write_register(NesPPU::PPUADDR, 0);
+        ppu->write_register(NesPPU::PPUADDR, 0);
+    };
+
+    for (uint16_t tile = 0;tile < NesPPU::NAMETABLE_WIDTH * NesPPU::NAMETABLE_HEIGHT;++tile)
+    {
+        write_vram(0x2000 + tile, 1);
+    }
+    write_vram(0x3F01, 0x30);
+    ppu->write_register(NesPPU::PPUMASK, NesPPU::PPUMASK_BACKGROUND | NesPPU::PPUMASK_SHOW_BACKGROUND_LEFT_EDGE);
+
+    NesDisplay::DirtyTiles none{};
+    NesDisplay::DirtyTiles one_tile{};
+    one_tile[DIRTY_TILE_INDEX / NesPPU::NAMETABLE_WIDTH] = 1u << (DIRTY_TILE_INDEX % NesPPU::NAMETABLE_WIDTH);
+
+    // a few frames to settle, the first frames after enabling rendering are all dirty
+    for (int32_t i = 0;i < 3;++i)
+    {
+        if (!run_frame(*ppu, display))
+        {
+            return false;
+        }
+    }
+    uint64_t previous_frame = mailbox.take()->number();
+
+    // both odd and even frames
+    for (int32_t i = 0;i < 4;++i)
+    {
+        if (!run_frame(*ppu, display))
+        {
+            return false;
+        }
+        FrameRef frame = mailbox.take();
+        check("static screen", *frame, previous_frame, none);
+        previous_frame = frame->number();
+    }
+
+    // the write happens in vblank, the next frame shows it
+    write_vram(0x2000 + DIRTY_TILE_INDEX, 2);
+
+    if (!run_frame(*ppu, display))
+    {
+        return false;
+    }
+    FrameRef frame = mailbox.take();
+    check("nametable write", *frame, previous_frame, one_tile);
+    previous_frame = frame->number();
+
+    if (!run_frame(*ppu, display))
+    {
+        return false;
+    }
+    frame = mailbox.take();
+    check("after nametable write", *frame, previous_frame, none);
+    previous_frame = frame->number();
+
+    // skipped frames aren't published, the published ones are still compared to the last one
+    ppu->set_frame_skip(3);
+
+    for (int32_t i = 0;i < 4;++i)
+    {
+        if (!run_frame(*ppu, display))
+        {
+            return false;
+        }
+        frame = mailbox.take();
+        check("static screen with frame skip", *frame, previous_frame, none);
+        previous_frame = frame->number();
+    }
+
+    display.remove_consumer(&mailbox);
+
+    LOG(INFO) << "DirtyTilesTest " << (passed_ ? "passed" : "failed");
+    return passed_;
+}
+
+bool DirtyTilesTest::run_frame(NesPPU& ppu, NesDisplay& display)
+{
+    const uint64_t frame_count = display.frame_count();
+
+    for (int32_t dot = 0;dot < 3 * NesPPU::SCANLINES * NesPPU::PIXELS_PER_LINE;++dot)
+    {
+        ppu.step();
+
+        if (display.frame_count() != frame_count)
+        {
+            return true;
+        }
+    }
+    LOG(ERROR) << "DirtyTilesTest: no frame was published";
+    passed_ = false;
+    return false;
+}
+
+bool DirtyTilesTest::check(std::string_view name, const VideoFrame& frame, uint64_t previous_frame,
+                           const NesDisplay::DirtyTiles& expected)
+{
+    NesDisplay::DirtyTiles dirty;
+    frame.dirty_tiles_since(previous_frame, dirty);
+
+    for (int32_t row = 0;row < NesDisplay::TILE_ROWS;++row)
+    {
+        if (dirty[row] != expected[row])
+        {
+            LOG(ERROR) << "DirtyTilesTest " << name << ": frame " << frame.number() << " tile row " << row
+                       << " dirty " << std::hex << dirty[row] << " expected " << expected[row] << std::dec;
+            passed_ = false;
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "io/display.hpp"
+
+#include <cstdint>
+#include <string_view>
+
+class NesPPU;
+
+class DirtyTilesTest
+{
+public:
+	// Drives a PPU through its registers, without a CPU or cartridge, and checks the dirty tiles
+	// of the frames it publishes: a static screen publishes no dirty tiles, on odd and even frames
+	// and with frame skip, and a nametable write dirties only its tile. Logs each failed check and
+	// returns false if there was one.
+	bool run();
+
+private:
+	static constexpr uint16_t DIRTY_TILE_INDEX = 0x21; // tile row 1, column 1
+
+	// Step the PPU until the display publishes a frame. Returns false if it doesn't within 3 frames,
+	// the frame skip this test uses.
+	bool run_frame(NesPPU& ppu, NesDisplay& display);
+
+	bool check(std::string_view name, const VideoFrame& frame, uint64_t previous_frame,
+	           const NesDisplay::DirtyTiles& expected);
+
+	bool passed_{true};
+};
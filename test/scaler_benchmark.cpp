@@ -0,0 +1,111 @@
+#include "test/scaler_benchmark.hpp"
+
+#include "io/display.hpp"
+#include "io/frame_pool.hpp"
+#include "io/ntsc_filter.hpp"
+#include "io/scalers.hpp"
+#include "lib/magic_enum.hpp"
+
+#include <glog/logging.h>
+
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+void ScalerBenchmark::run()
+{
+    // Tiles of diagonal edges and flat areas with a sprinkling of noise, closer to game frames
+    // than random pixels, which would never take the edge paths
+    std::vector<uint8_t> frame(NesDisplay::WIDTH * NesDisplay::HEIGHT);
+
+    uint32_t noise = 0x12345678;
+    for (int32_t y = 0;y < NesDisplay::HEIGHT;++y)
+    {
+        for (int32_t x = 0;x < NesDisplay::WIDTH;++x)
+        {
+            noise = noise * 1664525 + 1013904223;
+
+            const int32_t tile = (x / 8 + y / 8) % 5;
+            const bool above_diagonal = (x % 8) < (y % 8);
+            frame[y * NesDisplay::WIDTH + x] = (noise >> 28) == 0 ? (noise >> 8) & 0x3F :
+                                               (tile * 7 + above_diagonal) & 0x3F;
+        }
+    }
+
+    VideoFrame video_frame;
+    std::memcpy(video_frame.pixels_, frame.data(), frame.size());
+
+    for (Scaler scaler : magic_enum::enum_values<Scaler>())
+    {
+        const int32_t factor = scale_factor(scaler);
+        const int32_t scaled_width = NesDisplay::WIDTH * factor;
+        const int32_t scaled_height = NesDisplay::HEIGHT * factor;
+
+        std::vector<uint8_t> vector_output(scaled_width * scaled_height);
+        std::vector<uint8_t> scalar_output(scaled_width * scaled_height);
+        std::vector<uint8_t> rgba(scaled_width * scaled_height * BYTES_PER_PIXEL);
+
+        scale_indexed(scaler, frame.data(), NesDisplay::WIDTH, NesDisplay::WIDTH, NesDisplay::HEIGHT,
+                      vector_output.data(), scaled_width);
+        scale_indexed_scalar(scaler, frame.data(), NesDisplay::WIDTH, NesDisplay::WIDTH, NesDisplay::HEIGHT,
+                             scalar_output.data(), scaled_width);
+
+        LOG_IF(ERROR, vector_output != scalar_output) << scaler_name(scaler)
+                                                      << ": vector output differs from scalar";
+
+        auto start = std::chrono::steady_clock::now();
+        for (int32_t i = 0;i < ITERATIONS;++i)
+        {
+            scale_indexed(scaler, frame.data(), NesDisplay::WIDTH, NesDisplay::WIDTH, NesDisplay::HEIGHT,
+                          vector_output.data(), scaled_width);
+        }
+        auto scaled = std::chrono::steady_clock::now();
+
+        for (int32_t i = 0;i < ITERATIONS;++i)
+        {
+            NesDisplay::convert_frame_scaled(video_frame, scaler, PixelFormat::RGBA8888, rgba.data(),
+                                             scaled_width * BYTES_PER_PIXEL);
+        }
+        auto converted = std::chrono::steady_clock::now();
+
+        const double scale_ms = std::chrono::duration<double, std::milli>(scaled - start).count() / ITERATIONS;
+        const double convert_ms = std::chrono::duration<double, std::milli>(converted - scaled).count() / ITERATIONS;
+
+        LOG(INFO) << scaler_name(scaler) << " " << scaled_width << "x" << scaled_height
+                  << ": scale " << scale_ms << "ms, scale + convert " << convert_ms << "ms ("
+                  << 100.0 * convert_ms / FRAME_MS << "% of a frame)";
+    }
+
+    // the NTSC filter, checked line by line with every emphasis and phase
+    {
+        const int32_t filtered_width = NesDisplay::WIDTH * NTSC_SCALE;
+
+        std::vector<uint8_t> vector_line(filtered_width * BYTES_PER_PIXEL);
+        std::vector<uint8_t> scalar_line(filtered_width * BYTES_PER_PIXEL);
+        std::vector<uint8_t> rgba(filtered_width * NesDisplay::HEIGHT * NTSC_SCALE * BYTES_PER_PIXEL);
+
+        bool matches = true;
+        for (int32_t y = 0;y < NesDisplay::HEIGHT;++y)
+        {
+            ntsc_filter_line(&frame[y * NesDisplay::WIDTH], NesDisplay::WIDTH, y % 8, y % NTSC_PHASES,
+                             vector_line.data(), PixelFormat::RGBA8888);
+            ntsc_filter_line_scalar(&frame[y * NesDisplay::WIDTH], NesDisplay::WIDTH, y % 8, y % NTSC_PHASES,
+                                    scalar_line.data(), PixelFormat::RGBA8888);
+            matches = matches && vector_line == scalar_line;
+        }
+        LOG_IF(ERROR, !matches) << "NTSC: vector output differs from scalar";
+
+        auto start = std::chrono::steady_clock::now();
+        for (int32_t i = 0;i < ITERATIONS;++i)
+        {
+            NesDisplay::convert_frame_ntsc(video_frame, PixelFormat::RGBA8888, rgba.data(),
+                                           filtered_width * BYTES_PER_PIXEL);
+        }
+        auto filtered = std::chrono::steady_clock::now();
+
+        const double filter_ms = std::chrono::duration<double, std::milli>(filtered - start).count() / ITERATIONS;
+
+        LOG(INFO) << "NTSC " << filtered_width << "x" << NesDisplay::HEIGHT * NTSC_SCALE << ": " << filter_ms
+                  << "ms (" << 100.0 * filter_ms / FRAME_MS << "% of a frame)";
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+class ScalerBenchmark
+{
+public:
+	// Times each scaler on a synthetic frame, on its own and with the palette conversion that
+	// follows it on the consumer side, and the NTSC filter, and reports the time per frame and
+	// the share of a 60Hz frame (16.6ms) it takes on one core. The vector kernels are checked
+	// against the scalar ones first.
+	void run();
+
+private:
+	static constexpr int32_t ITERATIONS = 500;
+	static constexpr double FRAME_MS = 1000.0 / 60.0;
+};